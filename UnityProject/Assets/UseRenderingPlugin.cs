@@ -17,6 +17,158 @@ enum FastVideoError
 	FileNotFound		= 3,
 }
 
+//	matches TFramePoolStats
+[StructLayout(LayoutKind.Sequential)]
+public struct FramePoolStats
+{
+	public ulong	BudgetBytes;
+	public ulong	AllocatedBytes;
+	public ulong	UsedBytes;
+	public ulong	PeakBytes;
+	public ulong	IdleBytes;
+	public int		AllocatedFrames;
+	public int		UsedFrames;
+	public int		SizeClasses;
+	public int		AllocFailures;
+	public int		MappedFrames;
+}
+
+//	matches TUploadSchedulerStats
+[StructLayout(LayoutKind.Sequential)]
+public struct UploadSchedulerStats
+{
+	public ulong	RenderFrames;
+	public ulong	Uploads;
+	public ulong	DeferredUploads;
+	public ulong	OverBudgetFrames;
+	public int		BudgetMs;
+	public int		LastFrameMs;
+	public int		LastFrameUploads;
+	public int		LastFrameDeferred;
+	public int		MaxWaitMs;
+}
+
+//	matches TInstanceStats
+[StructLayout(LayoutKind.Sequential)]
+public struct InstanceStats
+{
+	public ulong	FramesDecoded;
+	public ulong	FramesConverted;
+	public ulong	FramesUploaded;
+	public ulong	FramesSkipped;
+	public ulong	FramesDropped;
+	public ulong	BytesRead;
+	public int		BufferedFrames;
+	public int		PoolFramesHeld;
+	public int		LagMs;
+	public float	DecodeAvgMs;
+	public float	DecodeMaxMs;
+	public float	ConvertAvgMs;
+	public float	ConvertMaxMs;
+	public float	UploadAvgMs;
+	public float	UploadMaxMs;
+}
+
+//	matches TPipelineStage
+public enum PipelineStage
+{
+	PacketRead	= 0,
+	Decode		= 1,
+	Convert		= 2,
+	PoolWait	= 3,
+	Residency	= 4,
+	StagingCopy	= 5,
+	Upload		= 6,
+	EndToEnd	= 7,
+}
+
+//	matches TLatencyPercentiles
+[StructLayout(LayoutKind.Sequential)]
+public struct LatencyPercentiles
+{
+	public ulong	Count;
+	public float	MeanMs;
+	public float	P50Ms;
+	public float	P90Ms;
+	public float	P99Ms;
+	public float	P999Ms;
+	public float	MaxMs;
+}
+
+//	matches TFastVideoState
+public enum FastVideoState
+{
+	FirstFrame	= 0,
+	Playing		= 1,
+	Paused		= 2,
+}
+
+//	matches TInstanceCommandOp
+public enum InstanceCommandOp
+{
+	Pause				= 0,
+	Resume				= 1,
+	SetLooping			= 2,
+	SetPlaybackRate		= 3,
+	SetTime				= 4,
+	SetScrubbing		= 5,
+	StepFrame			= 6,
+	SetUploadPriority	= 7,
+}
+
+//	matches TInstanceCommand
+[StructLayout(LayoutKind.Sequential)]
+public struct InstanceCommand
+{
+	public ulong	Instance;
+	public ulong	TimeMs;
+	public int		Op;
+	public int		IntArg;
+	public float	FloatArg;
+}
+
+//	matches TInstanceStatus
+[StructLayout(LayoutKind.Sequential)]
+public struct InstanceStatus
+{
+	public ulong	TimeMs;
+	public ulong	FrameMs;
+	public int		Valid;
+	public int		State;
+	public int		Looping;
+	public int		Scrubbing;
+	public float	PlaybackRate;
+	public int		UploadPriority;
+}
+
+//	matches TTestDecoderCost
+public enum TestDecoderCost
+{
+	None		= 0,
+	Fixed		= 1,
+	Workload	= 2,
+}
+
+//	matches TTestDecoderParams
+[StructLayout(LayoutKind.Sequential)]
+public struct TestDecoderParams
+{
+	public int		Width;
+	public int		Height;
+	public int		Format;
+	public float	FramesPerSecond;
+	public int		FrameCount;
+	public int		CostModel;
+	public int		CostUs;
+	public int		CostPasses;
+	public int		KeyframeInterval;
+	public int		BFrames;
+	public int		OutOfOrder;
+	public int		InitDelayMs;
+	public int		InitFail;
+	public uint		Seed;
+}
+
 //	class that interfaces with FastVideo
 public class FastVideo : MonoBehaviour
 {
@@ -29,11 +181,41 @@ public class FastVideo : MonoBehaviour
 	[DllImport ("FastVideo")]	private static extern bool	Pause(ulong Instance);
 	[DllImport ("FastVideo")]	private static extern bool	Resume(ulong Instance);
 	[DllImport ("FastVideo")]	private static extern bool	SetLooping(ulong Instance,bool EnableLooping);
+	[DllImport ("FastVideo")]	private static extern bool	SetPlaybackRate(ulong Instance,float Rate);
+	[DllImport ("FastVideo")]	private static extern bool	SetTime(ulong Instance,ulong TimeMs);
+	[DllImport ("FastVideo")]	private static extern bool	SetScrubbing(ulong Instance,bool EnableScrubbing);
+	[DllImport ("FastVideo")]	private static extern bool	StepFrame(ulong Instance,int Steps);
+	[DllImport ("FastVideo")]	private static extern bool	ShareDecoder(ulong Instance,ulong SourceInstance);
+	[DllImport ("FastVideo")]	private static extern bool	SetUploadBufferCount(ulong Instance,int Count);
+	[DllImport ("FastVideo")]	private static extern bool	SetDirtyRegionUploads(ulong Instance,bool Enable);
+	[DllImport ("FastVideo")]	private static extern bool	SetAtlasTexture(ulong Instance,System.IntPtr Texture,int x,int y,int Width,int Height);
+	[DllImport ("FastVideo")]	private static extern bool	SetUploadPriority(ulong Instance,int Priority);
+	[DllImport ("FastVideo")]	private static extern int	SubmitCommands(InstanceCommand[] Commands,int Count);
+	[DllImport ("FastVideo")]	private static extern int	GetInstanceStatus(ulong[] Instances,[In, Out] InstanceStatus[] Statuses,int Count);
+	[DllImport ("FastVideo")]	public static extern void	SetUploadBudget(int BudgetMs);
+	[DllImport ("FastVideo")]	public static extern bool	GetUploadSchedulerStats(ref UploadSchedulerStats Stats);
+	[DllImport ("FastVideo")]	private static extern bool	GetInstanceStats(ulong Instance,ref InstanceStats Stats);
+	[DllImport ("FastVideo")]	private static extern bool	GetLatencyPercentiles(ulong Instance,int Stage,ref LatencyPercentiles Percentiles);
+	[DllImport ("FastVideo")]	private static extern bool	GetGlobalLatencyPercentiles(int Stage,ref LatencyPercentiles Percentiles);
+	[DllImport ("FastVideo")]	public static extern void	ResetLatencyStats();
+	[DllImport ("FastVideo")]	public static extern bool	UseMemoryDevice(float RenderRateHz);
+	[DllImport ("FastVideo")]	public static extern System.IntPtr	AllocMemoryTexture(int Width,int Height,int Format);
+	[DllImport ("FastVideo")]	public static extern bool	FreeMemoryTexture(System.IntPtr Texture);
+	[DllImport ("FastVideo")]	public static extern bool	ReadMemoryTexture(System.IntPtr Texture,byte[] Buffer,int BufferSize);
+	[DllImport ("FastVideo")]	public static extern void	SetFramePoolBudget(ulong Bytes);
+	[DllImport ("FastVideo")]	public static extern bool	GetFramePoolStats(ref FramePoolStats Stats);
 	[DllImport ("FastVideo")]	public static extern void	EnableTestDecoder(bool Enable);
+	[DllImport ("FastVideo")]	public static extern void	SetTestDecoderParams(ref TestDecoderParams Params);
+	[DllImport ("FastVideo")]	public static extern bool	GetTestDecoderParams(ref TestDecoderParams Params);
+	[DllImport ("FastVideo")]	private static extern bool	EncodeTestClip(char[] Filename, int Length);
 	[DllImport ("FastVideo")]	public static extern void	EnableDebugTimers(bool Enable);
 	[DllImport ("FastVideo")]	public static extern void	EnableDebugLag(bool Enable);
 	[DllImport ("FastVideo")]	public static extern void	EnableDebugError(bool Enable);
 	[DllImport ("FastVideo")]	public static extern void	EnableDebugFull(bool Enable);
+	[DllImport ("FastVideo")]	public static extern ulong	GetDroppedLogCount();
+	[DllImport ("FastVideo")]	public static extern void	EnableTrace(bool Enable);
+	[DllImport ("FastVideo")]	public static extern void	ClearTrace();
+	[DllImport ("FastVideo")]	private static extern bool	WriteTraceFile(char[] Filename, int Length);
 
 	//	delegate type and singleton
 	static private bool 			gCallbacksInitialised = false;
@@ -108,6 +290,18 @@ public class FastVideo : MonoBehaviour
 		SetVideo( mInstance, Filename.ToCharArray(), Filename.Length );
 	}
 
+	//	write the test decoder's video (see SetTestDecoderParams) so the real decoder can play the same frames
+	public static bool EncodeTestClip(string Filename)
+	{
+		return EncodeTestClip( Filename.ToCharArray(), Filename.Length );
+	}
+
+	//	timer scopes recorded since EnableTrace, as json for chrome://tracing
+	public static bool WriteTraceFile(string Filename)
+	{
+		return WriteTraceFile( Filename.ToCharArray(), Filename.Length );
+	}
+
     public void Pause()
     {
         Pause(mInstance);
@@ -123,6 +317,95 @@ public class FastVideo : MonoBehaviour
         SetLooping(mInstance,EnableLooping);
     }
 
+    //	negative rates play backwards
+    public void SetPlaybackRate(float Rate)
+    {
+        SetPlaybackRate(mInstance,Rate);
+    }
+
+    public void SetTime(ulong TimeMs)
+    {
+        SetTime(mInstance,TimeMs);
+    }
+
+    //	while scrubbing, time only moves with SetTime/StepFrame
+    public void SetScrubbing(bool EnableScrubbing)
+    {
+        SetScrubbing(mInstance,EnableScrubbing);
+    }
+
+    public void StepFrame(int Steps)
+    {
+        StepFrame(mInstance,Steps);
+    }
+
+    //	show another instance's video without decoding it again. null to decode our own
+    public bool ShareDecoder(FastVideo Source)
+    {
+        return ShareDecoder(mInstance, Source!=null ? Source.mInstance : 0);
+    }
+
+    //	staging buffers between decoding and rendering (1-4). More smooths out uneven decode times
+    public bool SetUploadBufferCount(int Count)
+    {
+        return SetUploadBufferCount(mInstance, Count);
+    }
+
+    //	for mostly-static videos; only the 64x64 tiles that changed are uploaded. Costs some cpu to hash each frame
+    public bool SetDirtyRegionUploads(bool Enable)
+    {
+        return SetDirtyRegionUploads(mInstance, Enable);
+    }
+
+    //	draw into a region of a texture shared with other instances; they're all uploaded together. null to use our own texture again
+    public bool SetAtlasTexture(Texture2D AtlasTexture,int x,int y,int Width,int Height)
+    {
+        System.IntPtr TexturePtr = AtlasTexture!=null ? AtlasTexture.GetNativeTexturePtr() : System.IntPtr.Zero;
+        return SetAtlasTexture(mInstance, TexturePtr, x, y, Width, Height);
+    }
+
+    //	when the render thread is over its upload budget, higher priorities go first
+    public bool SetUploadPriority(int Priority)
+    {
+        return SetUploadPriority(mInstance, Priority);
+    }
+
+    //	for InstanceCommand and GetStatus
+    public ulong GetHandle()
+    {
+        return mInstance;
+    }
+
+    //	many instances' Pause/Resume/SetTime etc in one call. They're all applied at the start of the next render.
+    //	Returns Commands.Length, or 0 if the queue is too full for all of them (then none are queued)
+    public static int SubmitCommands(InstanceCommand[] Commands)
+    {
+        return SubmitCommands(Commands, Commands.Length);
+    }
+
+    //	fills one status per handle. Returns how many haven't been freed
+    public static int GetStatus(ulong[] Instances,InstanceStatus[] Statuses)
+    {
+        return GetInstanceStatus(Instances, Statuses, System.Math.Min(Instances.Length, Statuses.Length));
+    }
+
+    //	cheap enough to poll every frame
+    public bool GetStats(ref InstanceStats Stats)
+    {
+        return GetInstanceStats(mInstance, ref Stats);
+    }
+
+    public bool GetLatency(PipelineStage Stage,ref LatencyPercentiles Percentiles)
+    {
+        return GetLatencyPercentiles(mInstance, (int)Stage, ref Percentiles);
+    }
+
+    //	every instance, including ones that have been freed
+    public static bool GetGlobalLatency(PipelineStage Stage,ref LatencyPercentiles Percentiles)
+    {
+        return GetGlobalLatencyPercentiles((int)Stage, ref Percentiles);
+    }
+
     //	create end-of-render thread callback
 	IEnumerator Start() 
 	{
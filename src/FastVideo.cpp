@@ -2,7 +2,9 @@
 #include "FastVideo.h"
 #include "SoyDecoder.h"
 #include "SoyThread.h"
+#include <SortArray.h>
 #include <sstream>
+#include <cstdio>
 #include "TFastTexture.h"
 
 
@@ -25,8 +27,6 @@ namespace Unity
 #endif
 		TFastVideo*		gFastVideo = nullptr;
 	};
-
-	TFastVideo&			GetFastVideo();			//	allocate singleton if it hasn't been constructed. This avoids us competeting for crt construction order
 };
 
 
@@ -46,79 +46,330 @@ TFastVideo& Unity::GetFastVideo()
 
 
 
+class TSortPolicy_TFastTextureByUploadScore
+{
+public:
+	//	most urgent first
+	static int		Compare(const TFastTexture* a,const TFastTexture* b)
+	{
+		auto Scorea = a->GetUploadScore();
+		auto Scoreb = b->GetUploadScore();
+
+		if ( Scorea > Scoreb ) return -1;
+		if ( Scorea < Scoreb ) return 1;
+		return 0;
+	}
+};
+
+
+TUploadSchedulerCounters::TUploadSchedulerCounters() :
+	mBudgetMs	( DEFAULT_UPLOAD_BUDGET_MS )
+{
+	Reset();
+}
+
+void TUploadSchedulerCounters::OnRenderFrame(int BudgetMs,int FrameMs,int Uploads,int Deferred,int MaxWaitMs)
+{
+	mRenderFrames++;
+	mUploads += Uploads;
+	mDeferredUploads += Deferred;
+	if ( BudgetMs > 0 && FrameMs > BudgetMs )
+		mOverBudgetFrames++;
+	mLastFrameMs = FrameMs;
+	mLastFrameUploads = Uploads;
+	mLastFrameDeferred = Deferred;
+
+	//	a reset on another thread can lower it under us
+	int OldMaxWaitMs = mMaxWaitMs;
+	while ( MaxWaitMs > OldMaxWaitMs && !mMaxWaitMs.compare_exchange_weak( OldMaxWaitMs, MaxWaitMs ) )
+	{
+	}
+}
+
+void TUploadSchedulerCounters::GetStats(TUploadSchedulerStats& Stats) const
+{
+	Stats.mRenderFrames = mRenderFrames.load();
+	Stats.mUploads = mUploads.load();
+	Stats.mDeferredUploads = mDeferredUploads.load();
+	Stats.mOverBudgetFrames = mOverBudgetFrames.load();
+	Stats.mBudgetMs = mBudgetMs.load();
+	Stats.mLastFrameMs = mLastFrameMs.load();
+	Stats.mLastFrameUploads = mLastFrameUploads.load();
+	Stats.mLastFrameDeferred = mLastFrameDeferred.load();
+	Stats.mMaxWaitMs = mMaxWaitMs.load();
+}
+
+void TUploadSchedulerCounters::Reset()
+{
+	mRenderFrames = 0;
+	mUploads = 0;
+	mDeferredUploads = 0;
+	mOverBudgetFrames = 0;
+	mLastFrameMs = 0;
+	mLastFrameUploads = 0;
+	mLastFrameDeferred = 0;
+	mMaxWaitMs = 0;
+}
+
+
+THeadlessRenderThread::THeadlessRenderThread(float RateHz) :
+	SoyThread		( "THeadlessRenderThread" ),
+	mIntervalMs		( static_cast<int>( 1000.f / ofMax( 1.f, RateHz ) ) )
+{
+}
+
+void THeadlessRenderThread::threadedFunction()
+{
+	Trace::TThread TraceThread("THeadlessRenderThread");
+	while ( isThreadRunning() )
+	{
+		sleep( mIntervalMs );
+		Unity::GetFastVideo().OnPostRender();
+	}
+}
+
+
 TFastVideo::TFastVideo() :
 	mDebugFunc			( nullptr ),
 	mOnErrorFunc		( nullptr ),
-	mFramePool			( DEFAULT_MAX_POOL_SIZE ),
-	mNextInstanceRef	( "FastTxture" )
+	mFramePool			( DEFAULT_MAX_POOL_SIZE )
 {
+	mNextInstanceRef.Get() = SoyRef("FastTxture");
+#if defined(BUFFER_DEBUG_LOG)
+	mDebugLogDropsReported = 0;
+#endif
+	mTestDecoderParams.Get() = TTestFrameGenerator::GetDefaultParams();
 }
 
 TFastVideo::~TFastVideo()
 {
 }
 
-SoyRef TFastVideo::AllocInstance()
+Unity::ulong TFastVideo::AllocInstance()
 {
-	ofMutex::ScopedLock Lock( mInstancesLock );
-	auto* pInstance = new TFastTexture( mNextInstanceRef, mFramePool );
+	SoyRef InstanceRef;
+	{
+		ofMutex::ScopedLock Lock( mNextInstanceRef );
+		InstanceRef = mNextInstanceRef.Get();
+		mNextInstanceRef.Get()++;
+	}
+
+	auto* pInstance = new TFastTexture( InstanceRef, mFramePool );
 	if ( !pInstance )
-		return SoyRef();
+		return 0;
 	pInstance->SetDevice( mDevice );
-	mNextInstanceRef++;
-	
-	mInstances.PushBack( pInstance );
 
-	Unity::Debug( BufferString<100>() << "Allocated instance: " << pInstance->GetRef() );
+	auto Handle = mInstances.Alloc( pInstance );
+	if ( !Handle )
+	{
+		Unity::DebugError( BufferString<100>() << "Failed to allocate instance " << InstanceRef << ", " << INSTANCE_TABLE_SLOTS << " instances already" );
+		delete pInstance;
+		return 0;
+	}
+	pInstance->SetHandle( Handle );
+
+	Unity::Debug( BufferString<100>() << "Allocated instance: " << InstanceRef );
 
-	return pInstance->GetRef();
+	return Handle;
 }
 
-bool TFastVideo::FreeInstance(SoyRef InstanceRef)
+bool TFastVideo::FreeInstance(Unity::ulong Instance)
 {
-	ofMutex::ScopedLock Lock( mInstancesLock );
-	int Index = FindInstanceIndex( InstanceRef );
-	if ( Index < 0 )
+	//	no new lookups from here on. The render pass may still be using it, and unlinking it from shared
+	//	decoders and atlases changes what the pass walks, so the render thread deletes it
+	if ( !mInstances.Retire( Instance ) )
 	{
-		Unity::DebugError( BufferString<100>() << "Failed to find instance: " << InstanceRef );
+		Unity::DebugError( BufferString<100>() << "Failed to find instance: " << Instance );
 		return false;
 	}
 
-	auto* pInstance = mInstances[Index];
-	mInstances.RemoveBlock( Index, 1 );
-	delete pInstance;
-	Unity::Debug( BufferString<100>() << "Free'd instance: " << InstanceRef );
+	TInstanceChange Change;
+	Change.mOp = TInstanceChangeOp::Free;
+	Change.mInstance = Instance;
+	QueueChange( Change );
+	return true;
+}
+
+TFastTexture* TFastVideo::FindInstance(Unity::ulong Instance)
+{
+	TInstanceRef pInstance( mInstances, Instance );
+	return pInstance.Get();
+}
+
+bool TFastVideo::ShareDecoder(Unity::ulong Instance,Unity::ulong Source)
+{
+	TInstanceRef pInstance( mInstances, Instance );
+	if ( !pInstance )
+		return false;
 
-	//	if we have no more instances, the frame pool should be empty
-	if ( mInstances.IsEmpty() )
+	TInstanceRef pSource( mInstances, Source );
+	if ( Source && !pSource )
 	{
-		mFramePool.DebugUsedFrames();
-		assert( mFramePool.IsEmpty() );
+		Unity::DebugError( BufferString<100>() << "Failed to find instance to share decoder: " << Source );
+		return false;
 	}
 
+	TInstanceChange Change;
+	Change.mOp = TInstanceChangeOp::ShareDecoder;
+	Change.mInstance = Instance;
+	Change.mSource = Source;
+	QueueChange( Change );
 	return true;
 }
 
-TFastTexture* TFastVideo::FindInstance(SoyRef Ref)
+bool TFastVideo::SetInstanceAtlas(Unity::ulong Instance,Unity::TTexture AtlasTexture,const TFrameRect& Rect)
 {
-	ofMutex::ScopedLock Lock( mInstancesLock );
-	int Index = FindInstanceIndex( Ref );
-	if ( Index < 0 )
-		return NULL;
-	return mInstances[Index];
+	TInstanceRef pInstance( mInstances, Instance );
+	if ( !pInstance )
+		return false;
+
+	TInstanceChange Change;
+	Change.mOp = TInstanceChangeOp::SetAtlas;
+	Change.mInstance = Instance;
+	Change.mTexture = AtlasTexture;
+	Change.mRect = Rect;
+	QueueChange( Change );
+	return true;
 }
 
-int TFastVideo::FindInstanceIndex(SoyRef Ref)
+bool TFastVideo::SetInstanceTexture(Unity::ulong Instance,Unity::TTexture Texture)
 {
-	ofMutex::ScopedLock Lock( mInstancesLock );
-	for ( int i=0;	i<mInstances.GetSize();	i++ )
+	TInstanceRef pInstance( mInstances, Instance );
+	if ( !pInstance )
+		return false;
+
+	TInstanceChange Change;
+	Change.mOp = TInstanceChangeOp::SetTexture;
+	Change.mInstance = Instance;
+	Change.mTexture = Texture;
+	QueueChange( Change );
+	return true;
+}
+
+void TFastVideo::QueueChange(const TInstanceChange& Change)
+{
+	ofMutex::ScopedLock Lock( mPendingChanges );
+	mPendingChanges.Get().PushBack( Change );
+}
+
+void TFastVideo::ApplyChanges()
+{
+	//	take them all out first, so callers aren't blocked while we apply them
+	mApplyingChanges.Clear();
 	{
-		auto& Instance = *mInstances[i];
-		if ( Instance.GetRef() != Ref )
+		ofMutex::ScopedLock Lock( mPendingChanges );
+		auto& Pending = mPendingChanges.Get();
+		for ( int i=0;	i<Pending.GetSize();	i++ )
+			mApplyingChanges.PushBack( Pending[i] );
+		Pending.Clear();
+	}
+
+	for ( int i=0;	i<mApplyingChanges.GetSize();	i++ )
+		ApplyChange( mApplyingChanges[i] );
+
+	//	instances may have left their atlases
+	if ( !mApplyingChanges.IsEmpty() )
+		FreeUnusedAtlases();
+}
+
+void TFastVideo::ApplyChange(const TInstanceChange& Change)
+{
+	if ( Change.mOp == TInstanceChangeOp::Free )
+	{
+		//	waits for anyone else still holding it (api calls that looked it up before it was retired)
+		auto* pInstance = mInstances.Reclaim( Change.mInstance );
+		if ( !pInstance )
+			return;
+
+		SoyRef InstanceRef = pInstance->GetRef();
+		delete pInstance;
+		Unity::Debug( BufferString<100>() << "Free'd instance: " << InstanceRef );
+
+		//	if we have no more instances, the frame pool should be empty
+		if ( mInstances.GetLiveCount() == 0 )
+		{
+			mFramePool.DebugUsedFrames();
+			assert( mFramePool.IsEmpty() );
+		}
+		return;
+	}
+
+	//	instance may have been freed since the change was queued
+	TInstanceRef pInstance( mInstances, Change.mInstance );
+	if ( !pInstance )
+		return;
+
+	switch ( Change.mOp )
+	{
+	case TInstanceChangeOp::SetTexture:
+		pInstance->SetTexture( Change.mTexture );
+		return;
+
+	case TInstanceChangeOp::ShareDecoder:
+	{
+		TInstanceRef pSource( mInstances, Change.mSource );
+		if ( Change.mSource && !pSource )
+		{
+			Unity::DebugError( BufferString<100>() << "Instance to share decoder was freed: " << Change.mSource );
+			return;
+		}
+		pInstance->SetSharedSource( pSource.Get() );
+		return;
+	}
+
+	case TInstanceChangeOp::SetAtlas:
+	{
+		//	instances using the same texture share an atlas
+		TFastTextureAtlas* pAtlas = nullptr;
+		if ( Change.mTexture.IsValid() )
+		{
+			pAtlas = FindAtlas( Change.mTexture );
+			if ( !pAtlas )
+			{
+				if ( !mDevice )
+				{
+					Unity::DebugError( BufferString<100>() << pInstance->GetRef() << " cannot join an atlas without a device" );
+					return;
+				}
+
+				pAtlas = new TFastTextureAtlas( Change.mTexture, mDevice );
+				if ( !pAtlas->IsValid() )
+				{
+					delete pAtlas;
+					return;
+				}
+				mAtlases.PushBack( pAtlas );
+			}
+		}
+		pInstance->SetAtlas( pAtlas, Change.mRect );
+		return;
+	}
+
+	default:
+		return;
+	}
+}
+
+TFastTextureAtlas* TFastVideo::FindAtlas(Unity::TTexture AtlasTexture)
+{
+	for ( int i=0;	i<mAtlases.GetSize();	i++ )
+	{
+		if ( mAtlases[i]->GetTargetTexture().GetPointer() == AtlasTexture.GetPointer() )
+			return mAtlases[i];
+	}
+	return nullptr;
+}
+
+void TFastVideo::FreeUnusedAtlases()
+{
+	for ( int i=mAtlases.GetSize()-1;	i>=0;	i-- )
+	{
+		auto* pAtlas = mAtlases[i];
+		if ( !pAtlas->IsEmpty() )
 			continue;
-		return i;
+		mAtlases.RemoveBlock( i, 1 );
+		delete pAtlas;
 	}
-	return -1;
 }
 
 void TFastVideo::OnPostRender()
@@ -130,6 +381,12 @@ void TFastVideo::OnPostRender()
 
 	ofMutex::ScopedLock Lock( mInstancesLock );
 
+	//	frees, targets, atlases and shared decoders change what the pass walks, so they're only made here
+	ApplyChanges();
+
+	//	script's batched changes land together, before this frame's uploads
+	ApplyCommands();
+
 	if ( !mDevice )
 		return;
 
@@ -137,22 +394,177 @@ void TFastVideo::OnPostRender()
 	mDevice->SetRenderThread();
 	mDevice->OnRenderThreadUpdate();
 	
-	for ( int i=0;	i<mInstances.GetSize();	i++ )
+	//	most urgent instances first; by priority, and how long they've been waiting
+	SoyTime FrameStart(true);
+	//	hold every instance for the pass so they can't be freed under us
+	mUploadOrder.Clear();
+	mRenderHandles.Clear();
+	auto SortedInstances = GetSortArray( mUploadOrder, TSortPolicy_TFastTextureByUploadScore() );
+	for ( int s=0;	s<mInstances.GetSlotCount();	s++ )
+	{
+		Unity::ulong Handle = 0;
+		auto* pInstance = mInstances.AcquireSlot( s, Handle );
+		if ( !pInstance )
+			continue;
+		mRenderHandles.PushBack( Handle );
+		pInstance->UpdateUploadScore( FrameStart );
+		SortedInstances.Push( pInstance );
+	}
+
+	//	once we're over budget, the rest wait for the next frame. Always do the most urgent one so nothing waits forever
+	int Uploads = 0;
+	int Deferred = 0;
+	int MaxWaitMs = 0;
+	int BudgetMs = mUploadStats.mBudgetMs;
+	for ( int i=0;	i<mUploadOrder.GetSize();	i++ )
 	{
-		auto& Instance = *mInstances[i];
+		auto& Instance = *mUploadOrder[i];
+		auto ElapsedMs = SoyTime(true).GetTime() - FrameStart.GetTime();
+		if ( BudgetMs > 0 && Uploads > 0 && ElapsedMs >= static_cast<uint64>( BudgetMs ) )
+		{
+			MaxWaitMs = ofMax( MaxWaitMs, Instance.GetUploadWaitMs( FrameStart ) );
+			Deferred++;
+			continue;
+		}
 		Instance.OnPostRender();
+		Uploads++;
+	}
+	for ( int i=0;	i<mRenderHandles.GetSize();	i++ )
+		mInstances.Release( mRenderHandles[i] );
+	mUploadOrder.Clear();
+
+	auto FrameMs = static_cast<int>( SoyTime(true).GetTime() - FrameStart.GetTime() );
+	mUploadStats.OnRenderFrame( BudgetMs, FrameMs, Uploads, Deferred, MaxWaitMs );
+
+	//	one upload for all the instances in each atlas
+	for ( int i=0;	i<mAtlases.GetSize();	i++ )
+	{
+		auto& Atlas = *mAtlases[i];
+		Atlas.OnPostRender();
 	}
 
 	mDevice->OnRenderThreadPostUpdate();
 
+	//	give back memory we haven't needed for a while
+	mFramePool.TrimIdleFrames();
+
 	//	flush debug log
 #if defined(BUFFER_DEBUG_LOG)
 	FlushDebugLogBuffer();
 #endif
 }
 
+void TFastVideo::SetUploadBudget(int BudgetMs)
+{
+	//	next render pass picks it up
+	mUploadStats.mBudgetMs = ofMax( 0, BudgetMs );
+}
+
+void TFastVideo::GetUploadSchedulerStats(TUploadSchedulerStats& Stats)
+{
+	mUploadStats.GetStats( Stats );
+}
+
+void TFastVideo::ResetUploadSchedulerStats()
+{
+	mUploadStats.Reset();
+}
+
+void TFastVideo::SetTestDecoderParams(const TTestDecoderParams& Params)
+{
+	ofMutex::ScopedLock Lock( mTestDecoderParams );
+	mTestDecoderParams.Get() = Params;
+}
+
+TTestDecoderParams TFastVideo::GetTestDecoderParams()
+{
+	ofMutex::ScopedLock Lock( mTestDecoderParams );
+	return mTestDecoderParams.Get();
+}
+
+void TFastVideo::ResetLatencyStats()
+{
+	for ( int s=0;	s<mInstances.GetSlotCount();	s++ )
+	{
+		Unity::ulong Handle = 0;
+		auto* pInstance = mInstances.AcquireSlot( s, Handle );
+		if ( !pInstance )
+			continue;
+		pInstance->GetCounters().ResetStages();
+		mInstances.Release( Handle );
+	}
+	TPipelineCounters::GetGlobal().ResetStages();
+}
+
+int TFastVideo::QueueCommands(const TInstanceCommand* Commands,int Count)
+{
+	//	a batch is queued under one lock, so it's never split across render passes. Part of one
+	//	would be applied without the rest, so if it doesn't all fit none of it is queued
+	ofMutex::ScopedLock Lock( mPendingCommands );
+	auto& Pending = mPendingCommands.Get();
+	if ( Count > MAX_PENDING_COMMANDS - Pending.GetSize() )
+	{
+		BufferString<100> Debug;
+		Debug << "Command queue full, refused batch of " << Count << " commands";
+		Unity::DebugError( Debug );
+		return 0;
+	}
+
+	for ( int i=0;	i<Count;	i++ )
+		Pending.PushBack( Commands[i] );
+	return Count;
+}
+
+void TFastVideo::ApplyCommands()
+{
+	//	take them all out first, so scripts aren't blocked while we apply them
+	mApplyingCommands.Clear();
+	{
+		ofMutex::ScopedLock Lock( mPendingCommands );
+		auto& Pending = mPendingCommands.Get();
+		for ( int i=0;	i<Pending.GetSize();	i++ )
+			mApplyingCommands.PushBack( Pending[i] );
+		Pending.Clear();
+	}
+
+	for ( int i=0;	i<mApplyingCommands.GetSize();	i++ )
+		ApplyCommand( mApplyingCommands[i] );
+}
+
+bool TFastVideo::ApplyCommand(const TInstanceCommand& Command)
+{
+	//	instance may have been freed since the command was queued
+	TInstanceRef pInstance( mInstances, Command.mInstance );
+	if ( !pInstance )
+		return false;
+
+	switch ( Command.mOp )
+	{
+	case TInstanceCommandOp::Pause:				pInstance->SetState( TFastVideoState::Paused );	return true;
+	case TInstanceCommandOp::Resume:			pInstance->SetState( TFastVideoState::Playing );	return true;
+	case TInstanceCommandOp::SetLooping:		pInstance->SetLooping( Command.mIntArg != 0 );	return true;
+	case TInstanceCommandOp::SetPlaybackRate:	pInstance->SetPlaybackRate( Command.mFloatArg );	return true;
+	case TInstanceCommandOp::SetTime:			pInstance->Seek( SoyTime( Command.mTimeMs ) );	return true;
+	case TInstanceCommandOp::SetScrubbing:		pInstance->SetScrubbing( Command.mIntArg != 0 );	return true;
+	case TInstanceCommandOp::StepFrame:			pInstance->StepFrame( Command.mIntArg );	return true;
+	case TInstanceCommandOp::SetUploadPriority:	pInstance->SetUploadPriority( Command.mIntArg );	return true;
+	}
+
+	BufferString<100> Debug;
+	Debug << "Unknown command " << Command.mOp << " for " << pInstance->GetRef();
+	Unity::DebugError( Debug );
+	return false;
+}
+
 bool TFastVideo::AllocDevice(Unity::TGfxDevice::Type DeviceType,void* Device)
 {
+	//	our render thread may be mid-pass on the old device. Stop it before taking the lock (it takes it
+	//	too); UseMemoryDevice restarts it afterwards, a real device is driven by unity's render thread
+	SetHeadlessRenderRate( 0.f );
+
+	//	the swap and the walk can't overlap a render pass, an atlas change or a free
+	ofMutex::ScopedLock Lock( mInstancesLock );
+
 	//	free old device
 	mDevice.reset();
 
@@ -166,14 +578,62 @@ bool TFastVideo::AllocDevice(Unity::TGfxDevice::Type DeviceType,void* Device)
 			Unity::DebugError(BufferString<1000>() <<"Failed to allocated device " << DeviceType );
 	}
 
+	OnDeviceChanged();
+	return mDevice!=nullptr;
+}
+
+bool TFastVideo::AllocMemoryDevice()
+{
+	//	same as AllocDevice, but unity never gives us this one. Batch mode's null device stays no device
+	SetHeadlessRenderRate( 0.f );
+	ofMutex::ScopedLock Lock( mInstancesLock );
+
+	mDevice.reset();
+	mDevice = ofPtr<TUnityDevice>( new TUnityDevice_Memory() );
+
+	OnDeviceChanged();
+	return true;
+}
+
+void TFastVideo::OnDeviceChanged()
+{
 	//	update device on all instances (remove, or add)
-	for ( int i=0;	i<mInstances.GetSize();	i++ )
+	for ( int s=0;	s<mInstances.GetSlotCount();	s++ )
+	{
+		Unity::ulong Handle = 0;
+		auto* pInstance = mInstances.AcquireSlot( s, Handle );
+		if ( !pInstance )
+			continue;
+		pInstance->SetDevice( mDevice );
+		mInstances.Release( Handle );
+	}
+	for ( int i=0;	i<mAtlases.GetSize();	i++ )
 	{
-		auto& Instance = *mInstances[i];
-		Instance.SetDevice( mDevice );
+		auto& Atlas = *mAtlases[i];
+		Atlas.SetDevice( mDevice );
 	}
 
-	return mDevice!=nullptr;
+	//	decode into the new device's upload buffers
+	mFramePool.SetMappedFrameDevice( mDevice );
+}
+
+void TFastVideo::SetHeadlessRenderRate(float RateHz)
+{
+	if ( mHeadlessRenderThread )
+	{
+		mHeadlessRenderThread->waitForThread();
+		mHeadlessRenderThread.reset();
+	}
+
+	if ( RateHz <= 0.f )
+		return;
+
+	mHeadlessRenderThread = ofPtr<THeadlessRenderThread>( new THeadlessRenderThread( RateHz ) );
+	mHeadlessRenderThread->startThread( true, true );
+
+	BufferString<100> Debug;
+	Debug << "Headless render thread at " << RateHz << "hz";
+	Unity::Debug( Debug );
 }
 
 bool TFastVideo::FreeDevice(Unity::TGfxDevice::Type DeviceType)
@@ -188,29 +648,23 @@ bool TFastVideo::FreeDevice(Unity::TGfxDevice::Type DeviceType)
 extern "C" EXPORT_API Unity::ulong	AllocInstance()
 {
 	//	alloc a new instance
-	SoyRef InstanceRef = Unity::GetFastVideo().AllocInstance();
-	Unity::ulong RefInt = static_cast<Unity::ulong>( InstanceRef.GetInt64() );
-	return RefInt;
+	return Unity::GetFastVideo().AllocInstance();
 }
 
 extern "C" EXPORT_API bool FreeInstance(Unity::ulong Instance)
 {
-	return Unity::GetFastVideo().FreeInstance( SoyRef(Instance) );
+	return Unity::GetFastVideo().FreeInstance( Instance );
 }
 
 extern "C" EXPORT_API bool SetTexture(Unity::ulong Instance,void* pTexture)
 {
-	auto* pInstance = Unity::GetFastVideo().FindInstance( SoyRef(Instance) );
-	if ( !pInstance )
-		return false;
-
     Unity::TTexture Texture( pTexture );
-	return pInstance->SetTexture( Texture );
+	return Unity::GetFastVideo().SetInstanceTexture( Instance, Texture );
 }
 
 extern "C" EXPORT_API bool SetVideo(Unity::ulong Instance,const wchar_t* pFilename,int Length)
 {
-	auto* pInstance = Unity::GetFastVideo().FindInstance( SoyRef(Instance) );
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
 	if ( !pInstance )
 		return false;
 
@@ -260,12 +714,8 @@ void Unity::ConsoleLog(const char* str)
 #if defined(BUFFER_DEBUG_LOG)
 void TFastVideo::BufferDebugLog(const char* String,const char* Prefix)
 {
-	ofMutex::ScopedLock lock( mDebugLogBufferLock );
-	
-	auto& str = mDebugLogBuffer.PushBack();
-	if ( Prefix )
-		str << "[" << Prefix << "] ";
-	str << String;
+	//	never blocks; if the render thread has fallen behind the message is dropped and counted
+	mDebugLogQueue.Push( String, Prefix );
 }
 #endif
 
@@ -273,14 +723,19 @@ void TFastVideo::BufferDebugLog(const char* String,const char* Prefix)
 #if defined(BUFFER_DEBUG_LOG)
 void TFastVideo::FlushDebugLogBuffer()
 {
-	ofMutex::ScopedLock lock( mDebugLogBufferLock );
-	
-	for ( int i=0;	i<mDebugLogBuffer.GetSize();	i++ )
+	//	no more than a queue's worth, so threads logging constantly can't keep us here
+	char Message[LOG_MESSAGE_LENGTH];
+	for ( int i=0;	i<LOG_QUEUE_SLOTS && mDebugLogQueue.Pop( Message );	i++ )
+		DebugLog( Message );
+
+	uint64 Dropped = mDebugLogQueue.GetDroppedCount();
+	uint64 Reported = mDebugLogDropsReported.exchange( Dropped );
+	if ( Dropped > Reported )
 	{
-		auto& Debug = mDebugLogBuffer[i];
+		BufferString<100> Debug;
+		Debug << "Log queue full, dropped " << (Dropped - Reported) << " messages";
 		DebugLog( Debug.c_str() );
 	}
-	mDebugLogBuffer.Clear();
 }
 #endif
 
@@ -317,7 +772,7 @@ void Unity::OnError(TFastTexture& Instance,FastVideoError Error)
 
 	if ( FastVideo.mOnErrorFunc )
 	{
-		ulong InstanceId = Instance.GetRef().GetInt64();
+		ulong InstanceId = Instance.GetHandle();
 		ulong ErrorId = static_cast<ulong>( Error );
 		(*FastVideo.mOnErrorFunc)( InstanceId, ErrorId );
 	}
@@ -356,6 +811,7 @@ extern "C" void EXPORT_API UnityRenderEvent(int eventID)
 	switch ( eventID )
 	{
 		case UnityEvent::OnPostRender:
+			Trace::SetThreadName("UnityRenderThread");
 			Unity::GetFastVideo().OnPostRender();
 			break;
 
@@ -367,7 +823,7 @@ extern "C" void EXPORT_API UnityRenderEvent(int eventID)
 
 extern "C" EXPORT_API bool Pause(Unity::ulong Instance)
 {
-	auto* pInstance = Unity::GetFastVideo().FindInstance( SoyRef(Instance) );
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
 	if ( !pInstance )
 		return false;
 	
@@ -377,7 +833,7 @@ extern "C" EXPORT_API bool Pause(Unity::ulong Instance)
 
 extern "C" EXPORT_API bool Resume(Unity::ulong Instance)
 {
-	auto* pInstance = Unity::GetFastVideo().FindInstance( SoyRef(Instance) );
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
 	if ( !pInstance )
 		return false;
 	
@@ -387,7 +843,7 @@ extern "C" EXPORT_API bool Resume(Unity::ulong Instance)
 
 extern "C" EXPORT_API bool SetLooping(Unity::ulong Instance, bool EnableLooping)
 {
-	auto* pInstance = Unity::GetFastVideo().FindInstance(SoyRef(Instance));
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
 	if (!pInstance)
 		return false;
 
@@ -395,11 +851,274 @@ extern "C" EXPORT_API bool SetLooping(Unity::ulong Instance, bool EnableLooping)
 	return true;
 }
 
+extern "C" EXPORT_API bool SetPlaybackRate(Unity::ulong Instance, float Rate)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->SetPlaybackRate(Rate);
+	return true;
+}
+
+extern "C" EXPORT_API bool SetTime(Unity::ulong Instance, Unity::ulong TimeMs)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->Seek( SoyTime( static_cast<uint64>(TimeMs) ) );
+	return true;
+}
+
+extern "C" EXPORT_API bool SetScrubbing(Unity::ulong Instance, bool EnableScrubbing)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->SetScrubbing(EnableScrubbing);
+	return true;
+}
+
+extern "C" EXPORT_API bool StepFrame(Unity::ulong Instance, int Steps)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->StepFrame(Steps);
+	return true;
+}
+
+extern "C" EXPORT_API bool ShareDecoder(Unity::ulong Instance, Unity::ulong SourceInstance)
+{
+	//	0 stops sharing
+	return Unity::GetFastVideo().ShareDecoder( Instance, SourceInstance );
+}
+
+extern "C" EXPORT_API bool SetUploadBufferCount(Unity::ulong Instance, int Count)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->SetUploadSlotCount( Count );
+	return true;
+}
+
+extern "C" EXPORT_API bool SetDirtyRegionUploads(Unity::ulong Instance, bool Enable)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->SetDirtyRegionUploads( Enable );
+	return true;
+}
+
+extern "C" EXPORT_API bool SetAtlasTexture(Unity::ulong Instance, void* pTexture, int x, int y, int Width, int Height)
+{
+	Unity::TTexture Texture( pTexture );
+	return Unity::GetFastVideo().SetInstanceAtlas( Instance, Texture, TFrameRect( x, y, Width, Height ) );
+}
+
+extern "C" EXPORT_API bool SetUploadPriority(Unity::ulong Instance, int Priority)
+{
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->SetUploadPriority( Priority );
+	return true;
+}
+
+extern "C" EXPORT_API void SetUploadBudget(int BudgetMs)
+{
+	Unity::GetFastVideo().SetUploadBudget( BudgetMs );
+}
+
+extern "C" EXPORT_API bool GetUploadSchedulerStats(TUploadSchedulerStats* Stats)
+{
+	if ( !Stats )
+		return false;
+
+	Unity::GetFastVideo().GetUploadSchedulerStats( *Stats );
+	return true;
+}
+
+extern "C" EXPORT_API int SubmitCommands(const TInstanceCommand* Commands, int Count)
+{
+	if ( !Commands || Count <= 0 )
+		return 0;
+
+	return Unity::GetFastVideo().QueueCommands( Commands, Count );
+}
+
+extern "C" EXPORT_API int GetInstanceStatus(const Unity::ulong* Instances, TInstanceStatus* Statuses, int Count)
+{
+	if ( !Instances || !Statuses )
+		return 0;
+
+	auto& InstanceTable = Unity::GetFastVideo().GetInstanceTable();
+	int Valid = 0;
+	for ( int i=0;	i<Count;	i++ )
+	{
+		auto& Status = Statuses[i];
+		TInstanceRef pInstance( InstanceTable, Instances[i] );
+		if ( !pInstance )
+		{
+			memset( &Status, 0, sizeof(Status) );
+			continue;
+		}
+		pInstance->GetStatus( Status );
+		Valid++;
+	}
+	return Valid;
+}
+
+extern "C" EXPORT_API bool GetInstanceStats(Unity::ulong Instance, TInstanceStats* Stats)
+{
+	if ( !Stats )
+		return false;
+
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->GetStats( *Stats );
+	return true;
+}
+
+extern "C" EXPORT_API bool GetLatencyPercentiles(Unity::ulong Instance, int Stage, TLatencyPercentiles* Percentiles)
+{
+	if ( !Percentiles || Stage < 0 || Stage >= TPipelineStage::Count )
+		return false;
+
+	TInstanceRef pInstance( Unity::GetFastVideo().GetInstanceTable(), Instance );
+	if (!pInstance)
+		return false;
+
+	pInstance->GetCounters().GetStage( static_cast<TPipelineStage::Type>(Stage) )->GetPercentiles( *Percentiles );
+	return true;
+}
+
+extern "C" EXPORT_API bool GetGlobalLatencyPercentiles(int Stage, TLatencyPercentiles* Percentiles)
+{
+	if ( !Percentiles || Stage < 0 || Stage >= TPipelineStage::Count )
+		return false;
+
+	TPipelineCounters::GetGlobal().GetStage( static_cast<TPipelineStage::Type>(Stage) )->GetPercentiles( *Percentiles );
+	return true;
+}
+
+extern "C" EXPORT_API void ResetLatencyStats()
+{
+	Unity::GetFastVideo().ResetLatencyStats();
+}
+
+extern "C" EXPORT_API bool UseMemoryDevice(float RenderRateHz)
+{
+	auto& FastVideo = Unity::GetFastVideo();
+	if ( !FastVideo.AllocMemoryDevice() )
+		return false;
+
+	FastVideo.SetHeadlessRenderRate( RenderRateHz );
+	return true;
+}
+
+extern "C" EXPORT_API void* AllocMemoryTexture(int Width, int Height, int Format)
+{
+	auto& FastVideo = Unity::GetFastVideo();
+	if ( !FastVideo.IsDeviceValid() )
+		return nullptr;
+
+	if ( Width <= 0 || Height <= 0 || Format <= TFrameFormat::Invalid || Format > TFrameFormat::YUV )
+	{
+		Unity::DebugError( BufferString<1000>() << "AllocMemoryTexture: invalid texture " << Width << "x" << Height << " format " << Format );
+		return nullptr;
+	}
+
+	//	same as a unity texture; give it to SetTexture. The instance deletes it when it's replaced or freed
+	TFrameMeta Meta( Width, Height, static_cast<TFrameFormat::Type>( Format ) );
+	auto Texture = FastVideo.GetDevice().AllocTexture( Meta );
+	return Texture.GetPointer();
+}
+
+extern "C" EXPORT_API bool FreeMemoryTexture(void* pTexture)
+{
+	auto& FastVideo = Unity::GetFastVideo();
+	if ( !FastVideo.IsDeviceValid() )
+		return false;
+
+	Unity::TTexture Texture( pTexture );
+	return FastVideo.GetDevice().DeleteTexture( Texture );
+}
+
+extern "C" EXPORT_API bool ReadMemoryTexture(void* pTexture, unsigned char* Buffer, int BufferSize)
+{
+	auto& FastVideo = Unity::GetFastVideo();
+	if ( !FastVideo.IsDeviceValid() )
+		return false;
+
+	Unity::TTexture Texture( pTexture );
+	return FastVideo.GetDevice().ReadTexture( Texture, Buffer, BufferSize );
+}
+
+extern "C" EXPORT_API void SetFramePoolBudget(Unity::ulong Bytes)
+{
+	Unity::GetFastVideo().GetFramePool().SetBudget( Bytes );
+}
+
+extern "C" EXPORT_API bool GetFramePoolStats(TFramePoolStats* Stats)
+{
+	if ( !Stats )
+		return false;
+
+	Unity::GetFastVideo().GetFramePool().GetStats( *Stats );
+	return true;
+}
+
 extern "C" EXPORT_API void EnableTestDecoder(bool Enable)
 {
 	USE_TEST_DECODER = Enable;
 }
 
+extern "C" EXPORT_API void SetTestDecoderParams(const TTestDecoderParams* Params)
+{
+	if ( !Params )
+		return;
+
+	Unity::GetFastVideo().SetTestDecoderParams( *Params );
+}
+
+extern "C" EXPORT_API bool GetTestDecoderParams(TTestDecoderParams* Params)
+{
+	if ( !Params )
+		return false;
+
+	*Params = Unity::GetFastVideo().GetTestDecoderParams();
+	return true;
+}
+
+extern "C" EXPORT_API bool EncodeTestClip(const wchar_t* pFilename, int Length)
+{
+	if ( !pFilename )
+		return false;
+
+#if defined(ENABLE_DECODER_LIBAV)
+	//	make string
+	std::wstring Filename;
+	for ( int i=0;	i<Length;	i++ )
+		Filename += pFilename[i];
+
+	return TTestFrameGenerator( Unity::GetFastVideo().GetTestDecoderParams() ).Encode( Filename );
+#else
+	Unity::DebugError("EncodeTestClip requires libav");
+	return false;
+#endif
+}
+
 extern "C" EXPORT_API void EnableDebugTimers(bool Enable)
 {
 	ENABLE_TIMER_DEBUG_LOG = Enable;
@@ -419,3 +1138,105 @@ extern "C" EXPORT_API void EnableDebugFull(bool Enable)
 {
 	ENABLE_FULL_DEBUG_LOG = true;
 }
+
+extern "C" EXPORT_API Unity::ulong GetDroppedLogCount()
+{
+#if defined(BUFFER_DEBUG_LOG)
+	return Unity::GetFastVideo().mDebugLogQueue.GetDroppedCount();
+#else
+	return 0;
+#endif
+}
+
+extern "C" EXPORT_API void EnableTrace(bool Enable)
+{
+	Trace::SetEnabled( Enable );
+}
+
+extern "C" EXPORT_API void ClearTrace()
+{
+	Trace::Clear();
+}
+
+extern "C" EXPORT_API int GetTraceJson(char* Buffer, int BufferSize)
+{
+	std::string Json;
+	Trace::GetJson( Json );
+
+	int Size = static_cast<int>( Json.length() ) + 1;
+	if ( Buffer && BufferSize >= Size )
+		memcpy( Buffer, Json.c_str(), Size );
+	return Size;
+}
+
+//	wchar_t is utf-16 on windows and utf-32 elsewhere; pairs of surrogates are joined either way
+static std::string GetUtf8(const std::wstring& String)
+{
+	std::string Utf8;
+	for ( size_t i=0;	i<String.length();	i++ )
+	{
+		uint32 c = static_cast<uint32>( String[i] );
+		if ( c >= 0xd800 && c <= 0xdbff && i+1 < String.length() )
+		{
+			uint32 Low = static_cast<uint32>( String[i+1] );
+			if ( Low >= 0xdc00 && Low <= 0xdfff )
+			{
+				c = 0x10000 + ((c - 0xd800) << 10) + (Low - 0xdc00);
+				i++;
+			}
+		}
+
+		if ( c < 0x80 )
+		{
+			Utf8 += static_cast<char>( c );
+		}
+		else if ( c < 0x800 )
+		{
+			Utf8 += static_cast<char>( 0xc0 | (c >> 6) );
+			Utf8 += static_cast<char>( 0x80 | (c & 0x3f) );
+		}
+		else if ( c < 0x10000 )
+		{
+			Utf8 += static_cast<char>( 0xe0 | (c >> 12) );
+			Utf8 += static_cast<char>( 0x80 | ((c >> 6) & 0x3f) );
+			Utf8 += static_cast<char>( 0x80 | (c & 0x3f) );
+		}
+		else
+		{
+			Utf8 += static_cast<char>( 0xf0 | ((c >> 18) & 0x07) );
+			Utf8 += static_cast<char>( 0x80 | ((c >> 12) & 0x3f) );
+			Utf8 += static_cast<char>( 0x80 | ((c >> 6) & 0x3f) );
+			Utf8 += static_cast<char>( 0x80 | (c & 0x3f) );
+		}
+	}
+	return Utf8;
+}
+
+extern "C" EXPORT_API bool WriteTraceFile(const wchar_t* pFilename, int Length)
+{
+	if ( !pFilename )
+		return false;
+
+	//	make string
+	std::wstring Filename;
+	for ( int i=0;	i<Length;	i++ )
+		Filename += pFilename[i];
+
+	std::string Json;
+	Trace::GetJson( Json );
+
+	//	windows' narrow paths are in the ansi codepage, so open with the wide name there
+#if defined(TARGET_WINDOWS)
+	FILE* File = _wfopen( Filename.c_str(), L"wb" );
+#else
+	FILE* File = fopen( GetUtf8( Filename ).c_str(), "wb" );
+#endif
+	if ( !File )
+	{
+		Unity::DebugError( BufferString<1000>() << "Failed to open trace file " << GetUtf8( Filename ).c_str() );
+		return false;
+	}
+	bool Success = fwrite( Json.c_str(), 1, Json.length(), File ) == Json.length();
+	Success = ( fclose( File ) == 0 ) && Success;
+	return Success;
+}
@@ -4,11 +4,26 @@
 #include <SoyThread.h>
 #include "UnityDevice.h"
 #include "TFrame.h"
+#include "TTrace.h"
+#include "TLogQueue.h"
+#include "TInstanceTable.h"
 
 #define USE_REAL_TIMESTAMP				0
 
 #define DEFAULT_MAX_POOL_SIZE		30
 #define DEFAULT_MAX_FRAME_BUFFERS	(DEFAULT_MAX_POOL_SIZE-1)
+#define DEFAULT_SIZE_CLASS_PREALLOC	(DEFAULT_MAX_POOL_SIZE/3)	//	frames allocated up front the first time a frame size is used
+#define DEFAULT_MAX_FRAME_CACHE		(DEFAULT_MAX_POOL_SIZE/2)	//	frames kept around the playhead when scrubbing (frame buffer is emptied)
+#define DEFAULT_FRAME_POOL_BUDGET	( (sizeof(void*) < 8 ? 256ull : 1024ull) * 1024ull * 1024ull )	//	bytes; 32 bit editor runs out of address space
+#define DEFAULT_FRAME_POOL_TRIM_MS	5000	//	free frames unused for this long are given back to the OS
+#define DEFAULT_UPLOAD_SLOTS		3		//	staging buffers per instance, so the upload thread always has one to write to
+#define MAX_UPLOAD_SLOTS			4
+#define DEFAULT_MAX_MAPPED_FRAMES	(DEFAULT_MAX_POOL_SIZE/2)	//	device upload buffers per frame size decoded into directly. Any more come from the heap
+#define DEFAULT_FRAME_INTERVAL_MS	33		//	used to estimate frame steps when we don't know the frame rate
+#define DEFAULT_UPLOAD_BUDGET_MS	4		//	render thread time per frame for instance uploads, the rest wait for the next frame. 0 is unlimited
+#define UPLOAD_STALENESS_PRIORITY_MS	100	//	waiting this long for an upload counts as one priority level, so low priorities aren't starved
+#define DEFAULT_HEADLESS_RENDER_HZ	60		//	headless render thread rate when it's enabled without one
+#define MAX_PENDING_COMMANDS		4096	//	SubmitCommands waiting for the render thread; a batch that would go over this is refused
 
 #if USE_REAL_TIMESTAMP==1
 	#define FORCE_BUFFER_FRAME_COUNT	20	//	hold X frames before popping (must be less than DEFAULT_MAX_FRAME_BUFFERS)
@@ -30,11 +45,17 @@ static bool SHOW_POOL_FULL_MESSAGE	=	true;
 #define DYNAMIC_SKIP_OOO_FRAMES			true
 #define DECODER_SKIP_OOO_FRAMES			false
 
-#define REAL_TIME_MODIFIER				1.0f	//	speed up/slow down real life time
+#define REAL_TIME_MODIFIER				1.0f	//	default playback rate; speed up/slow down real life time (per-instance with SetPlaybackRate)
+#define DECODE_SKIP_NONREF_RATE			1.5f	//	faster than this, decoder drops non-reference frames
+#define DECODE_KEYFRAMES_ONLY_RATE		3.0f	//	faster than this, decoder only decodes keyframes
+#define DECODE_CATCHUP_SEEK_MS			1000	//	when skipping frames and the decoder is this far behind the playhead, seek ahead
+#define DECODE_LOOKAHEAD_MS				500		//	real-time ms buffered ahead of the playhead. Slower rates need less media time buffered
 
 //#define FORCE_SINGLE_THREAD_UPLOAD
 static bool	OPENGL_REREADY_MAP			=true;	//	after we copy the dynamic texture, immediately re-open the map
 static bool	OPENGL_USE_STREAM_TEXTURE	=true;	//	GL_STREAM_DRAW else GL_DYNAMIC_DRAW
+static bool	OPENGL_PERSISTENT_MAP		=true;	//	map dynamic textures once, coherently, with glBufferStorage (GL4.4) and fence copies instead of unmapping
+static bool	ENABLE_MAPPED_FRAMES		=true;	//	decode straight into the device's mapped upload buffers (if it has them) rather than copying each frame in
 
 #if defined(TARGET_OSX)// && defined(ENABLE_OPENGL)
 static bool USE_APPLE_CLIENT_STORAGE	= true;
@@ -43,7 +64,7 @@ static bool USE_APPLE_CLIENT_STORAGE	= true;
 #define ENABLE_DEBUG_LOG
 
 //	buffer output log messages. OSX crashes randomly when we use the debug-console output on other threads (not sure if its just cos the c# funcs aren't thread safe?)
-//	other platforms PROBABLY need it if OSX does.
+//	other platforms PROBABLY need it if OSX does. Messages go through a lock-free queue (TLogQueue) drained by the render thread
 #define BUFFER_DEBUG_LOG
 
 //#define DEBUG_LOG_THREADSAFE
@@ -58,6 +79,162 @@ extern bool ENABLE_LAG_DEBUG_LOG;
 extern bool ENABLE_DECODER_DEBUG_LOG;
 
 class TFastTexture;
+class TFastTextureAtlas;
+class TFastVideo;
+
+
+//	which ENABLE_..._DEBUG_LOG flag a message is under
+namespace TLogLevel
+{
+	enum Type
+	{
+		Error,
+		Timer,
+		Lag,
+		Decoder,
+		Full,
+	};
+};
+
+
+//	render thread upload scheduling, see TFastVideo::OnPostRender
+struct TUploadSchedulerStats
+{
+	uint64		mRenderFrames;
+	uint64		mUploads;				//	instances given their turn
+	uint64		mDeferredUploads;		//	instances pushed to the next frame
+	uint64		mOverBudgetFrames;		//	frames that still went over (the most urgent instance always gets a turn)
+	int			mBudgetMs;
+	int			mLastFrameMs;
+	int			mLastFrameUploads;
+	int			mLastFrameDeferred;
+	int			mMaxWaitMs;				//	longest an instance has waited for its turn
+};
+
+
+//	GetInstanceStats. Counts are since the instance was allocated; instances following
+//	another's decoder (ShareDecoder) count decoding on the source
+struct TInstanceStats
+{
+	uint64		mFramesDecoded;		//	including dropped
+	uint64		mFramesConverted;
+	uint64		mFramesUploaded;
+	uint64		mFramesSkipped;		//	buffered but never shown, the playhead passed them
+	uint64		mFramesDropped;		//	thrown away by the decoder (behind the playhead, out of order)
+	uint64		mBytesRead;
+	int			mBufferedFrames;	//	decoded and waiting to be shown
+	int			mPoolFramesHeld;	//	pool frames counted against this instance
+	int			mLagMs;				//	frame in the texture is this far behind the playhead
+	float		mDecodeAvgMs;
+	float		mDecodeMaxMs;
+	float		mConvertAvgMs;
+	float		mConvertMaxMs;
+	float		mUploadAvgMs;
+	float		mUploadMaxMs;
+};
+
+
+//	stages with latency histograms, for GetLatencyPercentiles. Matches the c# enum
+namespace TPipelineStage
+{
+	enum Type
+	{
+		PacketRead	= 0,	//	av_read_frame
+		Decode		= 1,	//	avcodec_decode_video2 (or the test decoder's cost)
+		Convert		= 2,	//	sws_scale into the output format
+		PoolWait	= 3,	//	decode thread waiting for the pool to give it a frame
+		Residency	= 4,	//	decoded frame waiting in the frame buffer until it's popped
+		StagingCopy	= 5,	//	frame copied into the upload thread's dynamic texture
+		Upload		= 6,	//	render thread copies that changed the texture
+		EndToEnd	= 7,	//	decoded to shown in the target texture
+
+		Count
+	};
+
+	const char*	ToString(Type Stage);
+};
+
+//	GetLatencyPercentiles. Percentiles are bucket upper bounds, within ~3%
+struct TLatencyPercentiles
+{
+	uint64		mCount;
+	float		mMeanMs;
+	float		mP50Ms;
+	float		mP90Ms;
+	float		mP99Ms;
+	float		mP999Ms;
+	float		mMaxMs;
+};
+
+
+//	SubmitCommands ops. Matches the c# enum
+namespace TInstanceCommandOp
+{
+	enum Type
+	{
+		Pause				= 0,
+		Resume				= 1,
+		SetLooping			= 2,	//	mIntArg 0 or 1
+		SetPlaybackRate		= 3,	//	mFloatArg
+		SetTime				= 4,	//	mTimeMs
+		SetScrubbing		= 5,	//	mIntArg 0 or 1
+		StepFrame			= 6,	//	mIntArg steps
+		SetUploadPriority	= 7,	//	mIntArg
+	};
+};
+
+//	a per-instance call for SubmitCommands. Unused args are ignored
+struct TInstanceCommand
+{
+	uint64		mInstance;
+	uint64		mTimeMs;
+	int			mOp;		//	TInstanceCommandOp
+	int			mIntArg;
+	float		mFloatArg;
+};
+
+//	GetInstanceStatus
+struct TInstanceStatus
+{
+	uint64		mTimeMs;		//	playhead
+	uint64		mFrameMs;		//	frame in the texture
+	int			mValid;			//	0 if the instance has been freed, and the rest is zero
+	int			mState;			//	TFastVideoState
+	int			mLooping;
+	int			mScrubbing;
+	float		mPlaybackRate;
+	int			mUploadPriority;
+};
+
+
+namespace TTestDecoderCost
+{
+	enum Type
+	{
+		None		= 0,	//	frames are free; measures the pool, buffers and uploads on their own
+		Fixed		= 1,	//	spin for mCostUs per frame
+		Workload	= 2,	//	draw every pixel mCostPasses times, so the cost scales with resolution like a real decode
+	};
+};
+
+//	synthetic video for the test decoder (EnableTestDecoder) and EncodeTestClip. Same settings, same frames
+struct TTestDecoderParams
+{
+	int			mWidth;
+	int			mHeight;
+	int			mFormat;			//	TFrameFormat
+	float		mFramesPerSecond;
+	int			mFrameCount;		//	then the video ends. 0 never ends (can't be encoded)
+	int			mCostModel;			//	TTestDecoderCost
+	int			mCostUs;
+	int			mCostPasses;
+	int			mKeyframeInterval;	//	gop length. 1 is all keyframes
+	int			mBFrames;			//	non-reference frames between reference frames. They're decoded after the reference frame that follows them
+	int			mOutOfOrder;		//	output in decode order (no reorder delay) so timestamps go backwards after each reference frame
+	int			mInitDelayMs;		//	emulate a slow open
+	int			mInitFail;			//	fail to open, after the delay
+	uint32		mSeed;				//	changes the frame colours
+};
 
 
 
@@ -84,11 +261,26 @@ namespace Unity
 	typedef void (*TDebugLogFunc)(const char*);
 	typedef void (*TOnErrorFunc)(ulong,ulong);
 
+	TFastVideo&	GetFastVideo();			//	allocate singleton if it hasn't been constructed. This avoids us competeting for crt construction order
 	void		OnError(TFastTexture& Instance,FastVideoError Error);
 
 	void		ConsoleLog(const char* str);
 	inline void	ConsoleLog(const std::string& String)		{ ConsoleLog(String.c_str()); }
 
+	//	check before formatting a message that's logged often (per frame, on decode threads)
+	inline bool	IsLogEnabled(TLogLevel::Type Level)
+	{
+		switch ( Level )
+		{
+		case TLogLevel::Error:		return ENABLE_ERROR_LOG;
+		case TLogLevel::Timer:		return ENABLE_TIMER_DEBUG_LOG;
+		case TLogLevel::Lag:		return ENABLE_LAG_DEBUG_LOG;
+		case TLogLevel::Decoder:	return ENABLE_DECODER_DEBUG_LOG;
+		case TLogLevel::Full:		return ENABLE_FULL_DEBUG_LOG;
+		default:					return false;
+		}
+	}
+
 
 	inline void	DebugError(const std::string& String)		{ ENABLE_ERROR_LOG ? ConsoleLog(String) : ofLogNoticeWrapper(String); }
 	inline void	DebugError(const char* String)				{ ENABLE_ERROR_LOG ? ConsoleLog(String) : ofLogNoticeWrapper(String); }
@@ -102,30 +294,106 @@ namespace Unity
 	inline void	Debug(const char* String)					{ ENABLE_FULL_DEBUG_LOG ? ConsoleLog(String) : ofLogNoticeWrapper(String); }
 
 
+	//	also a trace event, when tracing is enabled
 	class TScopeTimerWarning : public ofScopeTimerWarning
 	{
 	public:
 		TScopeTimerWarning(const char* Name,uint64 WarningTimeMs,bool AutoStart=true) :
-			ofScopeTimerWarning(Name, WarningTimeMs, AutoStart, DebugTimer )
+			ofScopeTimerWarning(Name, WarningTimeMs, AutoStart, DebugTimer ),
+			mTraceStartUs	( 0 ),
+			mTracing		( false )
 		{
+			//	copy the name now, it's often a temporary
+			mTraceName[0] = '\0';
+			if ( Trace::IsEnabled() )
+				Trace::CopyName( mTraceName, Name );
+			if ( AutoStart )
+				TraceStart();
 		};
+		~TScopeTimerWarning()
+		{
+			TraceStop();
+		}
+
+		void		Start()
+		{
+			TraceStart();
+			ofScopeTimerWarning::Start();
+		}
+		void		Stop()
+		{
+			ofScopeTimerWarning::Stop();
+			TraceStop();
+		}
+
+	private:
+		void		TraceStart()
+		{
+			if ( !mTraceName[0] )
+				return;
+			mTraceStartUs = Trace::GetTimeUs();
+			mTracing = true;
+		}
+		void		TraceStop()
+		{
+			if ( !mTracing )
+				return;
+			Trace::AddEvent( mTraceName, mTraceStartUs, Trace::GetTimeUs() );
+			mTracing = false;
+		}
+
+	private:
+		char		mTraceName[TRACE_NAME_LENGTH];
+		uint64		mTraceStartUs;
+		bool		mTracing;
 	};
 	
 	
 };
 
 extern "C" EXPORT_API Unity::ulong	AllocInstance();
-extern "C" EXPORT_API bool			FreeInstance(Unity::ulong Instance);
-extern "C" EXPORT_API bool			SetTexture(Unity::ulong Instance,void* Texture);
+extern "C" EXPORT_API bool			FreeInstance(Unity::ulong Instance);	//	handle is invalid on return; the instance is deleted at the start of the next render pass
+extern "C" EXPORT_API bool			SetTexture(Unity::ulong Instance,void* Texture);	//	applied at the start of the next render pass
 extern "C" EXPORT_API bool			SetVideo(Unity::ulong Instance,const wchar_t* Filename,int Length);
 extern "C" EXPORT_API bool			Pause(Unity::ulong Instance);
 extern "C" EXPORT_API bool			Resume(Unity::ulong Instance);
 extern "C" EXPORT_API bool			SetLooping(Unity::ulong Instance, bool EnableLooping);
+extern "C" EXPORT_API bool			SetPlaybackRate(Unity::ulong Instance, float Rate);
+extern "C" EXPORT_API bool			SetTime(Unity::ulong Instance, Unity::ulong TimeMs);
+extern "C" EXPORT_API bool			SetScrubbing(Unity::ulong Instance, bool EnableScrubbing);
+extern "C" EXPORT_API bool			StepFrame(Unity::ulong Instance, int Steps);
+extern "C" EXPORT_API bool			ShareDecoder(Unity::ulong Instance, Unity::ulong SourceInstance);	//	applied at the start of the next render pass
+extern "C" EXPORT_API bool			SetUploadBufferCount(Unity::ulong Instance, int Count);
+extern "C" EXPORT_API bool			SetDirtyRegionUploads(Unity::ulong Instance, bool Enable);
+extern "C" EXPORT_API bool			SetAtlasTexture(Unity::ulong Instance, void* Texture, int x, int y, int Width, int Height);	//	applied at the start of the next render pass
+extern "C" EXPORT_API bool			SetUploadPriority(Unity::ulong Instance, int Priority);
+extern "C" EXPORT_API int			SubmitCommands(const TInstanceCommand* Commands, int Count);	//	applied together at the start of the next render pass. returns Count, or 0 if the queue can't take the whole batch (none of it is queued)
+extern "C" EXPORT_API int			GetInstanceStatus(const Unity::ulong* Instances, TInstanceStatus* Statuses, int Count);	//	returns how many instances are still valid
+extern "C" EXPORT_API void			SetUploadBudget(int BudgetMs);
+extern "C" EXPORT_API bool			GetUploadSchedulerStats(TUploadSchedulerStats* Stats);
+extern "C" EXPORT_API bool			GetInstanceStats(Unity::ulong Instance, TInstanceStats* Stats);
+extern "C" EXPORT_API bool			GetLatencyPercentiles(Unity::ulong Instance, int Stage, TLatencyPercentiles* Percentiles);
+extern "C" EXPORT_API bool			GetGlobalLatencyPercentiles(int Stage, TLatencyPercentiles* Percentiles);	//	every instance, including freed ones
+extern "C" EXPORT_API void			ResetLatencyStats();	//	stage timings of every instance and the global histograms
+extern "C" EXPORT_API bool			UseMemoryDevice(float RenderRateHz);	//	headless; textures in system memory. >0 runs our own render thread
+extern "C" EXPORT_API void*			AllocMemoryTexture(int Width, int Height, int Format);
+extern "C" EXPORT_API bool			FreeMemoryTexture(void* Texture);
+extern "C" EXPORT_API bool			ReadMemoryTexture(void* Texture, unsigned char* Buffer, int BufferSize);
+extern "C" EXPORT_API void			SetFramePoolBudget(Unity::ulong Bytes);
+extern "C" EXPORT_API bool			GetFramePoolStats(TFramePoolStats* Stats);
 extern "C" EXPORT_API void			EnableTestDecoder(bool Enable);
+extern "C" EXPORT_API void			SetTestDecoderParams(const TTestDecoderParams* Params);	//	used by decoders created after this
+extern "C" EXPORT_API bool			GetTestDecoderParams(TTestDecoderParams* Params);
+extern "C" EXPORT_API bool			EncodeTestClip(const wchar_t* Filename, int Length);	//	write the test decoder's video to a file for the real decoder
 extern "C" EXPORT_API void			EnableDebugTimers(bool Enable);
 extern "C" EXPORT_API void			EnableDebugLag(bool Enable);
 extern "C" EXPORT_API void			EnableDebugError(bool Enable);
 extern "C" EXPORT_API void			EnableDebugFull(bool Enable);
+extern "C" EXPORT_API Unity::ulong	GetDroppedLogCount();	//	messages lost because the log queue was full
+extern "C" EXPORT_API void			EnableTrace(bool Enable);	//	record timer scopes for chrome://tracing
+extern "C" EXPORT_API void			ClearTrace();
+extern "C" EXPORT_API int			GetTraceJson(char* Buffer, int BufferSize);	//	returns the size needed (including the terminator); call again if it's bigger than BufferSize
+extern "C" EXPORT_API bool			WriteTraceFile(const wchar_t* Filename, int Length);
 
 //	http://www.gamedev.net/page/resources/_/technical/game-programming/c-plugin-debug-log-with-unity-r3349
 //	gr: call this in unity to tell us where to DebugLog() to
@@ -151,22 +419,105 @@ extern "C" void EXPORT_API UnitySetGraphicsDevice(void* device, int deviceType,
 
 
 
+//	TUploadSchedulerStats as atomics, so the render pass updates them and anyone can read them without waiting for it
+class TUploadSchedulerCounters
+{
+public:
+	TUploadSchedulerCounters();
+
+	void				OnRenderFrame(int BudgetMs,int FrameMs,int Uploads,int Deferred,int MaxWaitMs);
+	void				GetStats(TUploadSchedulerStats& Stats) const;
+	void				Reset();		//	counts; keeps the budget
+
+public:
+	std::atomic<int>	mBudgetMs;
+	std::atomic<uint64>	mRenderFrames;
+	std::atomic<uint64>	mUploads;
+	std::atomic<uint64>	mDeferredUploads;
+	std::atomic<uint64>	mOverBudgetFrames;
+	std::atomic<int>	mLastFrameMs;
+	std::atomic<int>	mLastFrameUploads;
+	std::atomic<int>	mLastFrameDeferred;
+	std::atomic<int>	mMaxWaitMs;
+};
+
+
+//	changes to what the render pass walks (instances, shared decoders, atlases, targets). Queued by the
+//	api and applied at the start of the next render pass, so callers never wait for one to finish
+namespace TInstanceChangeOp
+{
+	enum Type
+	{
+		Free,
+		SetTexture,
+		SetAtlas,
+		ShareDecoder,
+	};
+};
+
+class TInstanceChange
+{
+public:
+	TInstanceChange() :
+		mOp			( TInstanceChangeOp::Free ),
+		mInstance	( 0 ),
+		mSource		( 0 )
+	{
+	}
+
+public:
+	TInstanceChangeOp::Type	mOp;
+	Unity::ulong		mInstance;
+	Unity::ulong		mSource;	//	ShareDecoder
+	Unity::TTexture		mTexture;	//	SetTexture, SetAtlas
+	TFrameRect			mRect;		//	SetAtlas
+};
+
+
+//	calls OnPostRender like unity's render thread would, for headless devices with no unity to drive them
+class THeadlessRenderThread : public SoyThread
+{
+public:
+	THeadlessRenderThread(float RateHz);
+
+	virtual void		threadedFunction();
+
+public:
+	int					mIntervalMs;
+};
+
+
 class TFastVideo
 {
 public:
 	TFastVideo();
 	~TFastVideo();
 	
-	SoyRef				AllocInstance();
-	bool				FreeInstance(SoyRef InstanceRef);
-	TFastTexture*		FindInstance(SoyRef InstanceRef);
+	Unity::ulong		AllocInstance();	//	0 if we're out of instance slots
+	bool				FreeInstance(Unity::ulong Instance);	//	handle is invalid straight away, it's deleted at the start of the next render pass
+	TFastTexture*		FindInstance(Unity::ulong Instance);	//	not kept alive; only for callers who know nothing else frees it. Use TInstanceRef
+	TInstanceTable&		GetInstanceTable()		{	return mInstances;	}
+	//	these are applied at the start of the next render pass; false if the instance isn't valid now
+	bool				ShareDecoder(Unity::ulong Instance,Unity::ulong Source);	//	0 source stops sharing
+	bool				SetInstanceAtlas(Unity::ulong Instance,Unity::TTexture AtlasTexture,const TFrameRect& Rect);	//	invalid texture takes the instance out of its atlas
+	bool				SetInstanceTexture(Unity::ulong Instance,Unity::TTexture Texture);	//	also takes it out of its atlas
 	
 	void				OnPostRender();
 	
 	bool				AllocDevice(Unity::TGfxDevice::Type DeviceType,void* Device);
 	bool				FreeDevice(Unity::TGfxDevice::Type DeviceType);
+	bool				AllocMemoryDevice();	//	headless, for UseMemoryDevice
+	void				SetHeadlessRenderRate(float RateHz);	//	0 stops our render thread
 	bool				IsDeviceValid()			{	return mDevice!=nullptr;	}
 	TUnityDevice&       GetDevice()				{	return *mDevice;	}
+	TFramePool&			GetFramePool()			{	return mFramePool;	}
+	void				SetUploadBudget(int BudgetMs);
+	void				GetUploadSchedulerStats(TUploadSchedulerStats& Stats);
+	void				ResetUploadSchedulerStats();
+	void				SetTestDecoderParams(const TTestDecoderParams& Params);
+	TTestDecoderParams	GetTestDecoderParams();
+	void				ResetLatencyStats();
+	int					QueueCommands(const TInstanceCommand* Commands,int Count);	//	all or nothing; returns Count, or 0 if they don't all fit
 	
 #if defined(BUFFER_DEBUG_LOG)
 	void				FlushDebugLogBuffer();
@@ -175,14 +526,31 @@ public:
 	void				DebugLog(const char* String);
 	
 private:
-	int					FindInstanceIndex(SoyRef InstanceRef);
+	TFastTextureAtlas*	FindAtlas(Unity::TTexture AtlasTexture);
+	void				FreeUnusedAtlases();
+	void				OnDeviceChanged();	//	caller holds mInstancesLock
+	void				QueueChange(const TInstanceChange& Change);
+	void				ApplyChanges();
+	void				ApplyChange(const TInstanceChange& Change);
+	void				ApplyCommands();
+	bool				ApplyCommand(const TInstanceCommand& Command);
 	
 private:
-	ofMutex						mInstancesLock;
-	SoyRef						mNextInstanceRef;
-	Array<TFastTexture*>		mInstances;
+	ofMutex						mInstancesLock;	//	the render pass against device changes. Instance lookups don't take it
+	ofMutexT<SoyRef>			mNextInstanceRef;
+	TInstanceTable				mInstances;
+	Array<TFastTextureAtlas*>	mAtlases;		//	render thread only, or with mInstancesLock
+	Array<TFastTexture*>		mUploadOrder;	//	render thread only
+	Array<Unity::ulong>			mRenderHandles;	//	render thread only. Instances we hold for the render pass
+	ofMutexT<Array<TInstanceCommand>>	mPendingCommands;
+	Array<TInstanceCommand>		mApplyingCommands;	//	render thread only
+	ofMutexT<Array<TInstanceChange>>	mPendingChanges;	//	never refused; a freed handle is already invalid
+	Array<TInstanceChange>		mApplyingChanges;	//	render thread only
+	TUploadSchedulerCounters	mUploadStats;
 	ofPtr<TUnityDevice>         mDevice;
 	TFramePool					mFramePool;
+	ofPtr<THeadlessRenderThread>	mHeadlessRenderThread;
+	ofMutexT<TTestDecoderParams>	mTestDecoderParams;
 	
 public:
 	Unity::TOnErrorFunc			mOnErrorFunc;
@@ -191,8 +559,8 @@ public:
 #endif
 	Unity::TDebugLogFunc		mDebugFunc;
 #if defined(BUFFER_DEBUG_LOG)
-	ofMutex						mDebugLogBufferLock;
-	Array<BufferString<200>>	mDebugLogBuffer;
+	TLogQueue					mDebugLogQueue;
+	std::atomic<uint64>			mDebugLogDropsReported;
 #endif
 };
 
@@ -37,19 +37,212 @@ FastVideoError TDecodeState::GetFastVideoError(TDecodeState::Type State)
 }
 
 
+TDecodeSkip::Type TDecodeSkip::GetSkipMode(float PlaybackRate)
+{
+	//	going backwards we need every frame to decode the chunk
+	if ( PlaybackRate < 0.f )
+		return TDecodeSkip::None;
 
-#if defined(ENABLE_DECODER_TEST)
-TDecoder_Test::TDecoder_Test() :
-	mCurrentColour(0)
+	if ( PlaybackRate > DECODE_KEYFRAMES_ONLY_RATE )
+		return TDecodeSkip::KeyframesOnly;
+
+	if ( PlaybackRate > DECODE_SKIP_NONREF_RATE )
+		return TDecodeSkip::NonReference;
+
+	return TDecodeSkip::None;
+}
+
+const char* TDecodeSkip::ToString(TDecodeSkip::Type Skip)
+{
+	switch ( Skip )
+	{
+	case TDecodeSkip::None:				return "None";
+	case TDecodeSkip::NonReference:		return "NonReference";
+	case TDecodeSkip::KeyframesOnly:	return "KeyframesOnly";
+	default:							return "Unknown skip type";
+	}
+}
+
+
+TTestFrameGenerator::TTestFrameGenerator(const TTestDecoderParams& Params) :
+	mParams	( Params )
+{
+}
+
+TTestDecoderParams TTestFrameGenerator::GetDefaultParams()
+{
+	TTestDecoderParams Params;
+	memset( &Params, 0, sizeof(Params) );
+	Params.mWidth = 1280;
+	Params.mHeight = 720;
+	Params.mFormat = TFrameFormat::RGBA;
+	Params.mFramesPerSecond = 30.f;
+	Params.mFrameCount = 300;
+	Params.mCostModel = TTestDecoderCost::None;
+	Params.mCostPasses = 1;
+	Params.mKeyframeInterval = 30;
+	Params.mBFrames = 2;
+	return Params;
+}
+
+TFrameMeta TTestFrameGenerator::GetFrameMeta() const
+{
+	return TFrameMeta( mParams.mWidth, mParams.mHeight, static_cast<TFrameFormat::Type>( mParams.mFormat ) );
+}
+
+bool TTestFrameGenerator::IsEnd(int FrameIndex) const
+{
+	return mParams.mFrameCount > 0 && FrameIndex >= mParams.mFrameCount;
+}
+
+//	first frame is one interval in, same as the libav decoder's running timestamp
+SoyTime TTestFrameGenerator::GetTimestamp(int FrameIndex) const
+{
+	double IntervalMs = 1000.0 / ofMax( 0.001f, mParams.mFramesPerSecond );
+	return SoyTime( static_cast<uint64>( (FrameIndex+1) * IntervalMs ) );
+}
+
+int TTestFrameGenerator::GetFrameIndex(SoyTime Timestamp) const
+{
+	double IntervalMs = 1000.0 / ofMax( 0.001f, mParams.mFramesPerSecond );
+	int FrameIndex = static_cast<int>( static_cast<double>( Timestamp.GetTime() ) / IntervalMs ) - 1;
+
+	//	timestamps are truncated to ms, so a frame's own timestamp can divide down to the frame before
+	if ( GetTimestamp( FrameIndex+1 ).GetTime() <= Timestamp.GetTime() )
+		FrameIndex++;
+	FrameIndex = ofMax( 0, FrameIndex );
+	if ( mParams.mFrameCount > 0 )
+		FrameIndex = ofMin( FrameIndex, mParams.mFrameCount-1 );
+	return FrameIndex;
+}
+
+bool TTestFrameGenerator::IsKeyframe(int FrameIndex) const
+{
+	return GetKeyframe( FrameIndex ) == FrameIndex;
+}
+
+int TTestFrameGenerator::GetKeyframe(int FrameIndex) const
+{
+	int Interval = ofMax( 1, mParams.mKeyframeInterval );
+	return FrameIndex - (FrameIndex % Interval);
+}
+
+int TTestFrameGenerator::GetGopEnd(int GopStart) const
+{
+	int GopEnd = GopStart + ofMax( 1, mParams.mKeyframeInterval );
+	if ( mParams.mFrameCount > 0 )
+		GopEnd = ofMin( GopEnd, mParams.mFrameCount );
+	return GopEnd;
+}
+
+//	after the keyframe, frames are in groups of b-frames followed by the reference frame they're predicted from
+//	(the last group in a gop may be short)
+bool TTestFrameGenerator::IsReference(int FrameIndex) const
+{
+	int GopStart = GetKeyframe( FrameIndex );
+	if ( FrameIndex == GopStart )
+		return true;
+
+	int GroupSize = ofMax( 0, mParams.mBFrames ) + 1;
+	int GroupStart = GopStart + 1 + ((FrameIndex - GopStart - 1) / GroupSize) * GroupSize;
+	GroupSize = ofMin( GroupSize, GetGopEnd( GopStart ) - GroupStart );
+	return FrameIndex == GroupStart + GroupSize - 1;
+}
+
+//	the reference frame is stored before the b-frames that need it
+int TTestFrameGenerator::GetDecodeOrderFrame(int DecodeIndex) const
+{
+	int GopStart = GetKeyframe( DecodeIndex );
+	if ( DecodeIndex == GopStart )
+		return DecodeIndex;
+
+	int GroupSize = ofMax( 0, mParams.mBFrames ) + 1;
+	int GroupIndex = DecodeIndex - GopStart - 1;
+	int GroupStart = GopStart + 1 + (GroupIndex / GroupSize) * GroupSize;
+	int GroupPosition = GroupIndex % GroupSize;
+	GroupSize = ofMin( GroupSize, GetGopEnd( GopStart ) - GroupStart );
+
+	if ( GroupPosition == 0 )
+		return GroupStart + GroupSize - 1;
+	return GroupStart + GroupPosition - 1;
+}
+
+void TTestFrameGenerator::ApplyCost(Array<uint8>& DecodeBuffer,int FrameIndex) const
+{
+	switch ( mParams.mCostModel )
+	{
+	case TTestDecoderCost::Fixed:
+	{
+		//	spin rather than sleep; sleeps are too coarse and a decoder doesn't give up its core
+		auto End = std::chrono::steady_clock::now() + std::chrono::microseconds( ofMax( 0, mParams.mCostUs ) );
+		while ( std::chrono::steady_clock::now() < End )
+		{
+		}
+		break;
+	}
+
+	case TTestDecoderCost::Workload:
+	{
+		//	draw at the source size, so the cost doesn't depend on what we're decoding to
+		auto Meta = GetFrameMeta();
+		int Pitch = Meta.mWidth * Meta.GetChannels();
+		DecodeBuffer.SetSize( Pitch * Meta.mHeight );
+		for ( int i=0;	i<ofMax(1,mParams.mCostPasses);	i++ )
+			Draw( DecodeBuffer.GetArray(), Pitch, Meta, FrameIndex );
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+//	colour from the frame index, a bar that moves half its width each frame, and the frame index
+//	in binary across the top (white is 1) so frames can be identified when read back
+void TTestFrameGenerator::Draw(uint8* Pixels,int Pitch,const TFrameMeta& Meta,int FrameIndex) const
 {
-	mColours.PushBack( TColour(255,0,0) );
-	mColours.PushBack( TColour(255,255,0) );
-	mColours.PushBack( TColour(255,0,255) );
+	int Channels = Meta.GetChannels();
+	int Width = Meta.mWidth;
+	int Height = Meta.mHeight;
+	if ( !Pixels || !Meta.IsValid() )
+		return;
+
+	uint32 Hash = ( static_cast<uint32>( FrameIndex ) * 2654435761u ) ^ mParams.mSeed;
+	TColour Colour( Hash & 0xff, (Hash>>8) & 0xff, (Hash>>16) & 0xff );
+	BufferArray<uint8,10> Components( Channels );
+	for ( int i=0;	i<Components.GetSize();	i++ )
+		Components[i] = Colour[i];
+
+	//	fill the first row, then copy it down
+	int RowSize = Width * Channels;
+	for ( int x=0;	x<Width;	x++ )
+		memcpy( &Pixels[x*Channels], Components.GetArray(), Channels );
+	for ( int y=1;	y<Height;	y++ )
+		memcpy( &Pixels[y*Pitch], Pixels, RowSize );
+
+	int BarWidth = ofMax( 1, Width/16 );
+	int BarX = static_cast<int>( ( static_cast<int64>( FrameIndex ) * ofMax(1,BarWidth/2) ) % Width );
+	int BarSize = ofMin( BarWidth, Width-BarX ) * Channels;
+	for ( int y=0;	y<Height;	y++ )
+		memset( &Pixels[y*Pitch + BarX*Channels], 255, BarSize );
+
+	int BlockSize = ofMax( 1, Width/32 );
+	for ( int Bit=0;	Bit<16 && Bit*BlockSize<Width;	Bit++ )
+	{
+		uint8 Value = ( (FrameIndex >> Bit) & 1 ) ? 255 : 0;
+		int BlockX = Bit * BlockSize;
+		int BlockRowSize = ofMin( BlockSize, Width-BlockX ) * Channels;
+		for ( int y=0;	y<ofMin(BlockSize,Height);	y++ )
+			memset( &Pixels[y*Pitch + BlockX*Channels], Value, BlockRowSize );
+	}
+}
 
-	mColours.PushBack( TColour(0,255,0) );
-	mColours.PushBack( TColour(0,255,255) );
 
-	mColours.PushBack( TColour(0,0,255) );
+#if defined(ENABLE_DECODER_TEST)
+TDecoder_Test::TDecoder_Test() :
+	mGenerator		( TTestFrameGenerator::GetDefaultParams() ),
+	mDecodeIndex	( 0 )
+{
 }
 #endif
 
@@ -57,11 +250,30 @@ TDecoder_Test::TDecoder_Test() :
 #if defined(ENABLE_DECODER_TEST)
 TDecodeInitResult::Type TDecoder_Test::Init(const TDecodeParams& Params)
 {
-	//	debug test to see if a big init pause locks up unity
-	Sleep(4000);
+	//	filename is ignored, the video comes from the current test params
+	mGenerator = TTestFrameGenerator( Unity::GetFastVideo().GetTestDecoderParams() );
+	auto& TestParams = mGenerator.mParams;
+
+	if ( TestParams.mInitDelayMs > 0 )
+		ofThread::sleep( TestParams.mInitDelayMs );
+
+	if ( TestParams.mInitFail )
+	{
+		Unity::DebugError("Test decoder failing init");
+		return TDecodeInitResult::UnknownError;
+	}
+
+	mVideoMeta.mFrameMeta = mGenerator.GetFrameMeta();
+	mVideoMeta.mFramesPerSecond = TestParams.mFramesPerSecond;
+	if ( !mVideoMeta.mFrameMeta.IsValid() )
+	{
+		Unity::DebugError("Test decoder has invalid frame size/format");
+		return TDecodeInitResult::CodecError;
+	}
 
-	//	delayed failure test
-	return TDecodeInitResult::UnknownError;
+	mDecodeIndex = 0;
+	mLastDecodedTimestamp = SoyTime();
+	return TDecodeInitResult::Success;
 }
 #endif
 
@@ -69,17 +281,97 @@ TDecodeInitResult::Type TDecoder_Test::Init(const TDecodeParams& Params)
 #if defined(ENABLE_DECODER_TEST)
 bool TDecoder_Test::PeekNextFrame(TFrameMeta& FrameMeta)
 {
-	FrameMeta = TFrameMeta( 4096, 2048, TFrameFormat::BGRA );
+	FrameMeta = mGenerator.GetFrameMeta();
 	return true;
 }
 #endif
 
 
+#if defined(ENABLE_DECODER_TEST)
+bool TDecoder_Test::IsSkipped(int FrameIndex) const
+{
+	switch ( mSkipMode )
+	{
+	case TDecodeSkip::NonReference:		return !mGenerator.IsReference( FrameIndex );
+	case TDecodeSkip::KeyframesOnly:	return !mGenerator.IsKeyframe( FrameIndex );
+	default:							return false;
+	}
+}
+#endif
+
+
 #if defined(ENABLE_DECODER_TEST)
 bool TDecoder_Test::DecodeNextFrame(TFramePixels& OutFrame,SoyTime MinTimestamp,bool& TryAgain)
 {
-	OutFrame.SetColour( mColours[mCurrentColour%mColours.GetSize()] );
-	mCurrentColour++;
+	TryAgain = false;
+
+	//	skipped frames cost nothing, like the packets libav doesn't send to the codec
+	int FrameIndex = -1;
+	while ( FrameIndex < 0 || IsSkipped( FrameIndex ) )
+	{
+		if ( mGenerator.IsEnd( mDecodeIndex ) )
+			return false;
+
+		//	a decoder with no reorder delay outputs frames in the order they're stored
+		FrameIndex = mGenerator.mParams.mOutOfOrder ? mGenerator.GetDecodeOrderFrame( mDecodeIndex ) : mDecodeIndex;
+		mDecodeIndex++;
+	}
+
+	TPipelineTimer DecodeCounter( mCounters ? &mCounters->mDecode : nullptr );
+	mGenerator.ApplyCost( mDecodeBuffer, FrameIndex );
+	DecodeCounter.Stop();
+
+	OutFrame.mTimestamp = mGenerator.GetTimestamp( FrameIndex );
+	OutFrame.mKeyframe = mGenerator.IsKeyframe( FrameIndex );
+
+	//	checking for out-of-order frames
+	if ( OutFrame.mTimestamp < mLastDecodedTimestamp )
+	{
+		if ( Unity::IsLogEnabled( TLogLevel::Full ) )
+		{
+			BufferString<100> Debug;
+			Debug << (DECODER_SKIP_OOO_FRAMES?"Skipped":"Decoded") << " out-of-order frames " << mLastDecodedTimestamp << " ... " << OutFrame.mTimestamp;
+			Unity::Debug(Debug);
+		}
+
+		if ( DECODER_SKIP_OOO_FRAMES )
+		{
+			TryAgain = true;
+			return false;
+		}
+	}
+	mLastDecodedTimestamp = OutFrame.mTimestamp;
+
+	//	too far behind, skip it
+	if ( OutFrame.mTimestamp < MinTimestamp && MinTimestamp.IsValid() && !STORE_PAST_FRAMES )
+	{
+		if ( Unity::IsLogEnabled( TLogLevel::Lag ) )
+		{
+			BufferString<100> Debug;
+			Debug << "Decoded frame " << OutFrame.mTimestamp << " too far behind " << MinTimestamp << " [skipped]";
+			Unity::DebugDecodeLag(Debug);
+		}
+		TryAgain = true;
+		return false;
+	}
+
+	TPipelineTimer ConvertCounter( mCounters ? &mCounters->mConvert : nullptr );
+	mGenerator.Draw( OutFrame.GetData(), OutFrame.GetPitch(), OutFrame.mMeta, FrameIndex );
+	ConvertCounter.Stop();
+	if ( mCounters )
+		mCounters->mFramesConverted++;
+
+	return true;
+}
+#endif
+
+
+#if defined(ENABLE_DECODER_TEST)
+bool TDecoder_Test::Seek(SoyTime Timestamp)
+{
+	//	keyframes are at the same position in decode and presentation order
+	mDecodeIndex = mGenerator.GetKeyframe( mGenerator.GetFrameIndex( Timestamp ) );
+	mLastDecodedTimestamp = SoyTime();
 	return true;
 }
 #endif
@@ -145,6 +437,17 @@ bool TPacket::reset(AVFormatContext* ctxt)
 }
 #endif
 
+#if defined(ENABLE_DECODER_LIBAV)
+void TPacket::clear()
+{
+	if ( packet.data )
+		av_free_packet(&packet);
+	memset( &packet, 0x00, sizeof(packet) );
+	av_init_packet(&packet);
+	packet.data = nullptr;
+}
+#endif
+
 
 #if defined(ENABLE_DECODER_LIBAV)
 TFrameFormat::Type GetFormat(enum AVPixelFormat Format)
@@ -174,9 +477,301 @@ enum AVPixelFormat GetFormat(const TFrameMeta& FrameMeta)
 }
 #endif
 
-TFrameBuffer::TFrameBuffer(int MaxFrameBufferSize,TFramePool& FramePool) :
+namespace
+{
+	TPipelineCounters	gGlobalPipelineCounters( nullptr );
+};
+
+const char* TPipelineStage::ToString(TPipelineStage::Type Stage)
+{
+	switch ( Stage )
+	{
+	case PacketRead:	return "PacketRead";
+	case Decode:		return "Decode";
+	case Convert:		return "Convert";
+	case PoolWait:		return "PoolWait";
+	case Residency:		return "Residency";
+	case StagingCopy:	return "StagingCopy";
+	case Upload:		return "Upload";
+	case EndToEnd:		return "EndToEnd";
+	default:			return "Unknown";
+	}
+}
+
+TPipelineCounters::TPipelineCounters(TPipelineCounters* Global) :
+	mBufferedFrames	( 0 ),
+	mShownFrameMs	( 0 )
+{
+	Reset();
+
+	if ( Global )
+	{
+		for ( int s=0;	s<TPipelineStage::Count;	s++ )
+		{
+			auto Stage = static_cast<TPipelineStage::Type>( s );
+			GetStage( Stage )->mGlobal = Global->GetStage( Stage );
+		}
+	}
+}
+
+TPipelineCounters& TPipelineCounters::GetGlobal()
+{
+	return gGlobalPipelineCounters;
+}
+
+TPlaybackClock::TPlaybackClock() :
+	mSequence	( 0 ),
+	mBaseUs		( 0 ),
+	mBaseWallUs	( TPipelineTimer::GetTimeUs() ),
+	mRate		( REAL_TIME_MODIFIER ),
+	mRunning	( false )
+{
+}
+
+TPlaybackClock::TState TPlaybackClock::GetState() const
+{
+	TState State;
+	while ( true )
+	{
+		uint32 Sequence = mSequence.load( std::memory_order_acquire );
+		if ( Sequence & 1 )
+			continue;
+
+		State.mBaseUs = mBaseUs.load( std::memory_order_relaxed );
+		State.mBaseWallUs = mBaseWallUs.load( std::memory_order_relaxed );
+		State.mRate = mRate.load( std::memory_order_relaxed );
+		State.mRunning = mRunning.load( std::memory_order_relaxed );
+
+		//	changed while we read it
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if ( mSequence.load( std::memory_order_relaxed ) == Sequence )
+			return State;
+	}
+}
+
+void TPlaybackClock::SetState(const TState& State)
+{
+	uint32 Sequence = mSequence.load( std::memory_order_relaxed );
+	mSequence.store( Sequence+1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	mBaseUs.store( State.mBaseUs, std::memory_order_relaxed );
+	mBaseWallUs.store( State.mBaseWallUs, std::memory_order_relaxed );
+	mRate.store( State.mRate, std::memory_order_relaxed );
+	mRunning.store( State.mRunning, std::memory_order_relaxed );
+
+	mSequence.store( Sequence+2, std::memory_order_release );
+}
+
+int64 TPlaybackClock::GetTimeUs(const TState& State,uint64 WallUs)
+{
+	int64 TimeUs = State.mBaseUs;
+	if ( State.mRunning && WallUs > State.mBaseWallUs )
+		TimeUs += static_cast<int64>( static_cast<double>( WallUs - State.mBaseWallUs ) * State.mRate );
+
+	//	going backwards, stop at the start
+	return TimeUs > 0 ? TimeUs : 0;
+}
+
+SoyTime TPlaybackClock::GetTime() const
+{
+	auto State = GetState();
+	auto TimeUs = GetTimeUs( State, TPipelineTimer::GetTimeUs() );
+	return SoyTime( static_cast<uint64>( TimeUs / 1000 ) );
+}
+
+void TPlaybackClock::SetTime(SoyTime Time)
+{
+	ofMutex::ScopedLock Lock( mWriteLock );
+	auto State = GetState();
+	State.mBaseUs = static_cast<int64>( Time.GetTime() ) * 1000;
+	State.mBaseWallUs = TPipelineTimer::GetTimeUs();
+	SetState( State );
+}
+
+void TPlaybackClock::SetRate(float Rate)
+{
+	ofMutex::ScopedLock Lock( mWriteLock );
+	auto State = GetState();
+	uint64 WallUs = TPipelineTimer::GetTimeUs();
+	State.mBaseUs = GetTimeUs( State, WallUs );
+	State.mBaseWallUs = WallUs;
+	State.mRate = Rate;
+	SetState( State );
+}
+
+void TPlaybackClock::SetRunning(bool Running)
+{
+	ofMutex::ScopedLock Lock( mWriteLock );
+	auto State = GetState();
+	if ( State.mRunning == Running )
+		return;
+	uint64 WallUs = TPipelineTimer::GetTimeUs();
+	State.mBaseUs = GetTimeUs( State, WallUs );
+	State.mBaseWallUs = WallUs;
+	State.mRunning = Running;
+	SetState( State );
+}
+
+void TPlaybackClock::CopyFrom(const TPlaybackClock& That)
+{
+	auto State = That.GetState();
+	ofMutex::ScopedLock Lock( mWriteLock );
+	SetState( State );
+}
+
+void TPipelineCounters::Reset()
+{
+	mFramesDecoded = 0;
+	mFramesConverted = 0;
+	mFramesUploaded = 0;
+	mFramesSkipped = 0;
+	mFramesDropped = 0;
+	mBytesRead = 0;
+	ResetStages();
+}
+
+void TPipelineCounters::ResetStages()
+{
+	for ( int s=0;	s<TPipelineStage::Count;	s++ )
+		GetStage( static_cast<TPipelineStage::Type>( s ) )->Reset();
+}
+
+TPipelineStageCounter* TPipelineCounters::GetStage(TPipelineStage::Type Stage)
+{
+	switch ( Stage )
+	{
+	case TPipelineStage::PacketRead:	return &mRead;
+	case TPipelineStage::Decode:		return &mDecode;
+	case TPipelineStage::Convert:		return &mConvert;
+	case TPipelineStage::PoolWait:		return &mPoolWait;
+	case TPipelineStage::Residency:		return &mResidency;
+	case TPipelineStage::StagingCopy:	return &mStagingCopy;
+	case TPipelineStage::Upload:		return &mUpload;
+	case TPipelineStage::EndToEnd:		return &mEndToEnd;
+	default:							return nullptr;
+	}
+}
+
+void TPipelineStageCounter::Reset()
+{
+	mCount = 0;
+	mTotalUs = 0;
+	mMaxUs = 0;
+	mHistogram.Reset();
+}
+
+void TPipelineStageCounter::Add(uint64 Us)
+{
+	mCount++;
+	mTotalUs += Us;
+	mHistogram.Add( Us );
+
+	//	raise the max, unless another thread beats us to a bigger one
+	uint64 Max = mMaxUs;
+	while ( Us > Max && !mMaxUs.compare_exchange_weak( Max, Us ) )
+	{
+	}
+
+	if ( mGlobal )
+		mGlobal->Add( Us );
+}
+
+void TPipelineStageCounter::AddSince(uint64 StartUs)
+{
+	if ( StartUs == 0 )
+		return;
+	uint64 Now = TPipelineTimer::GetTimeUs();
+	Add( Now > StartUs ? Now - StartUs : 0 );
+}
+
+void TPipelineStageCounter::GetPercentiles(TLatencyPercentiles& Percentiles) const
+{
+	//	a snapshot; adds during the copy may or may not be in it
+	uint32 Counts[TLatencyHistogram::BUCKET_COUNT];
+	uint64 Total = mHistogram.GetCounts( Counts );
+	uint64 TotalUs = mTotalUs;
+	uint64 Count = mCount;
+
+	Percentiles.mCount = Total;
+	Percentiles.mMeanMs = Count ? (TotalUs / 1000.f) / Count : 0.f;
+	Percentiles.mP50Ms = TLatencyHistogram::GetPercentileUs( Counts, Total, 50.f ) / 1000.f;
+	Percentiles.mP90Ms = TLatencyHistogram::GetPercentileUs( Counts, Total, 90.f ) / 1000.f;
+	Percentiles.mP99Ms = TLatencyHistogram::GetPercentileUs( Counts, Total, 99.f ) / 1000.f;
+	Percentiles.mP999Ms = TLatencyHistogram::GetPercentileUs( Counts, Total, 99.9f ) / 1000.f;
+	Percentiles.mMaxMs = GetMaxMs();
+}
+
+void TLatencyHistogram::Reset()
+{
+	for ( int b=0;	b<BUCKET_COUNT;	b++ )
+		mBuckets[b].store( 0, std::memory_order_relaxed );
+}
+
+uint64 TLatencyHistogram::GetCounts(uint32* Counts) const
+{
+	uint64 Total = 0;
+	for ( int b=0;	b<BUCKET_COUNT;	b++ )
+	{
+		Counts[b] = mBuckets[b].load( std::memory_order_relaxed );
+		Total += Counts[b];
+	}
+	return Total;
+}
+
+int TLatencyHistogram::GetBucket(uint64 Us)
+{
+	if ( Us > LATENCY_HISTOGRAM_MAX_US )
+		Us = LATENCY_HISTOGRAM_MAX_US;
+	if ( Us < 2 * SUB_BUCKETS )
+		return static_cast<int>( Us );
+
+	//	highest bit picks the power of two, the bits below it pick the linear bucket
+	int HighBit = 0;
+	for ( uint64 v=Us>>1;	v;	v>>=1 )
+		HighBit++;
+	int Shift = HighBit - LATENCY_HISTOGRAM_SUB_BITS;
+	int SubBucket = static_cast<int>( Us >> Shift ) - SUB_BUCKETS;
+	return (2 * SUB_BUCKETS) + (HighBit - LATENCY_HISTOGRAM_SUB_BITS - 1) * SUB_BUCKETS + SubBucket;
+}
+
+uint64 TLatencyHistogram::GetBucketMaxUs(int Bucket)
+{
+	if ( Bucket < 2 * SUB_BUCKETS )
+		return Bucket;
+
+	Bucket -= 2 * SUB_BUCKETS;
+	int Shift = (Bucket / SUB_BUCKETS) + 1;
+	uint64 SubBucket = (Bucket % SUB_BUCKETS) + SUB_BUCKETS;
+	return ((SubBucket + 1) << Shift) - 1;
+}
+
+uint64 TLatencyHistogram::GetPercentileUs(const uint32* Counts,uint64 Total,float Percent)
+{
+	if ( Total == 0 )
+		return 0;
+
+	//	smallest value with at least Percent of the samples at or below it
+	double ExactRank = Total * (Percent / 100.0);
+	uint64 Rank = static_cast<uint64>( ExactRank );
+	if ( Rank < ExactRank || Rank == 0 )
+		Rank++;
+	if ( Rank > Total )
+		Rank = Total;
+	uint64 Seen = 0;
+	for ( int b=0;	b<BUCKET_COUNT;	b++ )
+	{
+		Seen += Counts[b];
+		if ( Seen >= Rank )
+			return GetBucketMaxUs( b );
+	}
+	return GetBucketMaxUs( BUCKET_COUNT-1 );
+}
+
+TFrameBuffer::TFrameBuffer(int MaxFrameBufferSize,TFramePool& FramePool,TPipelineCounters* Counters) :
 	mMaxFrameBufferSize	( ofMax(MaxFrameBufferSize,1) ),
-	mFramePool			( FramePool )
+	mFramePool			( FramePool ),
+	mCounters			( Counters )
 {
 }
 	
@@ -193,13 +788,39 @@ bool TFrameBuffer::IsFull()
 	return false;
 }
 
+int TFrameBuffer::GetSize()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	return mFrameBuffers.GetSize();
+}
+
+SoyTime TFrameBuffer::GetLastTimestamp()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	if ( mFrameBuffers.IsEmpty() )
+		return SoyTime();
+	return mFrameBuffers[mFrameBuffers.GetSize()-1]->mTimestamp;
+}
+
 
-TDecodeThread::TDecodeThread(TDecodeParams& Params,TFrameBuffer& FrameBuffer,TFramePool& FramePool) :
+TDecodeThread::TDecodeThread(TDecodeParams& Params,TFrameBuffer& FrameBuffer,TFrameCache& FrameCache,TFramePool& FramePool,TFrameQuota& FrameQuota,TPipelineCounters& Counters,const TPlaybackClock& Clock) :
 	SoyThread			( "TDecodeThread" ),
-	mFrameBuffer		( FrameBuffer ),
-	mFramePool			( FramePool ),
 	mParams				( Params ),
-	mState				( TDecodeState::NoThread )
+	mState				( TDecodeState::NoThread ),
+	mFramePool			( FramePool ),
+	mFrameQuota			( FrameQuota ),
+	mFrameBuffer		( FrameBuffer ),
+	mFrameCache			( FrameCache ),
+	mCounters			( Counters ),
+	mClock				( Clock ),
+	mScrubbing			( false ),
+	mTileHashing		( false ),
+	mReadableFrames		( false ),
+	mSeekRequested		( false ),
+	mSkipMode			( TDecodeSkip::None ),
+	mReverse			( false ),
+	mReverseChunkSeeked	( false ),
+	mPoolWaitStartUs	( 0 )
 {
 	Unity::Debug(__FUNCTION__);
 }
@@ -209,10 +830,12 @@ TDecodeThread::~TDecodeThread()
 	Unity::TScopeTimerWarning Timer( __FUNCTION__, 1 );
 
 	Unity::Debug("~TDecodeThread release frames");
+	ClearSharedFrameBuffers();
 	mFrameBuffer.ReleaseFrames();
 
 	Unity::Debug("~TDecodeThread WaitForThread");
 	waitForThread();
+	ReleaseReverseChunk();
 
 	Unity::Debug("~TDecodeThread finished");
 }
@@ -238,16 +861,15 @@ TDecodeInitResult::Type TDecodeThread::Init()
 		mDecoder = ofPtr<TDecoder>( new TDecoder_Qtkit() );
 #endif
 	
-#if defined(ENABLE_DECODER_TEST)
-	if ( !mDecoder )
-		mDecoder = ofPtr<TDecoder>( new TDecoder_Test() );
-#endif
-	
+	//	no decoder for real files on this platform. The test decoder's frames would look like the
+	//	video is playing, so it's only used when it's been asked for (USE_TEST_DECODER)
 	if ( !mDecoder )
 	{
+		Unity::DebugError("No decoder available for this platform");
 		mState = TDecodeState::NoThread;
 		return TDecodeInitResult::UnknownError;
 	}
+	mDecoder->mCounters = &mCounters;
 	mState = TDecodeState::Constructed;
 
 	//	push a clean-frame before we start the thread
@@ -296,6 +918,8 @@ void TFrameBuffer::ReleaseFrames()
 		auto Frame = mFrameBuffers.PopAt(i);
 		mFramePool.Free( Frame );
 	}
+	mReverseShown = SoyTime();
+	UpdateDepthCounter();
 }
 
 bool TFrameBuffer::HasVideoToPop()
@@ -305,10 +929,14 @@ bool TFrameBuffer::HasVideoToPop()
 }
 
 
-TFramePixels* TFrameBuffer::PopFrame(SoyTime Timestamp)
+TFramePixels* TFrameBuffer::PopFrame(SoyTime Timestamp,bool Reverse)
 {
+	if ( Reverse )
+		return PopFrameReverse( Timestamp );
+
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
 	ofMutex::ScopedLock lock( mFrameMutex );
+	mReverseShown = SoyTime();
 
 	if ( mFrameBuffers.GetSize() < FORCE_BUFFER_FRAME_COUNT )
 		return nullptr;
@@ -334,9 +962,14 @@ TFramePixels* TFrameBuffer::PopFrame(SoyTime Timestamp)
 	int SkipCount = PopFrameIndex;
 	if ( SkipCount > 0 && SKIP_PAST_FRAMES )
 	{
-		BufferString<100> Debug;
-		Debug << "Skipping " << SkipCount << " frames";
-		Unity::DebugDecodeLag(Debug);
+		if ( Unity::IsLogEnabled( TLogLevel::Lag ) )
+		{
+			BufferString<100> Debug;
+			Debug << "Skipping " << SkipCount << " frames";
+			Unity::DebugDecodeLag(Debug);
+		}
+		if ( mCounters )
+			mCounters->mFramesSkipped += SkipCount;
 
 
 		//	pop & release the first X frames we're going to skip
@@ -344,121 +977,795 @@ TFramePixels* TFrameBuffer::PopFrame(SoyTime Timestamp)
 		{
 			auto* Frame = mFrameBuffers.PopAt(0);
 			
-			BufferString<100> Debug;
-			Debug << "Frame " << Frame->mTimestamp << " skipped";
-			ofLogNotice( Debug.c_str() );
+			if ( Unity::IsLogEnabled( TLogLevel::Full ) )
+			{
+				BufferString<100> Debug;
+				Debug << "Frame " << Frame->mTimestamp << " skipped";
+				ofLogNotice( Debug.c_str() );
+			}
 
 			mFramePool.Free( Frame );
 			PopFrameIndex--;
 		}
-		assert( PopFrameIndex == 0 );
+		assert( PopFrameIndex == 0 );
+	}
+
+	//	nothing to use
+	if ( PopFrameIndex == -1 )
+		return NULL;
+
+	TFramePixels* PoppedFrame = mFrameBuffers.PopAt(0);
+	UpdateDepthCounter();
+	if ( mCounters )
+		mCounters->mResidency.AddSince( PoppedFrame->mBufferedUs );
+	return PoppedFrame;
+}
+
+//	time is going backwards, so the frames in the future are the ones we've passed.
+//	the frame we last popped is shown until the time goes before it, then we use the
+//	latest frame at or before the timestamp and leave the earlier ones for later
+TFramePixels* TFrameBuffer::PopFrameReverse(SoyTime Timestamp)
+{
+	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
+	ofMutex::ScopedLock lock( mFrameMutex );
+
+	//	no time yet, we have nothing to go backwards from
+	if ( !Timestamp.IsValid() )
+		return nullptr;
+
+	//	still showing the last frame
+	if ( mReverseShown.IsValid() && !(Timestamp < mReverseShown) )
+		return nullptr;
+
+	//	release frames we've already gone past
+	int SkipCount = 0;
+	while ( !mFrameBuffers.IsEmpty() )
+	{
+		auto* Frame = mFrameBuffers[mFrameBuffers.GetSize()-1];
+		if ( !(Frame->mTimestamp > Timestamp) )
+			break;
+
+		mFrameBuffers.PopBack();
+		mFramePool.Free( Frame );
+		SkipCount++;
+	}
+
+	if ( SkipCount > 0 && SKIP_PAST_FRAMES )
+	{
+		if ( Unity::IsLogEnabled( TLogLevel::Lag ) )
+		{
+			BufferString<100> Debug;
+			Debug << "Skipping " << SkipCount << " frames (reverse)";
+			Unity::DebugDecodeLag(Debug);
+		}
+		if ( mCounters )
+			mCounters->mFramesSkipped += SkipCount;
+	}
+
+	//	nothing to use
+	if ( mFrameBuffers.IsEmpty() )
+	{
+		UpdateDepthCounter();
+		return nullptr;
+	}
+
+	TFramePixels* PoppedFrame = mFrameBuffers.PopBack();
+	mReverseShown = PoppedFrame->mTimestamp;
+	UpdateDepthCounter();
+	if ( mCounters )
+		mCounters->mResidency.AddSince( PoppedFrame->mBufferedUs );
+	return PoppedFrame;
+}
+
+void TFrameBuffer::UpdateDepthCounter()
+{
+	if ( mCounters )
+		mCounters->mBufferedFrames = mFrameBuffers.GetSize();
+}
+
+
+TFrameCache::TFrameCache(int MaxSize,TFramePool& FramePool) :
+	mMaxSize	( ofMax(MaxSize,1) ),
+	mFramePool	( FramePool ),
+	mCoverValid	( false )
+{
+}
+
+TFrameCache::~TFrameCache()
+{
+	ReleaseFrames();
+}
+
+bool TFrameCache::IsFull()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	return mFrames.GetSize() >= mMaxSize;
+}
+
+bool TFrameCache::IsCovered(SoyTime Timestamp)
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	if ( !mCoverValid )
+		return false;
+
+	if ( Timestamp < mCoverStart )
+		return false;
+	if ( !(Timestamp < mCoverEnd) )
+		return false;
+	return true;
+}
+
+SoyTime TFrameCache::GetLastTimestamp()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	if ( mFrames.IsEmpty() )
+		return SoyTime();
+	return mFrames[mFrames.GetSize()-1]->mTimestamp;
+}
+
+int TFrameCache::GetFrameIndex(SoyTime Timestamp)
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+
+	//	last frame at or before the time
+	int Index = -1;
+	for ( int i=0;	i<mFrames.GetSize();	i++ )
+	{
+		if ( mFrames[i]->mTimestamp > Timestamp )
+			break;
+		Index = i;
+	}
+	return Index;
+}
+
+TFrameRef TFrameCache::GetFrame(SoyTime Timestamp)
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	if ( mFrames.IsEmpty() )
+		return TFrameRef();
+
+	//	before the first frame (eg. seeked before the first keyframe) show the first one
+	int Index = GetFrameIndex( Timestamp );
+	return TFrameRef( mFrames[ofMax(0,Index)], mFramePool );
+}
+
+SoyTime TFrameCache::GetStepTime(SoyTime Timestamp,int Steps)
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	int Index = GetFrameIndex( Timestamp );
+	if ( Index < 0 )
+		return SoyTime();
+
+	int StepIndex = Index + Steps;
+	if ( StepIndex >= 0 && StepIndex < mFrames.GetSize() )
+		return mFrames[StepIndex]->mTimestamp;
+
+	//	one past the end is the first frame of the next GOP
+	if ( StepIndex == mFrames.GetSize() && mCoverValid )
+		return mCoverEnd;
+
+	return SoyTime();
+}
+
+int TFrameCache::GetFrameInterval()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	if ( mFrames.GetSize() < 2 )
+		return DEFAULT_FRAME_INTERVAL_MS;
+
+	auto First = mFrames[0]->mTimestamp.GetTime();
+	auto Last = mFrames[mFrames.GetSize()-1]->mTimestamp.GetTime();
+	int Interval = static_cast<int>( (Last - First) / (mFrames.GetSize()-1) );
+	return ofMax( 1, Interval );
+}
+
+void TFrameCache::PushFrame(TFramePixels* pFrame)
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	auto SortedFrames = GetSortArray( mFrames, TSortPolicy_TFramePixelsByTimestamp() );
+	SortedFrames.Push( pFrame );
+}
+
+TFramePixels* TFrameCache::PopOldestFrame()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	if ( mFrames.IsEmpty() )
+		return nullptr;
+
+	//	being copied to a texture, can't decode into it. Let it go back to the pool when they're done
+	auto* Frame = mFrames.PopAt(0);
+	if ( Frame->IsShared() )
+	{
+		mFramePool.Free( Frame );
+		return nullptr;
+	}
+	return Frame;
+}
+
+void TFrameCache::SetCover(SoyTime Start,SoyTime End)
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	mCoverValid = true;
+	mCoverStart = Start;
+	mCoverEnd = End;
+
+	//	the frames we have are covered, even if they're before the start
+	if ( !mFrames.IsEmpty() && mFrames[0]->mTimestamp < mCoverStart )
+		mCoverStart = mFrames[0]->mTimestamp;
+}
+
+void TFrameCache::ReleaseFrames()
+{
+	ofMutex::ScopedLock Lock( mFrameMutex );
+	for ( int i=mFrames.GetSize()-1;	i>=0;	i-- )
+	{
+		auto* Frame = mFrames.PopAt(i);
+		mFramePool.Free( Frame );
+	}
+	mCoverValid = false;
+}
+
+
+void TDecodeThread::threadedFunction()
+{
+	Trace::TThread TraceThread("TDecodeThread");
+	assert( mState == TDecodeState::Constructed );
+	
+	//	init
+	TDecodeInitResult::Type InitResult = TDecodeInitResult::UnknownError;
+	if ( mDecoder )
+	{
+		InitResult = mDecoder->Init( mParams );
+	}
+
+	//	set state
+	switch ( InitResult )
+	{
+	case TDecodeInitResult::Success:		mState = TDecodeState::Decoding;				break;
+	case TDecodeInitResult::FileNotFound:	mState = TDecodeState::FailedInit_FileNotFound;	break;
+	case TDecodeInitResult::CodecError:		mState = TDecodeState::FailedInit_CodecError;	break;
+
+	case TDecodeInitResult::UnknownError:
+	default:
+		mState = TDecodeState::FailedInit_Unknown;
+		break;
+	}
+
+
+	while ( isThreadRunning() && mState == TDecodeState::Decoding )
+	{
+        ofThread::sleep(1);
+
+		UpdateDirection();
+		UpdateSeek();
+		UpdateSkipMode();
+
+		if ( IsScrubbing() )
+		{
+			DecodeScrubCache();
+			continue;
+		}
+
+		if ( mReverse )
+		{
+			DecodeNextChunkReverse();
+			continue;
+		}
+
+		//	if buffer is filled, stop (don't buffer too many frames)
+		bool DoDecode = !mFrameBuffer.IsFull();
+
+		//	playing slowly, don't decode further ahead than we need
+		DoDecode &= !IsBufferedAhead();
+
+		if ( !DoDecode )
+			continue;
+		
+		DecodeNextFrame();
+	}
+}
+
+void TFrameBuffer::PushFrame(TFramePixels* pFrame)
+{
+	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
+	ofMutex::ScopedLock lock( mFrameMutex );
+
+	//	sort by time, it's possible we get frames out of order due to encoding
+	auto SortedFrameBuffers = GetSortArray( mFrameBuffers, TSortPolicy_TFramePixelsByTimestamp() );
+	SortedFrameBuffers.Push( pFrame );
+
+	//	popped frame has been put back because it couldn't be shown
+	if ( pFrame->mTimestamp.GetTime() == mReverseShown.GetTime() )
+		mReverseShown = SoyTime();
+	UpdateDepthCounter();
+}
+
+TFrameMeta TDecodeThread::GetDecodedFrameMeta()
+{
+	ofMutex::ScopedLock lock( mDecodeFormat );
+	return mDecodeFormat;
+}
+	
+	
+void TDecodeThread::SetDecodedFrameMeta(TFrameMeta Format)
+{
+	ofMutex::ScopedLock lock( mDecodeFormat );
+
+	//	no change
+	if ( mDecodeFormat.Get() == Format )
+		return;
+
+	//	update
+	mDecodeFormat.Get() = Format;
+
+#if defined(ENABLE_DECODER_LIBAV_INIT_SIZE_FRAME)
+	//	push a green "OK" frame
+	TFramePixels* Frame = mFramePool.Alloc( GetDecodedFrameMeta(), "Debug init", &mFrameQuota );
+	if ( Frame )
+	{
+		Unity::DebugLog( BufferString<100>()<<"Pushing Debug Frame; " << __FUNCTION__ );
+		Frame->SetColour( ENABLE_DECODER_LIBAV_INIT_SIZE_FRAME );
+		PushFrame( Frame );
+	}
+	else
+	{
+		BufferString<100> Debug;
+		Debug << "failed to alloc debug Init frame";
+		Unity::DebugLog( Debug );
+	}
+#endif
+
+}
+
+bool TDecodeThread::IsScrubbing()
+{
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	return mScrubbing;
+}
+
+void TDecodeThread::SetScrubbing(bool Scrubbing)
+{
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	mScrubbing = Scrubbing;
+}
+
+bool TDecodeThread::IsTileHashing()
+{
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	return mTileHashing;
+}
+
+void TDecodeThread::SetTileHashing(bool TileHashing)
+{
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	mTileHashing = TileHashing;
+}
+
+void TDecodeThread::SetReadableFrames(bool Readable)
+{
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	mReadableFrames = Readable;
+}
+
+bool TDecodeThread::CanMapFrames()
+{
+	//	mapped frames are write-only, anything that reads the pixels needs them on the heap
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	return !mTileHashing && !mReadableFrames;
+}
+
+void TDecodeThread::OnFrameDecoded(TFramePixels& Frame)
+{
+	//	mapped frames are write-only, so can't be read back to hash
+	if ( IsTileHashing() && !Frame.IsMapped() )
+		Frame.UpdateTileHashes();
+	else
+		Frame.mTileHashes.Clear();
+}
+
+void TDecodeThread::RequestSeek(SoyTime Timestamp)
+{
+	ofMutex::ScopedLock Lock( mPlaybackRateLock );
+	mSeekRequested = true;
+	mSeekTime = Timestamp;
+}
+
+void TDecodeThread::AddSharedFrameBuffer(TFrameBuffer& FrameBuffer)
+{
+	ofMutex::ScopedLock Lock( mSharedFrameBuffers );
+	mSharedFrameBuffers.PushBackUnique( &FrameBuffer );
+}
+
+void TDecodeThread::RemoveSharedFrameBuffer(TFrameBuffer& FrameBuffer)
+{
+	ofMutex::ScopedLock Lock( mSharedFrameBuffers );
+	int Index = mSharedFrameBuffers.FindIndex( &FrameBuffer );
+	if ( Index < 0 )
+		return;
+	mSharedFrameBuffers.RemoveBlock( Index, 1 );
+}
+
+void TDecodeThread::ClearSharedFrameBuffers()
+{
+	ofMutex::ScopedLock Lock( mSharedFrameBuffers );
+	mSharedFrameBuffers.Clear();
+}
+
+void TDecodeThread::PushFrame(TFramePixels* pFrame)
+{
+	ofMutex::ScopedLock Lock( mSharedFrameBuffers );
+	pFrame->mBufferedUs = TPipelineTimer::GetTimeUs();
+
+	//	share before we push to our own buffer, once it's in there it could be popped and freed
+	for ( int i=0;	i<mSharedFrameBuffers.GetSize();	i++ )
+	{
+		auto& FrameBuffer = *mSharedFrameBuffers[i];
+
+		//	this instance is lagging, it'll just skip this frame
+		if ( FrameBuffer.IsFull() )
+			continue;
+
+		if ( !mFramePool.Retain( pFrame ) )
+			continue;
+		FrameBuffer.PushFrame( pFrame );
+	}
+
+	mFrameBuffer.PushFrame( pFrame );
+}
+
+void TDecodeThread::ReleaseFrames()
+{
+	ofMutex::ScopedLock Lock( mSharedFrameBuffers );
+	for ( int i=0;	i<mSharedFrameBuffers.GetSize();	i++ )
+		mSharedFrameBuffers[i]->ReleaseFrames();
+
+	mFrameBuffer.ReleaseFrames();
+}
+
+void TDecodeThread::UpdateSeek()
+{
+	SoyTime SeekTime;
+	{
+		ofMutex::ScopedLock Lock( mPlaybackRateLock );
+		if ( !mSeekRequested )
+			return;
+		mSeekRequested = false;
+		SeekTime = mSeekTime;
+	}
+
+	if ( !mDecoder )
+		return;
+
+	//	buffered frames are from the old position. The scrub cache refills itself if the time is outside it
+	ReleaseFrames();
+	if ( mReverse )
+	{
+		ReleaseReverseChunk();
+		mReverseChunkEnd = SoyTime( SeekTime.GetTime() + 1 );
+		return;
+	}
+
+	if ( IsScrubbing() )
+		return;
+
+	if ( !SeekDecoder( SeekTime ) )
+		Unity::DebugError("Failed to seek decoder");
+}
+
+//	seeks land on the keyframe before the time, so note where we were going; until we've decoded
+//	past it, being behind the playhead is the seek catching up rather than the decoder being slow
+bool TDecodeThread::SeekDecoder(SoyTime Time)
+{
+	mPendingSeekTime = SoyTime();
+	if ( !mDecoder->Seek( Time ) )
+		return false;
+	mPendingSeekTime = Time;
+	return true;
+}
+
+//	keep the GOP around the playhead in the cache. Frames are decoded from the keyframe
+//	before the playhead up to the next keyframe (or until the cache is full)
+bool TDecodeThread::DecodeScrubCache()
+{
+	if ( !mDecoder )
+		return false;
+
+	//	don't need to decode if we already have the frame
+	SoyTime Playhead = GetMinTimestamp();
+	if ( mFrameCache.IsCovered( Playhead ) )
+		return false;
+
+	Unity::TScopeTimerWarning Timer( __FUNCTION__, 10 );
+
+	//	frame buffer isn't used when scrubbing, so make the pool available to the cache
+	ReleaseFrames();
+	mFrameCache.ReleaseFrames();
+
+	if ( !SeekDecoder( Playhead ) )
+	{
+		Unity::DebugError("Failed to seek decoder for scrubbing");
+		return false;
+	}
+
+	SoyTime CoverEnd;
+	while ( isThreadRunning() && IsScrubbing() )
+	{
+		TFramePixels* Frame = nullptr;
+		if ( !mFrameCache.IsFull() )
+			Frame = mFramePool.Alloc( GetDecodedFrameMeta(), __FUNCTION__, &mFrameQuota );
+
+		//	cache is full, or we've used our share of the pool
+		if ( !Frame && mFrameCache.GetLastTimestamp().IsValid() )
+		{
+			//	we have frames either side of the playhead, so that's all we can cover
+			if ( mFrameCache.GetStepTime( Playhead, 1 ).IsValid() )
+			{
+				CoverEnd = SoyTime( mFrameCache.GetLastTimestamp().GetTime()+1 );
+				break;
+			}
+
+			//	haven't reached the playhead yet, slide along reusing the oldest frame
+			Frame = mFrameCache.PopOldestFrame();
+		}
+
+		//	pool is full, wait for some frames to be released
+		UpdatePoolWait( !Frame );
+		if ( !Frame )
+		{
+			ofThread::sleep(1);
+			continue;
+		}
+
+		bool TryAgain = true;
+		bool Decoded = false;
+		while ( TryAgain && !Decoded )
+		{
+			//	no min timestamp; we want every frame
+			Decoded = DecodeFrame( *Frame, SoyTime(), TryAgain );
+		}
+
+		//	end of the file, cover to just after the last frame (or the playhead if it's past the end)
+		if ( !Decoded )
+		{
+			mFramePool.Free( Frame );
+			CoverEnd = SoyTime( ofMax( mFrameCache.GetLastTimestamp().GetTime(), Playhead.GetTime() ) + 1 );
+			break;
+		}
+		OnFrameDecoded( *Frame );
+
+		//	reached the next GOP after the playhead (keep it if it's all we have)
+		bool AfterPlayhead = Frame->mTimestamp > Playhead;
+		if ( AfterPlayhead && Frame->mKeyframe && mFrameCache.GetLastTimestamp().IsValid() )
+		{
+			CoverEnd = Frame->mTimestamp;
+			mFramePool.Free( Frame );
+			break;
+		}
+
+		mFrameCache.PushFrame( Frame );
 	}
 
-	//	nothing to use
-	if ( PopFrameIndex == -1 )
-		return NULL;
+	//	covers from the playhead even if the first frame is after it, so we don't keep re-decoding
+	if ( CoverEnd.IsValid() )
+		mFrameCache.SetCover( Playhead, CoverEnd );
 
-	TFramePixels* PoppedFrame = mFrameBuffers.PopAt(0);
-	return PoppedFrame;
+	return true;
 }
 
-
-void TDecodeThread::threadedFunction()
+void TDecodeThread::UpdateDirection()
 {
-	assert( mState == TDecodeState::Constructed );
-	
-	//	init
-	TDecodeInitResult::Type InitResult = TDecodeInitResult::UnknownError;
-	if ( mDecoder )
+	bool Reverse = ( GetPlaybackRate() < 0.f );
+	if ( Reverse == mReverse )
+		return;
+
+	if ( !mDecoder )
+		return;
+
+	mReverse = Reverse;
+	ReleaseReverseChunk();
+
+	//	everything buffered is on the wrong side of the playhead now
+	ReleaseFrames();
+
+	SoyTime Playhead = GetMinTimestamp();
+	if ( mReverse )
 	{
-		InitResult = mDecoder->Init( mParams );
+		//	+1 so the chunk includes the frame at the playhead
+		mReverseChunkEnd = SoyTime( Playhead.GetTime() + 1 );
+	}
+	else
+	{
+		if ( !SeekDecoder( Playhead ) )
+			Unity::DebugError("Failed to seek decoder when resuming forward playback");
 	}
 
-	//	set state
-	switch ( InitResult )
+	BufferString<100> Debug;
+	Debug << "Decoder now playing " << (mReverse ? "backwards" : "forwards") << " from " << Playhead;
+	Unity::Debug( Debug );
+}
+
+void TDecodeThread::UpdateSkipMode()
+{
+	if ( !mDecoder )
+		return;
+
+	auto SkipMode = TDecodeSkip::GetSkipMode( GetPlaybackRate() );
+	if ( SkipMode != mSkipMode )
 	{
-	case TDecodeInitResult::Success:		mState = TDecodeState::Decoding;				break;
-	case TDecodeInitResult::FileNotFound:	mState = TDecodeState::FailedInit_FileNotFound;	break;
-	case TDecodeInitResult::CodecError:		mState = TDecodeState::FailedInit_CodecError;	break;
+		mSkipMode = SkipMode;
+		mDecoder->SetSkipMode( mSkipMode );
 
-	case TDecodeInitResult::UnknownError:
-	default:
-		mState = TDecodeState::FailedInit_Unknown;
-		break;
+		BufferString<100> Debug;
+		Debug << "Decoder skip mode " << TDecodeSkip::ToString( mSkipMode );
+		Unity::Debug( Debug );
 	}
 
+	//	skipping frames but still can't keep up; jump to the keyframe nearest the playhead rather
+	//	than decoding (even just keyframes) we'll throw away
+	if ( mSkipMode == TDecodeSkip::None || mReverse )
+		return;
 
-	while ( isThreadRunning() && mState == TDecodeState::Decoding )
+	SoyTime Playhead = GetMinTimestamp();
+	SoyTime LastDecoded = mDecoder->mLastDecodedTimestamp;
+	//	nothing decoded since the last seek yet
+	if ( !Playhead.IsValid() || !LastDecoded.IsValid() )
+		return;
+
+	//	a gop longer than DECODE_CATCHUP_SEEK_MS would have us seek back to the same keyframe forever
+	if ( mPendingSeekTime.IsValid() )
 	{
-        ofThread::sleep(1);
+		if ( LastDecoded < mPendingSeekTime )
+			return;
+		mPendingSeekTime = SoyTime();
+	}
 
-		//	if buffer is filled, stop (don't buffer too many frames)
-		bool DoDecode = !mFrameBuffer.IsFull();
+	if ( Playhead.GetTime() < LastDecoded.GetTime() + DECODE_CATCHUP_SEEK_MS )
+		return;
 
-		if ( !DoDecode )
-			continue;
-		
-		DecodeNextFrame();
-	}
+	BufferString<100> Debug;
+	Debug << "Decoder " << (Playhead.GetTime() - LastDecoded.GetTime()) << "ms behind, seeking to " << Playhead;
+	Unity::DebugDecodeLag( Debug );
+
+	ReleaseFrames();
+	if ( !SeekDecoder( Playhead ) )
+		Unity::DebugError("Failed to seek decoder to catch up");
 }
 
-void TFrameBuffer::PushFrame(TFramePixels* pFrame)
+bool TDecodeThread::IsBufferedAhead()
 {
-	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
-	ofMutex::ScopedLock lock( mFrameMutex );
+	float Rate = GetPlaybackRate();
+	if ( Rate >= 1.f )
+		return false;
 
-	//	sort by time, it's possible we get frames out of order due to encoding
-	auto SortedFrameBuffers = GetSortArray( mFrameBuffers, TSortPolicy_TFramePixelsByTimestamp() );
-	SortedFrameBuffers.Push( pFrame );
+	SoyTime Playhead = GetMinTimestamp();
+	SoyTime LastBuffered = mFrameBuffer.GetLastTimestamp();
+	if ( !Playhead.IsValid() || !LastBuffered.IsValid() )
+		return false;
+
+	//	keep the same amount of real-time buffered, which is less media time when we're slow
+	uint64 LookaheadMs = static_cast<uint64>( DECODE_LOOKAHEAD_MS * ofMax( 0.f, Rate ) );
+	return LastBuffered.GetTime() >= Playhead.GetTime() + LookaheadMs;
 }
 
-TFrameMeta TDecodeThread::GetDecodedFrameMeta()
+void TDecodeThread::ReleaseReverseChunk()
 {
-	ofMutex::ScopedLock lock( mDecodeFormat );
-	return mDecodeFormat;
+	for ( int i=mReverseChunk.GetSize()-1;	i>=0;	i-- )
+	{
+		auto* Frame = mReverseChunk.PopAt(i);
+		mFramePool.Free( Frame );
+	}
+
+	//	decoder's position is no use without the frames before it
+	mReverseChunkSeeked = false;
+	mReversePushedEnd = SoyTime();
 }
-	
-	
-void TDecodeThread::SetDecodedFrameMeta(TFrameMeta Format)
+
+//	we can only decode forward, so to play backwards we seek to the keyframe before the
+//	frames we need next, decode the gop forward into a chunk, then push that chunk into the
+//	frame buffer to be popped in reverse. The chunk before it is decoded while that one is
+//	shown, so each frame is decoded once and we hold two gops at most.
+//	If a gop doesn't fit in our share of the pool the chunk keeps its latest frames, and the
+//	next chunk decodes the rest again from the same keyframe.
+//	Returns false when it's waiting; it carries on from where it was on the next call.
+bool TDecodeThread::DecodeNextChunkReverse()
 {
-	ofMutex::ScopedLock lock( mDecodeFormat );
+	if ( !mDecoder )
+		return false;
 
-	//	no change
-	if ( mDecodeFormat.Get() == Format )
-		return;
+	//	reached the start of the video
+	if ( !mReverseChunkEnd.IsValid() )
+		return false;
 
-	//	update
-	mDecodeFormat.Get() = Format;
+	if ( !mReverseChunkSeeked )
+	{
+		//	wait until the chunk before the last one pushed has been shown
+		SoyTime LastBuffered = mFrameBuffer.GetLastTimestamp();
+		if ( mReversePushedEnd.IsValid() && LastBuffered.IsValid() && !(LastBuffered < mReversePushedEnd) )
+			return false;
 
-#if defined(ENABLE_DECODER_LIBAV_INIT_SIZE_FRAME)
-	//	push a green "OK" frame
-	TFramePixels* Frame = mFramePool.Alloc( GetDecodedFrameMeta(), "Debug init" );
-	if ( Frame )
+		//	playhead has already gone past the start of this chunk (lagging, or jumped) so
+		//	don't decode frames that would be skipped
+		SoyTime Playhead = GetMinTimestamp();
+		if ( Playhead.IsValid() && Playhead.GetTime() + 1 < mReverseChunkEnd.GetTime() )
+			mReverseChunkEnd = SoyTime( Playhead.GetTime() + 1 );
+
+		SoyTime SeekTime( mReverseChunkEnd.GetTime() - 1 );
+		if ( !mDecoder->Seek( SeekTime ) )
+		{
+			Unity::DebugError("Failed to seek decoder for reverse playback");
+			mReverseChunkEnd = SoyTime();
+			return false;
+		}
+		mReverseChunkSeeked = true;
+	}
+
+	Unity::TScopeTimerWarning Timer( __FUNCTION__, 10 );
+
+	//	decode forward until we reach the frames we've already got
+	while ( isThreadRunning() )
 	{
-		Unity::DebugLog( BufferString<100>()<<"Pushing Debug Frame; " << __FUNCTION__ );
-		Frame->SetColour( ENABLE_DECODER_LIBAV_INIT_SIZE_FRAME );
-		mFrameBuffer.PushFrame( Frame );	
+		//	direction has changed, abort
+		if ( GetPlaybackRate() >= 0.f )
+		{
+			ReleaseReverseChunk();
+			return false;
+		}
+
+		TFramePixels* Frame = mFramePool.Alloc( GetDecodedFrameMeta(), __FUNCTION__, &mFrameQuota, CanMapFrames() );
+		if ( !Frame && !mReverseChunk.IsEmpty() )
+		{
+			//	frames will be released as the chunk in the buffer is shown
+			if ( mFrameBuffer.GetSize() > 0 )
+				return false;
+
+			//	gop doesn't fit in our share of the pool; reuse the oldest frame. We only keep the frames nearest the end
+			Frame = mReverseChunk.PopAt(0);
+		}
+
+		//	pool is full, wait for some frames to be released
+		UpdatePoolWait( !Frame );
+		if ( !Frame )
+			return false;
+
+		bool TryAgain = true;
+		bool Decoded = false;
+		while ( TryAgain && !Decoded )
+		{
+			//	no min timestamp; we want every frame
+			Decoded = DecodeFrame( *Frame, SoyTime(), TryAgain );
+		}
+
+		//	end of file, or reached the frames we've already decoded
+		if ( !Decoded || !(Frame->mTimestamp < mReverseChunkEnd) )
+		{
+			mFramePool.Free( Frame );
+			break;
+		}
+		OnFrameDecoded( *Frame );
+
+		auto SortedChunk = GetSortArray( mReverseChunk, TSortPolicy_TFramePixelsByTimestamp() );
+		SortedChunk.Push( Frame );
 	}
-	else
+
+	//	decoder needs seeking again for the next chunk
+	mReverseChunkSeeked = false;
+
+	//	nothing before the end; we've reached the start of the video
+	if ( mReverseChunk.IsEmpty() )
 	{
-		BufferString<100> Debug;
-		Debug << "failed to alloc debug Init frame";
-		Unity::DebugLog( Debug );
+		mReverseChunkEnd = SoyTime();
+		return false;
 	}
-#endif
 
-}
+	//	next chunk ends where this one starts
+	mReversePushedEnd = mReverseChunkEnd;
+	mReverseChunkEnd = mReverseChunk[0]->mTimestamp;
 
-SoyTime TDecodeThread::GetMinTimestamp()
-{
-	ofMutex::ScopedLock Lock( mMinTimestamp );
-	return mMinTimestamp;
-}
+	for ( int i=0;	i<mReverseChunk.GetSize();	i++ )
+		PushFrame( mReverseChunk[i] );
+	mReverseChunk.Clear();
 
-void TDecodeThread::SetMinTimestamp(SoyTime Timestamp)
-{
-	ofMutex::ScopedLock Lock( mMinTimestamp );
-	mMinTimestamp.Get() = Timestamp;
+	return true;
 }
 
 void TDecodeThread::PushInitFrame()
@@ -468,14 +1775,14 @@ void TDecodeThread::PushInitFrame()
 
 	//	alloc a frame
 	//	dont know decoder dimensions yet, so use video meta
-	TFramePixels* Frame = mFramePool.Alloc( mParams.mTargetTextureMeta, __FUNCTION__ );
+	TFramePixels* Frame = mFramePool.Alloc( mParams.mTargetTextureMeta, __FUNCTION__, &mFrameQuota );
 
 	//	out of memory/pool, or non-valid format (ie. dont know output dimensions yet)
 	if ( !Frame )
 		return;
 
 	Frame->SetColour( ENABLE_DECODER_INIT_FRAME );
-	mFrameBuffer.PushFrame( Frame );
+	PushFrame( Frame );
 #endif
 }
 
@@ -486,8 +1793,9 @@ bool TDecodeThread::DecodeNextFrame()
 
 	Unity::TScopeTimerWarning Timer( "thread DecodeNextFrame", 1 );
 
-	//	alloc a frame
-	TFramePixels* Frame = mFramePool.Alloc( GetDecodedFrameMeta(), __FUNCTION__ );
+	//	alloc a frame. It only goes to the device, so decode straight into upload memory if we can (unless we need to read it back)
+	TFramePixels* Frame = mFramePool.Alloc( GetDecodedFrameMeta(), __FUNCTION__, &mFrameQuota, CanMapFrames() );
+	UpdatePoolWait( !Frame );
 
 	//	out of memory/pool, or non-valid format (ie. dont know output dimensions yet)
 	if ( !Frame )
@@ -499,7 +1807,7 @@ bool TDecodeThread::DecodeNextFrame()
 		SoyTime MinTimestamp = GetMinTimestamp();
 
 		//	success!
-		if ( mDecoder->DecodeNextFrame( *Frame, MinTimestamp, TryAgain ) )
+		if ( DecodeFrame( *Frame, MinTimestamp, TryAgain ) )
 			break;
 		
 		//	failed, and failed hard
@@ -516,17 +1824,48 @@ bool TDecodeThread::DecodeNextFrame()
 	Debug << Frame->mTimestamp << " decoded -> framebuffer";
 	Unity::DebugLog( Debug );
 	*/
-	mFrameBuffer.PushFrame( Frame );
+	OnFrameDecoded( *Frame );
+	PushFrame( Frame );
 
 	return true;
 }
 
+void TDecodeThread::UpdatePoolWait(bool Waiting)
+{
+	if ( Waiting )
+	{
+		if ( mPoolWaitStartUs == 0 )
+			mPoolWaitStartUs = TPipelineTimer::GetTimeUs();
+		return;
+	}
+
+	//	got a frame, time from the first failed alloc
+	mCounters.mPoolWait.AddSince( mPoolWaitStartUs );
+	mPoolWaitStartUs = 0;
+}
+
+bool TDecodeThread::DecodeFrame(TFramePixels& Frame,SoyTime MinTimestamp,bool& TryAgain)
+{
+	bool Decoded = mDecoder->DecodeNextFrame( Frame, MinTimestamp, TryAgain );
+
+	//	try-again means the decoder had a frame but threw it away
+	if ( Decoded || TryAgain )
+		mCounters.mFramesDecoded++;
+	if ( !Decoded && TryAgain )
+		mCounters.mFramesDropped++;
+	if ( Decoded )
+		Frame.mDecodedUs = TPipelineTimer::GetTimeUs();
+
+	return Decoded;
+}
+
 
 #if defined(ENABLE_DECODER_LIBAV)
 TDecoder_Libav::TDecoder_Libav() :
-	mScaleContext	( nullptr ),
-	mVideoStream	( nullptr ),
-	mDataOffset		( 0 )
+	mScaleContext		( nullptr ),
+	mVideoStream		( nullptr ),
+	mDataOffset			( 0 ),
+	mResyncTimestamp	( false )
 {
 	//	initialise dxvacontext
 #if defined(ENABLE_DVXA)
@@ -604,11 +1943,21 @@ bool TDecoder_Libav::DecodeNextFrame(TFrameMeta& FrameMeta,TPacket& CurrentPacke
 			while ( true )
 			{
 				//	if we failed to read next packet, we're out of frames
+				TPipelineTimer ReadCounter( mCounters ? &mCounters->mRead : nullptr );
 				if ( !CurrentPacket.reset( mContext.get() ) )
 					return false;
+				ReadCounter.Stop();
+				if ( mCounters )
+					mCounters->mBytesRead += CurrentPacket.packet.size;
 				
-				if ( CurrentPacket.packet.stream_index == mVideoStream->index )
-					break;
+				if ( CurrentPacket.packet.stream_index != mVideoStream->index )
+					continue;
+
+				//	don't even send non-keyframes to the codec
+				if ( mSkipMode == TDecodeSkip::KeyframesOnly && !(CurrentPacket.packet.flags & AV_PKT_FLAG_KEY) )
+					continue;
+
+				break;
 			}
 		}
 
@@ -616,7 +1965,9 @@ bool TDecoder_Libav::DecodeNextFrame(TFrameMeta& FrameMeta,TPacket& CurrentPacke
 	
 		// sending data to libavcodec
 		DecodeTimer.Start();
+		TPipelineTimer DecodeCounter( mCounters ? &mCounters->mDecode : nullptr );
 		const auto processedLength = avcodec_decode_video2( mCodec.get(), Frame.get(), &isFrameAvailable, &packetToSend );
+		DecodeCounter.Stop();
 		DecodeTimer.Stop();
 		if (processedLength < 0) 
 		{
@@ -687,16 +2038,30 @@ bool TDecoder_Libav::DecodeNextFrame(TFramePixels& OutputFrame,SoyTime MinTimest
 	else
 	{
 		uint64 Step = static_cast<uint64>( 1.f / FrameRate );
+
+		//	after a seek (or when skipping) we don't know how many frames we've skipped, so continue from the frame's pts
+		if ( mResyncTimestamp || mSkipMode != TDecodeSkip::None )
+		{
+			SoyTime PresentationTime = GetPresentationTime( av_frame_get_best_effort_timestamp( mFrame.get() ) );
+			uint64 PresentationMs = PresentationTime.GetTime();
+			mFakeRunningTimestamp = SoyTime( PresentationMs > Step ? PresentationMs - Step : 0 );
+			mResyncTimestamp = false;
+		}
+
 		mFakeRunningTimestamp += Step;
 		OutputFrame.mTimestamp = SoyTime( mFakeRunningTimestamp );
 	}
+	OutputFrame.mKeyframe = ( mFrame->key_frame != 0 );
 	
 	//	checking for out-of-order frames
 	if ( OutputFrame.mTimestamp < mLastDecodedTimestamp )
 	{
-		BufferString<100> Debug;
-		Debug << (DECODER_SKIP_OOO_FRAMES?"Skipped":"Decoded") << " out-of-order frames " << mLastDecodedTimestamp << " ... " << OutputFrame.mTimestamp;
-		Unity::Debug(Debug);
+		if ( Unity::IsLogEnabled( TLogLevel::Full ) )
+		{
+			BufferString<100> Debug;
+			Debug << (DECODER_SKIP_OOO_FRAMES?"Skipped":"Decoded") << " out-of-order frames " << mLastDecodedTimestamp << " ... " << OutputFrame.mTimestamp;
+			Unity::Debug(Debug);
+		}
 
 		if ( DECODER_SKIP_OOO_FRAMES )
 		{
@@ -710,9 +2075,12 @@ bool TDecoder_Libav::DecodeNextFrame(TFramePixels& OutputFrame,SoyTime MinTimest
 	//	too far behind, skip it
 	if ( OutputFrame.mTimestamp < MinTimestamp && MinTimestamp.IsValid() && !STORE_PAST_FRAMES )
 	{
-		BufferString<100> Debug;
-		Debug << "Decoded frame " << OutputFrame.mTimestamp << " too far behind " << MinTimestamp << " [skipped]";
-		Unity::DebugDecodeLag(Debug);
+		if ( Unity::IsLogEnabled( TLogLevel::Lag ) )
+		{
+			BufferString<100> Debug;
+			Debug << "Decoded frame " << OutputFrame.mTimestamp << " too far behind " << MinTimestamp << " [skipped]";
+			Unity::DebugDecodeLag(Debug);
+		}
 		TryAgain = true;
 		return false;
 	}
@@ -721,6 +2089,8 @@ bool TDecoder_Libav::DecodeNextFrame(TFramePixels& OutputFrame,SoyTime MinTimest
 	AVPicture pict;
 	memset(&pict, 0, sizeof(pict));
 	avpicture_fill(&pict, OutputFrame.GetData(), GetFormat( OutputFrame.mMeta ), OutputFrame.GetWidth(), OutputFrame.GetHeight() );
+	//	our rows are padded (and aligned, so swscale can use its SIMD paths)
+	pict.linesize[0] = OutputFrame.GetPitch();
 
 
 	Unity::TScopeTimerWarning sws_getContext_Timer( "DecodeFrame - sws_getContext", 1 );
@@ -738,13 +2108,236 @@ bool TDecoder_Libav::DecodeNextFrame(TFramePixels& OutputFrame,SoyTime MinTimest
 	}
 
 	Unity::TScopeTimerWarning sws_scale_Timer( "DecodeFrame - sws_scale", 1 );
+	TPipelineTimer ConvertCounter( mCounters ? &mCounters->mConvert : nullptr );
 	sws_scale( ScaleContext, mFrame->data, mFrame->linesize, 0, mFrame->height, pict.data, pict.linesize);
+	ConvertCounter.Stop();
 	sws_scale_Timer.Stop();
+	if ( mCounters )
+		mCounters->mFramesConverted++;
 	
 	return true;
 }
 #endif
 
+#if defined(ENABLE_DECODER_LIBAV)
+SoyTime TDecoder_Libav::GetPresentationTime(int64_t Pts)
+{
+	if ( Pts == AV_NOPTS_VALUE || !mVideoStream )
+		return SoyTime();
+
+	if ( mVideoStream->start_time != AV_NOPTS_VALUE )
+		Pts -= mVideoStream->start_time;
+
+	double TimeBase = av_q2d( mVideoStream->time_base );
+	double TimeMs = static_cast<double>( Pts > 0 ? Pts : 0 ) * TimeBase * 1000.0;
+	return SoyTime( static_cast<uint64>(TimeMs) );
+}
+#endif
+
+#if defined(ENABLE_DECODER_LIBAV)
+bool TDecoder_Libav::Seek(SoyTime Timestamp)
+{
+	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
+
+	//	not setup right??
+	if ( !mVideoStream )
+		return false;
+
+	double TimeBase = av_q2d( mVideoStream->time_base );
+	double TimeSecs = static_cast<double>( Timestamp.GetTime() ) / 1000.0;
+	int64_t SeekPts = static_cast<int64_t>( TimeSecs / TimeBase );
+	if ( mVideoStream->start_time != AV_NOPTS_VALUE )
+		SeekPts += mVideoStream->start_time;
+
+	//	backward flag lands us on the keyframe at or before the time
+	auto err = av_seek_frame( mContext.get(), mVideoStream->index, SeekPts, AVSEEK_FLAG_BACKWARD );
+	if ( err < 0 )
+	{
+		BufferString<1000> Debug;
+		Debug << "Failed to seek to " << Timestamp << "; " << GetAVError( err );
+		Unity::DebugError(Debug);
+		return false;
+	}
+
+	//	drop anything the codec or we have buffered from before the seek
+	avcodec_flush_buffers( mCodec.get() );
+	mCurrentPacket.clear();
+	mDataOffset = 0;
+	mLastDecodedTimestamp = SoyTime();
+	mResyncTimestamp = true;
+
+	return true;
+}
+#endif
+
+#if defined(ENABLE_DECODER_LIBAV)
+//	mpeg4 with our gop and b-frames, timestamps in frames. Container comes from the extension
+bool TTestFrameGenerator::Encode(const std::wstring& Filename) const
+{
+	Unity::TScopeTimerWarning Timer( __FUNCTION__, 1000 );
+
+	auto Meta = GetFrameMeta();
+	if ( !Meta.IsValid() || mParams.mFrameCount <= 0 )
+	{
+		Unity::DebugError("Test clip needs a valid size and frame count");
+		return false;
+	}
+
+	TDecoder_Libav::InitLibav();
+	std::string Filenamea( Filename.begin(), Filename.end() );
+
+	AVFormatContext* Format = nullptr;
+	avformat_alloc_output_context2( &Format, nullptr, nullptr, Filenamea.c_str() );
+	auto* Codec = avcodec_find_encoder( AV_CODEC_ID_MPEG4 );
+	if ( !Format || !Codec )
+	{
+		BufferString<1000> Debug;
+		Debug << "Failed to find container/encoder for " << Filenamea;
+		Unity::DebugError(Debug);
+		if ( Format )
+			avformat_free_context( Format );
+		return false;
+	}
+
+	//	time base is whole frames; a fractional mFramesPerSecond won't match the test decoder's timestamps
+	int FrameRate = ofMax( 1, static_cast<int>( mParams.mFramesPerSecond + 0.5f ) );
+
+	auto* Stream = avformat_new_stream( Format, Codec );
+	auto* Context = Stream->codec;
+	Context->codec_id = AV_CODEC_ID_MPEG4;
+	Context->width = Meta.mWidth;
+	Context->height = Meta.mHeight;
+	Context->time_base.num = 1;
+	Context->time_base.den = FrameRate;
+	Stream->time_base = Context->time_base;
+	Context->gop_size = ofMax( 1, mParams.mKeyframeInterval );
+	Context->max_b_frames = ofMax( 0, mParams.mBFrames );
+	Context->pix_fmt = AV_PIX_FMT_YUV420P;
+	Context->flags |= CODEC_FLAG_QSCALE;
+	Context->global_quality = FF_QP2LAMBDA * 2;
+	if ( Format->oformat->flags & AVFMT_GLOBALHEADER )
+		Context->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+	bool Success = false;
+	AVFrame* Frame = avcodec_alloc_frame();
+	AVPicture Picture;
+	memset( &Picture, 0, sizeof(Picture) );
+	TFramePixels Source( TFrameMeta( Meta.mWidth, Meta.mHeight, TFrameFormat::RGBA ), __FUNCTION__ );
+	SwsContext* ScaleContext = sws_getContext( Meta.mWidth, Meta.mHeight, AV_PIX_FMT_RGBA, Meta.mWidth, Meta.mHeight, AV_PIX_FMT_YUV420P, SWS_POINT, nullptr, nullptr, nullptr );
+
+	int err = avcodec_open2( Context, Codec, nullptr );
+	if ( err < 0 )
+		Unity::DebugError( GetAVError(err) );
+	else if ( !(Format->oformat->flags & AVFMT_NOFILE) && (err = avio_open( &Format->pb, Filenamea.c_str(), AVIO_FLAG_WRITE )) < 0 )
+		Unity::DebugError( GetAVError(err) );
+	else if ( (err = avformat_write_header( Format, nullptr )) < 0 )
+		Unity::DebugError( GetAVError(err) );
+	else if ( ScaleContext && Frame && avpicture_alloc( &Picture, AV_PIX_FMT_YUV420P, Meta.mWidth, Meta.mHeight ) == 0 )
+	{
+		for ( int i=0;	i<4;	i++ )
+		{
+			Frame->data[i] = Picture.data[i];
+			Frame->linesize[i] = Picture.linesize[i];
+		}
+		Frame->width = Meta.mWidth;
+		Frame->height = Meta.mHeight;
+		Frame->format = AV_PIX_FMT_YUV420P;
+
+		//	null frame flushes the b-frames the encoder is holding
+		Success = true;
+		for ( int FrameIndex=0;	Success && FrameIndex<=mParams.mFrameCount;	FrameIndex++ )
+		{
+			bool Flush = ( FrameIndex == mParams.mFrameCount );
+			if ( !Flush )
+			{
+				Draw( Source.GetData(), Source.GetPitch(), Source.mMeta, FrameIndex );
+				const uint8* SourceData[1] = { Source.GetData() };
+				int SourcePitch[1] = { Source.GetPitch() };
+				sws_scale( ScaleContext, SourceData, SourcePitch, 0, Meta.mHeight, Frame->data, Frame->linesize );
+				Frame->pts = FrameIndex;
+				Frame->pict_type = IsKeyframe( FrameIndex ) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+			}
+
+			int GotPacket = true;
+			while ( Success && GotPacket )
+			{
+				AVPacket Packet;
+				av_init_packet( &Packet );
+				Packet.data = nullptr;
+				Packet.size = 0;
+				GotPacket = false;
+				err = avcodec_encode_video2( Context, &Packet, Flush ? nullptr : Frame, &GotPacket );
+				if ( err < 0 )
+				{
+					Unity::DebugError( GetAVError(err) );
+					Success = false;
+					break;
+				}
+				if ( !GotPacket )
+					break;
+
+				if ( Packet.pts != AV_NOPTS_VALUE )
+					Packet.pts = av_rescale_q( Packet.pts, Context->time_base, Stream->time_base );
+				if ( Packet.dts != AV_NOPTS_VALUE )
+					Packet.dts = av_rescale_q( Packet.dts, Context->time_base, Stream->time_base );
+				Packet.stream_index = Stream->index;
+				Success = ( av_interleaved_write_frame( Format, &Packet ) == 0 );
+
+				//	only keep draining when flushing
+				GotPacket &= Flush;
+			}
+		}
+
+		if ( Success )
+			Success = ( av_write_trailer( Format ) == 0 );
+		avpicture_free( &Picture );
+	}
+
+	if ( ScaleContext )
+		sws_freeContext( ScaleContext );
+	if ( Frame )
+		av_free( Frame );
+	avcodec_close( Context );
+	if ( Format->pb && !(Format->oformat->flags & AVFMT_NOFILE) )
+		avio_close( Format->pb );
+	avformat_free_context( Format );
+
+	BufferString<1000> Debug;
+	Debug << (Success ? "Encoded " : "Failed to encode ") << mParams.mFrameCount << " test frames to " << Filenamea;
+	Success ? Unity::Debug(Debug) : Unity::DebugError(Debug);
+	return Success;
+}
+#endif
+
+#if defined(ENABLE_DECODER_LIBAV)
+void TDecoder_Libav::InitLibav()
+{
+	av_register_all();
+	av_lockmgr_register( &TDecoder_Libav::LockManagerCallback );
+	av_log_set_callback( &TDecoder_Libav::LogCallback );
+	avformat_network_init();
+}
+#endif
+
+#if defined(ENABLE_DECODER_LIBAV)
+void TDecoder_Libav::SetSkipMode(TDecodeSkip::Type Skip)
+{
+	TDecoder::SetSkipMode( Skip );
+
+	if ( !mCodec )
+		return;
+
+	//	let the codec discard frames as early as it can, rather than decoding then throwing them away
+	switch ( Skip )
+	{
+	case TDecodeSkip::NonReference:		mCodec->skip_frame = AVDISCARD_NONREF;	break;
+	case TDecodeSkip::KeyframesOnly:	mCodec->skip_frame = AVDISCARD_NONKEY;	break;
+	case TDecodeSkip::None:
+	default:							mCodec->skip_frame = AVDISCARD_DEFAULT;	break;
+	}
+}
+#endif
+
 #if defined(ENABLE_DECODER_LIBAV)
 void TDecoder_Libav::LogCallback(void *ptr, int level, const char *fmt, va_list vargs)
 {
@@ -839,11 +2432,7 @@ TDecodeInitResult::Type TDecoder_Libav::Init(const TDecodeParams& Params)
 		return TDecodeInitResult::FileNotFound;
 	}
 
-	//	init lib av
-	av_register_all();
-	av_lockmgr_register( &TDecoder_Libav::LockManagerCallback );
-	av_log_set_callback( &TDecoder_Libav::LogCallback );
-	avformat_network_init();
+	InitLibav();
 
 	mContext = std::shared_ptr<AVFormatContext>(avformat_alloc_context(), &avformat_free_context);
 	auto avFormatPtr = mContext.get();
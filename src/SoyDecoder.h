@@ -1,6 +1,7 @@
 #pragma once
 #include "FastVideo.h"
 #include <SoyThread.h>
+#include <chrono>
 
 
 #define ENABLE_DECODER_TEST
@@ -82,6 +83,7 @@ public:
 	}
 
 	bool reset(AVFormatContext* ctxt);
+	void clear();
 
 	AVPacket	packet;
 };
@@ -96,23 +98,223 @@ public:
 };
 
 
+#define LATENCY_HISTOGRAM_SUB_BITS	5				//	32 linear buckets per power of two, so values are within ~3%
+#define LATENCY_HISTOGRAM_MAX_US	0xffffffffull	//	longer samples are counted in the last bucket
+
+
+//	HDR style log-linear histogram of microseconds. Exact below 64us, then every power of two
+//	is split into the same number of linear buckets. Lock-free, any thread can add to it
+class TLatencyHistogram
+{
+public:
+	static const int		SUB_BUCKETS = 1 << LATENCY_HISTOGRAM_SUB_BITS;
+	static const int		BUCKET_COUNT = (2 * SUB_BUCKETS) + (32 - LATENCY_HISTOGRAM_SUB_BITS - 1) * SUB_BUCKETS;
+
+public:
+	TLatencyHistogram()		{	Reset();	}
+
+	void					Reset();
+	void					Add(uint64 Us)		{	mBuckets[ GetBucket(Us) ].fetch_add( 1, std::memory_order_relaxed );	}
+	uint64					GetCounts(uint32* Counts) const;	//	copy BUCKET_COUNT counts, returns the total
+
+	static int				GetBucket(uint64 Us);
+	static uint64			GetBucketMaxUs(int Bucket);
+	static uint64			GetPercentileUs(const uint32* Counts,uint64 Total,float Percent);
+
+private:
+	std::atomic<uint32>		mBuckets[BUCKET_COUNT];
+};
+
+
+//	timings of one stage of the pipeline. An instance's stages also add to the global stage
+class TPipelineStageCounter
+{
+public:
+	TPipelineStageCounter() :
+		mGlobal		( nullptr )
+	{
+		Reset();
+	}
+
+	void				Reset();
+	void				Add(uint64 Us);
+	void				AddSince(uint64 StartUs);	//	TPipelineTimer::GetTimeUs(). 0 (not stamped) is ignored
+	float				GetAverageMs() const	{	uint64 Count = mCount;	return Count ? (mTotalUs / 1000.f) / Count : 0.f;	}
+	float				GetMaxMs() const		{	return mMaxUs / 1000.f;	}
+	void				GetPercentiles(TLatencyPercentiles& Percentiles) const;
+
+public:
+	TPipelineStageCounter*	mGlobal;
+	std::atomic<uint64>	mCount;
+	std::atomic<uint64>	mTotalUs;
+	std::atomic<uint64>	mMaxUs;
+	TLatencyHistogram	mHistogram;
+};
+
+//	lock-free counters for an instance's pipeline, bumped by whichever thread does the work.
+//	The global counters only collect stage timings
+class TPipelineCounters
+{
+public:
+	explicit TPipelineCounters(TPipelineCounters* Global);
+
+	void				Reset();		//	counts and timings; not the current state
+	void				ResetStages();	//	just the timings
+	TPipelineStageCounter*	GetStage(TPipelineStage::Type Stage);
+
+	static TPipelineCounters&	GetGlobal();
+
+public:
+	std::atomic<uint64>	mFramesDecoded;		//	out of the codec, including dropped
+	std::atomic<uint64>	mFramesConverted;	//	converted to the output format
+	std::atomic<uint64>	mFramesUploaded;	//	copied to the target texture
+	std::atomic<uint64>	mFramesSkipped;		//	buffered, but the playhead passed them before they were shown
+	std::atomic<uint64>	mFramesDropped;		//	decoded then thrown away (behind the playhead, out of order)
+	std::atomic<uint64>	mBytesRead;			//	packets read from the file
+	std::atomic<int>	mBufferedFrames;	//	frame buffer depth
+	std::atomic<uint64>	mShownFrameMs;		//	timestamp of the frame in the target texture
+	TPipelineStageCounter	mRead;
+	TPipelineStageCounter	mDecode;
+	TPipelineStageCounter	mConvert;
+	TPipelineStageCounter	mPoolWait;
+	TPipelineStageCounter	mResidency;
+	TPipelineStageCounter	mStagingCopy;
+	TPipelineStageCounter	mUpload;		//	render thread copies that changed the texture
+	TPipelineStageCounter	mEndToEnd;
+};
+
+//	adds the scope's duration to a stage. null stage does nothing
+class TPipelineTimer
+{
+public:
+	explicit TPipelineTimer(TPipelineStageCounter* Stage) :
+		mStage		( Stage ),
+		mStartUs	( Stage ? GetTimeUs() : 0 )
+	{
+	}
+	~TPipelineTimer()		{	Stop();	}
+
+	void				Cancel()	{	mStage = nullptr;	}
+	void				Stop()
+	{
+		if ( !mStage )
+			return;
+		mStage->AddSince( mStartUs );
+		mStage = nullptr;
+	}
+
+	//	steady clock; never 0, so 0 can mean not-stamped
+	static uint64		GetTimeUs()
+	{
+		auto Now = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() );
+		return static_cast<uint64>( Now.count() ) + 1;
+	}
+
+private:
+	TPipelineStageCounter*	mStage;
+	uint64					mStartUs;
+};
+
+
+//	the playhead as a base time, the wall clock at that point, and a rate. Anyone can work out the time
+//	now without a lock (the upload, render and decode threads all do, every frame).
+//	Seeking, rate changes and pausing rebase it; they're rare, and serialised by a lock readers never take.
+//	A sequence number that's odd mid-change makes readers retry instead of mixing old and new values
+class TPlaybackClock
+{
+public:
+	TPlaybackClock();
+
+	SoyTime				GetTime() const;		//	never before 0
+	float				GetRate() const			{	return mRate.load( std::memory_order_relaxed );	}	//	negative plays backwards. Kept while stopped
+	bool				IsRunning() const		{	return mRunning.load( std::memory_order_relaxed );	}
+	void				SetTime(SoyTime Time);
+	void				SetRate(float Rate);		//	time up to now stays at the old rate
+	void				SetRunning(bool Running);	//	stopped when paused, scrubbing, or waiting for the first frame
+	void				CopyFrom(const TPlaybackClock& That);	//	followers keep in step with their source
+
+private:
+	class TState
+	{
+	public:
+		int64			mBaseUs;		//	media time
+		uint64			mBaseWallUs;	//	TPipelineTimer::GetTimeUs() at mBaseUs
+		float			mRate;
+		bool			mRunning;
+	};
+
+	TState				GetState() const;
+	void				SetState(const TState& State);	//	caller locks mWriteLock
+	static int64		GetTimeUs(const TState& State,uint64 WallUs);
+
+private:
+	ofMutex				mWriteLock;
+	std::atomic<uint32>	mSequence;
+	std::atomic<int64>	mBaseUs;
+	std::atomic<uint64>	mBaseWallUs;
+	std::atomic<float>	mRate;
+	std::atomic<bool>	mRunning;
+};
+
+
 class TFrameBuffer
 {
 public:
-	TFrameBuffer(int MaxFrameBufferSize,TFramePool& FramePool);
+	TFrameBuffer(int MaxFrameBufferSize,TFramePool& FramePool,TPipelineCounters* Counters=nullptr);
 	~TFrameBuffer();
 
 	bool						IsFull();
-	TFramePixels*				PopFrame(SoyTime Frame);
+	int							GetSize();
+	SoyTime						GetLastTimestamp();
+	TFramePixels*				PopFrame(SoyTime Frame,bool Reverse=false);
 	bool						HasVideoToPop();
 	void						PushFrame(TFramePixels* pFrame);
 	void						ReleaseFrames();
 
+private:
+	TFramePixels*				PopFrameReverse(SoyTime Frame);
+	void						UpdateDepthCounter();	//	caller must lock mFrameMutex
+
 public:
 	int							mMaxFrameBufferSize;
 	TFramePool&					mFramePool;
+	TPipelineCounters*			mCounters;		//	skipped frames
 	ofMutex						mFrameMutex;
 	Array<TFramePixels*>		mFrameBuffers;	//	frame's we've read and ready to be popped
+	SoyTime						mReverseShown;	//	last frame popped in reverse; it's shown until the time goes before it
+};
+
+
+//	decoded frames around the playhead that stay until released, so stepping
+//	back and forth while scrubbing doesn't have to decode from the keyframe again
+class TFrameCache
+{
+public:
+	TFrameCache(int MaxSize,TFramePool& FramePool);
+	~TFrameCache();
+
+	bool						IsFull();
+	bool						IsCovered(SoyTime Timestamp);
+	SoyTime						GetLastTimestamp();
+	TFrameRef					GetFrame(SoyTime Timestamp);	//	frame to show at this time. It stays in the cache too
+	SoyTime						GetStepTime(SoyTime Timestamp,int Steps);	//	time of the frame N steps away, invalid if not in the cache
+	int							GetFrameInterval();
+	void						PushFrame(TFramePixels* pFrame);
+	TFramePixels*				PopOldestFrame();	//	null if someone else is still using it
+	void						SetCover(SoyTime Start,SoyTime End);
+	void						ReleaseFrames();
+
+private:
+	int							GetFrameIndex(SoyTime Timestamp);
+
+public:
+	int							mMaxSize;
+	TFramePool&					mFramePool;
+	ofMutex						mFrameMutex;
+	Array<TFramePixels*>		mFrames;		//	sorted
+	bool						mCoverValid;
+	SoyTime						mCoverStart;	//	time the cache was filled for, may be before the first frame
+	SoyTime						mCoverEnd;		//	first time after the cached frames we know there's no other frame (next keyframe, end of file)
 };
 
 
@@ -154,9 +356,28 @@ namespace TDecodeInitResult
 	FastVideoError	GetFastVideoError(Type Result);
 };
 
+//	frames the decoder doesn't bother decoding when playing faster than real time
+namespace TDecodeSkip
+{
+	enum Type
+	{
+		None = 0,
+		NonReference,		//	nothing depends on these frames so they're free to drop
+		KeyframesOnly,
+	};
+
+	Type			GetSkipMode(float PlaybackRate);
+	const char*		ToString(Type Skip);
+};
+
 class TDecoder
 {
 public:
+	TDecoder() :
+		mSkipMode	( TDecodeSkip::None ),
+		mCounters	( nullptr )
+	{
+	}
 	virtual ~TDecoder()	{}
 
 	virtual TDecodeInitResult::Type	Init(const TDecodeParams& Params)=0;
@@ -164,8 +385,12 @@ public:
 	TFrameMeta						GetFrameMeta()		{	return GetVideoMeta().mFrameMeta;	}
 	virtual bool					PeekNextFrame(TFrameMeta& FrameMeta)=0;
 	virtual bool					DecodeNextFrame(TFramePixels& OutFrame,SoyTime MinTimestamp,bool& TryAgain)=0;
+	virtual bool					Seek(SoyTime Timestamp)		{	return false;	}	//	move to the keyframe at or before this time
+	virtual void					SetSkipMode(TDecodeSkip::Type Skip)	{	mSkipMode = Skip;	}
 
 public:
+	TDecodeSkip::Type	mSkipMode;
+	TPipelineCounters*	mCounters;		//	decode/convert timings, if anyone's counting
 	TVideoMeta			mVideoMeta;
 	SoyTime				mLastDecodedTimestamp;
 #if defined(USE_REAL_TIMESTAMP)
@@ -184,9 +409,14 @@ public:
 	virtual TDecodeInitResult::Type	Init(const TDecodeParams& Params);
 	bool							PeekNextFrame(TFrameMeta& FrameMeta);
 	bool							DecodeNextFrame(TFramePixels& OutFrame,SoyTime MinTimestamp,bool& TryAgain);
+	virtual bool					Seek(SoyTime Timestamp);
+	virtual void					SetSkipMode(TDecodeSkip::Type Skip);
+
+	static void						InitLibav();	//	register codecs and our callbacks; safe to call more than once
 	
 private:
 	bool			DecodeNextFrame(TFrameMeta& FrameMeta,TPacket& Packet,std::shared_ptr<AVFrame>& Frame,int& DataOffset);
+	SoyTime			GetPresentationTime(int64_t Pts);
 	static void		LogCallback(void *ptr, int level, const char *fmt, va_list vargs);
 	static int		LockManagerCallback(void** ppMutex,enum AVLockOp op);
 
@@ -203,6 +433,7 @@ public:
 	std::shared_ptr<AVFrame>			mFrame;			//	currently decoding to this frame
 	AVStream*							mVideoStream;	//	gr: change to index!
 	int									mDataOffset;
+	bool								mResyncTimestamp;	//	after a seek, running timestamp is reset from the frame's pts
 	SwsContext*							mScaleContext;
 #if defined(ENABLE_DVXA)
 	dxva_context						mDxvaContext;
@@ -234,6 +465,37 @@ public:
 
 
 
+//	deterministic frames and gop structure; the same params always give the same video.
+//	Frame indexes are in presentation order
+class TTestFrameGenerator
+{
+public:
+	explicit TTestFrameGenerator(const TTestDecoderParams& Params);
+
+	static TTestDecoderParams	GetDefaultParams();
+
+	TFrameMeta					GetFrameMeta() const;
+	bool						IsEnd(int FrameIndex) const;
+	SoyTime						GetTimestamp(int FrameIndex) const;
+	int							GetFrameIndex(SoyTime Timestamp) const;		//	frame showing at this time
+	bool						IsKeyframe(int FrameIndex) const;
+	bool						IsReference(int FrameIndex) const;			//	b-frames aren't
+	int							GetKeyframe(int FrameIndex) const;			//	keyframe at or before
+	int							GetDecodeOrderFrame(int DecodeIndex) const;	//	frame at this position in the stream
+	void						ApplyCost(Array<uint8>& DecodeBuffer,int FrameIndex) const;	//	emulate the work of decoding this frame
+	void						Draw(uint8* Pixels,int Pitch,const TFrameMeta& Meta,int FrameIndex) const;
+#if defined(ENABLE_DECODER_LIBAV)
+	bool						Encode(const std::wstring& Filename) const;
+#endif
+
+private:
+	int							GetGopEnd(int GopStart) const;
+
+public:
+	TTestDecoderParams			mParams;
+};
+
+
 #if defined(ENABLE_DECODER_TEST)
 class TDecoder_Test : public TDecoder
 {
@@ -243,10 +505,15 @@ public:
 	virtual TDecodeInitResult::Type	Init(const TDecodeParams& Params);
 	virtual bool					PeekNextFrame(TFrameMeta& FrameMeta);
 	virtual bool					DecodeNextFrame(TFramePixels& OutFrame,SoyTime MinTimestamp,bool& TryAgain);
+	virtual bool					Seek(SoyTime Timestamp);
 	
+private:
+	bool							IsSkipped(int FrameIndex) const;
+
 public:
-	BufferArray<TColour,10>	mColours;
-	int						mCurrentColour;
+	TTestFrameGenerator		mGenerator;
+	int						mDecodeIndex;	//	position in the stream (decode order)
+	Array<uint8>			mDecodeBuffer;	//	emulated decode writes here before "converting" into the output frame
 };
 #endif
 
@@ -257,22 +524,45 @@ public:
 	static const int		INVALID_FRAME = -1;
 
 public:
-	TDecodeThread(TDecodeParams& Params,TFrameBuffer& FrameBuffer,TFramePool& FramePool);
+	TDecodeThread(TDecodeParams& Params,TFrameBuffer& FrameBuffer,TFrameCache& FrameCache,TFramePool& FramePool,TFrameQuota& FrameQuota,TPipelineCounters& Counters,const TPlaybackClock& Clock);
 	~TDecodeThread();
 
 	TDecodeInitResult::Type		Init();					//	make decoder and start thread
 	TFrameMeta					GetVideoFrameMeta()		{	return mDecoder ? mDecoder->GetFrameMeta() : TFrameMeta();	}
 	TFrameMeta					GetDecodedFrameMeta();
 	void						SetDecodedFrameMeta(TFrameMeta Format);
-	SoyTime						GetMinTimestamp();
-	void						SetMinTimestamp(SoyTime Timestamp);
+	SoyTime						GetMinTimestamp()		{	return mClock.GetTime();	}	//	skip decoding frames before this time (playhead when in reverse)
+	float						GetPlaybackRate()		{	return mClock.GetRate();	}
+	bool						IsScrubbing();
+	void						SetScrubbing(bool Scrubbing);
+	bool						IsTileHashing();
+	void						SetTileHashing(bool TileHashing);
+	void						SetReadableFrames(bool Readable);	//	frames are read on the cpu, so can't be decoded into write-only upload memory
+	void						RequestSeek(SoyTime Timestamp);
+	void						AddSharedFrameBuffer(TFrameBuffer& FrameBuffer);		//	also push decoded frames to another instance's buffer
+	void						RemoveSharedFrameBuffer(TFrameBuffer& FrameBuffer);
+	void						ClearSharedFrameBuffers();
 	bool						HasFinishedDecoding() const;
 	bool						HasFailedInitialisation() const;
 
 protected:
 	virtual void				threadedFunction();
 	bool						DecodeNextFrame();
+	bool						DecodeFrame(TFramePixels& Frame,SoyTime MinTimestamp,bool& TryAgain);	//	decoder's next frame, counted
+	void						UpdatePoolWait(bool Waiting);	//	after every alloc, to time how long we waited for the pool
 	void						PushInitFrame();
+	void						UpdateDirection();
+	void						UpdateSeek();
+	bool						SeekDecoder(SoyTime Time);
+	void						UpdateSkipMode();
+	bool						DecodeScrubCache();
+	bool						IsBufferedAhead();
+	bool						DecodeNextChunkReverse();
+	void						ReleaseReverseChunk();
+	void						PushFrame(TFramePixels* pFrame);
+	void						ReleaseFrames();
+	void						OnFrameDecoded(TFramePixels& Frame);
+	bool						CanMapFrames();
 
 public:
 	TDecodeParams				mParams;
@@ -281,10 +571,31 @@ public:
 protected:
 	ofMutexT<TFrameMeta>		mDecodeFormat;
 	TFramePool&					mFramePool;
+	TFrameQuota&				mFrameQuota;	//	instance's share of the pool
 	ofPtr<TDecoder>				mDecoder;
 	TFrameBuffer&				mFrameBuffer;
-
-	ofMutexT<SoyTime>			mMinTimestamp;	//	skip decoding frames before this time
+	TFrameCache&				mFrameCache;
+	TPipelineCounters&			mCounters;
+	ofMutexT<Array<TFrameBuffer*>>	mSharedFrameBuffers;	//	instances sharing this decoder get the same frames (refcounted)
+
+	const TPlaybackClock&		mClock;			//	instance's playhead
+
+	ofMutex						mPlaybackRateLock;	//	locks playback controls below
+	bool						mScrubbing;			//	decode into the frame cache instead of the frame buffer
+	bool						mTileHashing;		//	hash decoded frames so only changed tiles are uploaded
+	bool						mReadableFrames;	//	frames are copied on the cpu (eg. into an atlas)
+	bool						mSeekRequested;
+	SoyTime						mSeekTime;			//	jump here on the decode thread
+
+	//	only accessed on the decode thread
+	TDecodeSkip::Type			mSkipMode;
+	bool						mReverse;
+	SoyTime						mReverseChunkEnd;	//	next chunk decodes frames before this. Invalid when we've reached the start
+	bool						mReverseChunkSeeked;	//	decoder is part way through the chunk, so carry on rather than seeking
+	SoyTime						mReversePushedEnd;	//	end of the last chunk pushed. The next isn't started until everything after this has been shown
+	SoyTime						mPendingSeekTime;	//	last seek, until we've decoded up to it. Invalid when there isn't one
+	Array<TFramePixels*>		mReverseChunk;		//	frames decoded forward from a keyframe, waiting to be pushed
+	uint64						mPoolWaitStartUs;	//	first alloc that failed, 0 when we're not waiting
 };
 
 
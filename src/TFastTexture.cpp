@@ -17,13 +17,26 @@ const char* TFastVideoState::ToString(TFastVideoState::Type State)
 
 
 TFastTexture::TFastTexture(SoyRef Ref,TFramePool& FramePool) :
-	mRef					( Ref ),
-	mFrameBuffer			( DEFAULT_MAX_FRAME_BUFFERS, FramePool ),
+	SoyThread				( "TFastTexture" ),
 	mFramePool				( FramePool ),
 	mState					( TFastVideoState::FirstFrame ),
 	mLooping				( true ),
-	SoyThread				( "TFastTexture" ),
-	mDecoderThread			( nullptr )
+	mScrubbing				( false ),
+	mUploadSlotCount		( DEFAULT_UPLOAD_SLOTS ),
+	mPendingUploadSlotCount	( 0 ),
+	mDirtyRegionUploads		( false ),
+	mUploadPriority			( 0 ),
+	mUploadScore			( 0 ),
+	mCounters				( &TPipelineCounters::GetGlobal() ),
+	mFrameBuffer			( DEFAULT_MAX_FRAME_BUFFERS, FramePool, &mCounters ),
+	mFrameCache				( DEFAULT_MAX_FRAME_CACHE, FramePool ),
+	mFrameQuota				( BufferString<100>() << Ref ),
+	mRef					( Ref ),
+	mHandle					( 0 ),
+	mTargetTextureDecodedUs	( 0 ),
+	mDecoderThread			( nullptr ),
+	mSharedSource			( nullptr ),
+	mAtlas					( nullptr )
 {
 	if ( !mDecoderThread.tryLock() )
 	{
@@ -33,6 +46,7 @@ TFastTexture::TFastTexture(SoyRef Ref,TFramePool& FramePool) :
 	{
 		mDecoderThread.unlock();
 	}
+	mFramePool.AddQuota( mFrameQuota );
 	startThread( true, true );
 }
 
@@ -41,6 +55,11 @@ TFastTexture::~TFastTexture()
 	//	wait for self thread to finish
 	waitForThread();
 
+	//	unlink from any instances we're sharing a decoder with
+	SetSharedSource( nullptr );
+	DetachSharedFollowers();
+	SetAtlas( nullptr, TFrameRect() );
+
 	//	wait for render to finish
 	ofMutex::ScopedLock Lock( mRenderLock );
 
@@ -48,6 +67,8 @@ TFastTexture::~TFastTexture()
 	DeleteUploadThread();
 	DeleteDecoderThread();
 	WaitForAllDeadDecoderThreads();
+
+	mFramePool.RemoveQuota( mFrameQuota );
 }
 
 TUnityDevice& TFastTexture::GetDevice()
@@ -78,6 +99,369 @@ void TFastTexture::SetLooping(bool EnableLooping)
 	mLooping = EnableLooping;
 }
 
+void TFastTexture::SetPlaybackRate(float Rate)
+{
+	//	source instance sets our time
+	if ( mSharedSource )
+	{
+		BufferString<100> Debug;
+		Debug << GetRef() << " playback rate comes from the decoder we're sharing";
+		Unity::Debug( Debug );
+		return;
+	}
+
+	//	decoder reads the clock, and followers need to know which way to pop frames
+	mClock.SetRate( Rate );
+	UpdateSharedFollowers();
+
+	BufferString<100> Debug;
+	Debug << GetRef() << " playback rate " << Rate;
+	Unity::Debug( Debug );
+}
+
+void TFastTexture::SetUploadSlotCount(int Count)
+{
+	//	the render thread could be copying out of the ring, so it rebuilds it in OnPostRender
+	Count = ofMax( 1, ofMin( MAX_UPLOAD_SLOTS, Count ) );
+	mPendingUploadSlotCount = Count;
+}
+
+void TFastTexture::UpdateUploadSlotCount()
+{
+	int Count = mPendingUploadSlotCount.exchange( 0 );
+	if ( Count <= 0 || mUploadSlotCount == Count )
+		return;
+	mUploadSlotCount = Count;
+
+	//	rebuild the ring, keeping the decoder's output format
+	if ( mUploadThread )
+	{
+		DeleteUploadThread();
+		CreateUploadThread(true);
+		if ( mDecoderThread.Get() && mTargetTexture )
+			mDecoderThread.Get()->SetDecodedFrameMeta( GetDevice().GetTextureMeta( mTargetTexture ) );
+	}
+
+	BufferString<100> Debug;
+	Debug << GetRef() << " upload slots " << Count;
+	Unity::Debug( Debug );
+}
+
+void TFastTexture::SetDirtyRegionUploads(bool Enable)
+{
+	mDirtyRegionUploads = Enable;
+	{
+		ofMutex::ScopedLock Lock( mDecoderThread );
+		if ( mDecoderThread.Get() )
+			mDecoderThread.Get()->SetTileHashing( mDirtyRegionUploads );
+	}
+
+	BufferString<100> Debug;
+	Debug << GetRef() << " dirty region uploads " << (mDirtyRegionUploads ? "on" : "off");
+	Unity::Debug( Debug );
+}
+
+TFrameMeta TFastTexture::GetTargetMeta()
+{
+	if ( mAtlas )
+		return mAtlas->GetMemberMeta( mAtlasRect );
+
+	return GetDevice().GetTextureMeta( mTargetTexture );
+}
+
+bool TFastTexture::SetAtlas(TFastTextureAtlas* Atlas,const TFrameRect& Rect)
+{
+	if ( !Atlas && !mAtlas )
+		return true;
+
+	auto* SharedSource = mSharedSource.load();
+	if ( Atlas && SharedSource )
+	{
+		//	frames are decoded to fit the source so our region has to match it
+		if ( Atlas->GetMemberMeta( Rect ) != SharedSource->GetTargetMeta() )
+		{
+			BufferString<100> Debug;
+			Debug << GetRef() << " cannot join atlas, region differs from the decoder we're sharing";
+			Unity::DebugError( Debug );
+			return false;
+		}
+	}
+
+	//	leave the old atlas
+	if ( mAtlas )
+	{
+		mAtlas->RemoveMember( *this );
+		mAtlas = nullptr;
+		mAtlasRect = TFrameRect();
+	}
+
+	if ( Atlas )
+	{
+		if ( !Atlas->AddMember( *this, Rect ) )
+			return false;
+
+		//	our own texture isn't used any more
+		DeleteTargetTexture();
+		DeleteUploadThread();
+		mTargetTexture = Unity::TTexture();
+
+		mAtlas = Atlas;
+		mAtlasRect = Rect;
+	}
+
+	//	output format has changed, buffered frames are the wrong size
+	DetachSharedFollowers();
+	mFrameBuffer.ReleaseFrames();
+	mFrameCache.ReleaseFrames();
+	if ( mDecoderThread.Get() )
+	{
+		mDecoderThread.Get()->SetReadableFrames( mAtlas != nullptr );
+		mDecoderThread.Get()->SetDecodedFrameMeta( GetTargetMeta() );
+	}
+
+	BufferString<100> Debug;
+	Debug << GetRef() << (mAtlas ? " drawing to atlas " : " not in an atlas");
+	if ( mAtlas )
+		Debug << mAtlasRect.mX << "," << mAtlasRect.mY << " " << mAtlasRect.mWidth << "x" << mAtlasRect.mHeight;
+	Unity::Debug( Debug );
+	return true;
+}
+
+bool TFastTexture::PopAtlasFrame(TFrameRef& Frame,SoyTime LastFrame)
+{
+	SoyTime FrameTime = GetFrameTime();
+
+	//	frame stays in the cache
+	if ( mScrubbing )
+	{
+		Frame = mFrameCache.GetFrame( FrameTime );
+		if ( !Frame.IsValid() )
+			return false;
+
+		//	already written this frame
+		if ( Frame->mTimestamp.GetTime() == LastFrame.GetTime() )
+		{
+			Frame.Release();
+			return false;
+		}
+		return true;
+	}
+
+	TFramePixels* pFrame = mFrameBuffer.PopFrame( FrameTime, IsReverse() );
+	if ( !pFrame )
+		return false;
+
+	//	decoded into upload memory before we joined the atlas (or by a decoder we're sharing); can't be read back
+	if ( pFrame->IsMapped() )
+	{
+		mFramePool.Free( pFrame );
+		return false;
+	}
+
+	Frame = TFrameRef( pFrame, mFramePool );
+	mFramePool.Free( pFrame );
+	return true;
+}
+
+void TFastTexture::OnAtlasFrameCopied(SoyTime Frame,uint64 DecodedUs)
+{
+	mTargetTextureFrame = Frame;
+	mCounters.mFramesUploaded++;
+	mCounters.mShownFrameMs = Frame.GetTime();
+	mCounters.mEndToEnd.AddSince( DecodedUs );
+	OnTargetTextureChanged();
+}
+
+void TFastTexture::SetScrubbing(bool EnableScrubbing)
+{
+	//	source instance sets our time, and we have no cache to scrub
+	if ( mSharedSource )
+	{
+		BufferString<100> Debug;
+		Debug << GetRef() << " scrubbing comes from the decoder we're sharing";
+		Unity::Debug( Debug );
+		return;
+	}
+
+	if ( mScrubbing == EnableScrubbing )
+		return;
+
+	mScrubbing = EnableScrubbing;
+	UpdateClockRunning();
+
+	if ( mDecoderThread.Get() )
+	{
+		mDecoderThread.Get()->SetScrubbing( mScrubbing );
+		//	continue playing from wherever we scrubbed to
+		if ( !mScrubbing )
+			mDecoderThread.Get()->RequestSeek( GetFrameTime() );
+	}
+
+	//	give the frames back to the pool for normal playback
+	if ( !mScrubbing )
+		mFrameCache.ReleaseFrames();
+
+	BufferString<100> Debug;
+	Debug << GetRef() << " scrubbing " << (mScrubbing ? "on" : "off");
+	Unity::Debug( Debug );
+}
+
+void TFastTexture::StepFrame(int Steps)
+{
+	//	source instance sets our time
+	if ( mSharedSource )
+	{
+		BufferString<100> Debug;
+		Debug << GetRef() << " stepping comes from the decoder we're sharing";
+		Unity::Debug( Debug );
+		return;
+	}
+
+	//	stepping is only done when scrubbing
+	SetScrubbing( true );
+
+	//	use the cached frames if we have them, otherwise guess and the decoder will fill the cache there
+	SoyTime Now = GetFrameTime();
+	SoyTime StepTime = mFrameCache.GetStepTime( Now, Steps );
+	if ( !StepTime.IsValid() )
+	{
+		int64 Time = static_cast<int64>( Now.GetTime() ) + static_cast<int64>( Steps ) * mFrameCache.GetFrameInterval();
+		StepTime = SoyTime( static_cast<uint64>( Time > 0 ? Time : 0 ) );
+	}
+
+	SetFrameTime( StepTime );
+}
+
+void TFastTexture::Seek(SoyTime Time)
+{
+	SetFrameTime( Time );
+
+	//	playing normally the buffered frames are no use now
+	if ( mDecoderThread.Get() )
+	{
+		mDecoderThread.Get()->RequestSeek( Time );
+	}
+}
+
+bool TFastTexture::SetSharedSource(TFastTexture* Source)
+{
+	//	stop following the old source
+	if ( auto* OldSource = mSharedSource.load() )
+	{
+		OldSource->RemoveSharedFollower( *this );
+		mSharedSource = nullptr;
+
+		BufferString<100> Debug;
+		Debug << GetRef() << " no longer sharing decoder";
+		Unity::Debug( Debug );
+
+		//	carry on from the source's time, by our own state
+		UpdateClockRunning();
+	}
+
+	if ( !Source )
+		return true;
+
+	//	followers don't have a decoder, share the one they're following
+	if ( auto* SourceSource = Source->mSharedSource.load() )
+		Source = SourceSource;
+
+	if ( Source == this )
+	{
+		Unity::DebugError("Instance cannot share its own decoder");
+		return false;
+	}
+
+	//	frames are decoded to fit the source's texture (or atlas region) so we have to match it
+	TFrameMeta SourceMeta = Source->GetTargetMeta();
+	TFrameMeta TargetMeta = GetTargetMeta();
+	if ( !TargetMeta.IsValid() || SourceMeta != TargetMeta )
+	{
+		BufferString<100> Debug;
+		Debug << "Cannot share decoder of " << Source->GetRef() << ", texture format differs";
+		Unity::DebugError( Debug );
+		return false;
+	}
+
+	//	anything following us follows nothing now, and we don't need our own decoder
+	DetachSharedFollowers();
+	DeleteDecoderThread();
+	mFrameBuffer.ReleaseFrames();
+	mFrameCache.ReleaseFrames();
+	mScrubbing = false;
+
+	mSharedSource = Source;
+	Source->AddSharedFollower( *this );
+
+	BufferString<100> Debug;
+	Debug << GetRef() << " sharing decoder of " << Source->GetRef();
+	Unity::Debug( Debug );
+	return true;
+}
+
+void TFastTexture::AddSharedFollower(TFastTexture& Follower)
+{
+	ofMutex::ScopedLock LockDecoder( mDecoderThread );
+	ofMutex::ScopedLock Lock( mSharedFollowers );
+	mSharedFollowers.PushBackUnique( &Follower );
+
+	Follower.mClock.CopyFrom( mClock );
+
+	if ( mDecoderThread.Get() )
+		mDecoderThread.Get()->AddSharedFrameBuffer( Follower.mFrameBuffer );
+}
+
+void TFastTexture::RemoveSharedFollower(TFastTexture& Follower)
+{
+	ofMutex::ScopedLock LockDecoder( mDecoderThread );
+	ofMutex::ScopedLock Lock( mSharedFollowers );
+	int Index = mSharedFollowers.FindIndex( &Follower );
+	if ( Index >= 0 )
+		mSharedFollowers.RemoveBlock( Index, 1 );
+
+	if ( mDecoderThread.Get() )
+		mDecoderThread.Get()->RemoveSharedFrameBuffer( Follower.mFrameBuffer );
+
+	//	give back the frames we shared with it
+	Follower.mFrameBuffer.ReleaseFrames();
+}
+
+void TFastTexture::DetachSharedFollowers()
+{
+	ofMutex::ScopedLock LockDecoder( mDecoderThread );
+	ofMutex::ScopedLock Lock( mSharedFollowers );
+	for ( int i=0;	i<mSharedFollowers.GetSize();	i++ )
+	{
+		auto& Follower = *mSharedFollowers[i];
+		if ( mDecoderThread.Get() )
+			mDecoderThread.Get()->RemoveSharedFrameBuffer( Follower.mFrameBuffer );
+		Follower.mFrameBuffer.ReleaseFrames();
+		Follower.mSharedSource = nullptr;
+		Follower.UpdateClockRunning();
+	}
+	mSharedFollowers.Clear();
+}
+
+//	followers' clocks work out the same time as ours, so they only need updating when ours is rebased
+void TFastTexture::UpdateSharedFollowers()
+{
+	ofMutex::ScopedLock Lock( mSharedFollowers );
+	for ( int i=0;	i<mSharedFollowers.GetSize();	i++ )
+		mSharedFollowers[i]->mClock.CopyFrom( mClock );
+}
+
+void TFastTexture::UpdateClockRunning()
+{
+	//	source instance sets our time
+	if ( mSharedSource )
+		return;
+
+	//	paused and scrubbing only move with SetFrameTime. Waiting for the first frame, we don't step until we've rendered it
+	bool Running = ( mState == TFastVideoState::Playing ) && !mScrubbing;
+	mClock.SetRunning( Running );
+	UpdateSharedFollowers();
+}
+
 void TFastTexture::SetState(TFastVideoState::Type State)
 {
 	mState = State;
@@ -86,6 +470,7 @@ void TFastTexture::SetState(TFastVideoState::Type State)
 	{
 		SetFrameTime( SoyTime() );
 	}
+	UpdateClockRunning();
 
 	BufferString<100> Debug;
 	Debug << GetRef() << " " << TFastVideoState::ToString(State);
@@ -105,6 +490,8 @@ void TFastTexture::DeleteDecoderThread()
 	auto& DecoderThread = mDecoderThread.Get();
 	if ( DecoderThread )
 	{
+		//	dead thread mustn't push any more frames to other instances
+		DecoderThread->ClearSharedFrameBuffers();
 		DecoderThread->stopThread();
 //#error violation reading location 0x00003FFF.
 		/*
@@ -226,7 +613,7 @@ bool TFastTexture::CreateUploadThread(bool IsRenderThread)
 	}
 #endif
 
-	mUploadThread = ofPtr<TFastTextureUploadThread>( new TFastTextureUploadThread( *this, Device ) );
+	mUploadThread = ofPtr<TFastTextureUploadThread>( new TFastTextureUploadThread( *this, Device, mUploadSlotCount ) );
 	//	something messed up at init
 	if ( !mUploadThread->IsValid() )
 	{
@@ -259,6 +646,9 @@ bool TFastTexture::SetTexture(Unity::TTexture TargetTexture)
 {
     auto& Device = GetDevice();
 
+	//	drawing to our own texture now
+	SetAtlas( nullptr, TFrameRect() );
+
 	//	release existing texture
 	DeleteTargetTexture();
 
@@ -280,6 +670,13 @@ bool TFastTexture::SetTexture(Unity::TTexture TargetTexture)
 	TFrameMeta FrameMeta = Device.GetTextureMeta( mTargetTexture );
 	mFramePool.PreAlloc( FrameMeta );
 
+	//	video may have been set before the texture was applied
+	{
+		ofMutex::ScopedLock Lock( mDecoderThread );
+		if ( mDecoderThread.Get() )
+			mDecoderThread.Get()->SetDecodedFrameMeta( GetTargetMeta() );
+	}
+
 	return true;
 }
 
@@ -287,6 +684,9 @@ bool TFastTexture::SetVideo(const std::wstring& Filename)
 {
     auto& Device = GetDevice();
 
+	//	decoding ourselves now
+	SetSharedSource( nullptr );
+
 	//	reset video state
 	SetState( TFastVideoState::FirstFrame );
 	SetFrameTime( SoyTime() );
@@ -296,10 +696,20 @@ bool TFastTexture::SetVideo(const std::wstring& Filename)
 	//	 alloc new decoder thread
 	TDecodeParams Params;
 	Params.mFilename = Filename;
-	Params.mTargetTextureMeta = Device.GetTextureMeta( mTargetTexture );
+	Params.mTargetTextureMeta = GetTargetMeta();
 	
 	ofMutex::ScopedLock lock(mDecoderThread);	//	unneccesary?
-	mDecoderThread.Get() = new TDecodeThread( Params, mFrameBuffer, mFramePool );
+	mDecoderThread.Get() = new TDecodeThread( Params, mFrameBuffer, mFrameCache, mFramePool, mFrameQuota, mCounters, mClock );
+	mDecoderThread.Get()->SetScrubbing( mScrubbing );
+	mDecoderThread.Get()->SetTileHashing( mDirtyRegionUploads );
+	mDecoderThread.Get()->SetReadableFrames( mAtlas != nullptr );
+
+	//	instances following us get frames from the new decoder too
+	{
+		ofMutex::ScopedLock Lock( mSharedFollowers );
+		for ( int i=0;	i<mSharedFollowers.GetSize();	i++ )
+			mDecoderThread.Get()->AddSharedFrameBuffer( mSharedFollowers[i]->mFrameBuffer );
+	}
 
 	//	do initial init, will verify filename, dimensions, etc
 	TDecodeInitResult::Type InitResult = mDecoderThread.Get()->Init();
@@ -314,9 +724,9 @@ bool TFastTexture::SetVideo(const std::wstring& Filename)
 
 	//	if we already have the output texture we should set the decode format
 	//	gr: was dynamic texture format
-	if ( mTargetTexture )
+	if ( mTargetTexture || mAtlas )
 	{
-		TFrameMeta TextureFormat = Device.GetTextureMeta( mTargetTexture );
+		TFrameMeta TextureFormat = GetTargetMeta();
 		mDecoderThread.Get()->SetDecodedFrameMeta( TextureFormat );
 	}
 
@@ -329,8 +739,8 @@ void TFastTexture::OnDecoderInitFailed(FastVideoError Error)
 	//	push a red "BAD" frame
     auto& Device = GetDevice();
 	//	gr: was dynamic texture format
-	TFrameMeta TextureFormat = Device.GetTextureMeta( mTargetTexture );
-	TFramePixels* Frame = mFramePool.Alloc( TextureFormat, "Debug failed init" );
+	TFrameMeta TextureFormat = GetTargetMeta();
+	TFramePixels* Frame = mFramePool.Alloc( TextureFormat, "Debug failed init", &mFrameQuota );
 	if ( Frame )
 	{
 		Unity::Debug(BufferString<100>() << "Pushing Debug ERROR Frame; " << __FUNCTION__);
@@ -359,21 +769,26 @@ bool TFastTexture::UpdateFrameTexture(Unity::TTexture Texture,SoyTime& FrameCopi
     auto& Device = GetDevice();
 	if ( !Device.IsValid() )
 		return false;
+
+	if ( mScrubbing )
+		return UpdateFrameTextureFromCache( Texture, FrameCopied );
     
 	//	pop latest frame (this takes ownership)
 	SoyTime FrameTime = GetFrameTime();
-	TFramePixels* pFrame = mFrameBuffer.PopFrame( FrameTime );
+	TFramePixels* pFrame = mFrameBuffer.PopFrame( FrameTime, IsReverse() );
 	if ( !pFrame )
 		return false;
 
-	//	copy to texture
-	if ( !Device.CopyTexture( Texture, *pFrame, false ) )
+	//	copy to texture. Frames in upload memory can only be read by the device
+	bool Copied = pFrame->IsMapped() ? Device.CopyTexture( Texture, Unity::TDynamicTexture( pFrame->mMappedBuffer ) ) : Device.CopyTexture( Texture, *pFrame, false );
+	if ( !Copied )
 	{
 		//	put frame back in queue
 		mFrameBuffer.PushFrame( pFrame );
 		return false;
 	}
 	FrameCopied = pFrame->mTimestamp;
+	mTargetTextureDecodedUs = pFrame->mDecodedUs;
 	pFrame->SetOwner( __FUNCTION__ );
 	
 	//	free frame
@@ -382,7 +797,7 @@ bool TFastTexture::UpdateFrameTexture(Unity::TTexture Texture,SoyTime& FrameCopi
 	return true;
 }
 
-bool TFastTexture::UpdateFrameTexture(Unity::TDynamicTexture Texture,SoyTime& FrameCopied)
+bool TFastTexture::UpdateFrameTexture(Unity::TDynamicTexture Texture,SoyTime& FrameCopied,uint64& FrameDecodedUs,TFrameRef& MappedFrame,Array<uint32>& TileHashes)
 {
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
 
@@ -392,21 +807,41 @@ bool TFastTexture::UpdateFrameTexture(Unity::TDynamicTexture Texture,SoyTime& Fr
     auto& Device = GetDevice();
 	if ( !Device.IsValid() )
 		return false;
+
+	//	cached frames could have been decoded long ago, they don't count towards end-to-end latency
+	FrameDecodedUs = 0;
+	if ( mScrubbing )
+		return UpdateFrameTextureFromCache( Texture, FrameCopied, TileHashes );
     
 	//	pop latest frame (this takes ownership)
 	SoyTime FrameTime = GetFrameTime();
-	TFramePixels* pFrame = mFrameBuffer.PopFrame( FrameTime );
+	TFramePixels* pFrame = mFrameBuffer.PopFrame( FrameTime, IsReverse() );
 	if ( !pFrame )
 		return false;
+	TileHashes = pFrame->mTileHashes;
+
+	//	decoded straight into an upload buffer, nothing to copy
+	if ( pFrame->IsMapped() )
+	{
+		MappedFrame = TFrameRef( pFrame, mFramePool );
+		FrameCopied = pFrame->mTimestamp;
+		FrameDecodedUs = pFrame->mDecodedUs;
+		mFramePool.Free( pFrame );
+		return true;
+	}
 
 	//	copy to texture
+	TPipelineTimer StagingCounter( &mCounters.mStagingCopy );
 	if ( !Device.CopyTexture( Texture, *pFrame, false ) )
 	{
+		StagingCounter.Cancel();
 		//	put frame back in queue
 		mFrameBuffer.PushFrame( pFrame );
 		return false;
 	}
+	StagingCounter.Stop();
 	FrameCopied = pFrame->mTimestamp;
+	FrameDecodedUs = pFrame->mDecodedUs;
 	pFrame->SetOwner( __FUNCTION__ );
 	
 	//	free frame
@@ -415,6 +850,55 @@ bool TFastTexture::UpdateFrameTexture(Unity::TDynamicTexture Texture,SoyTime& Fr
 	return true;
 }
 
+bool TFastTexture::UpdateFrameTextureFromCache(Unity::TTexture Texture,SoyTime& FrameCopied)
+{
+    auto& Device = GetDevice();
+
+	//	frame stays in the cache, our reference stops the decoder reusing it while we copy
+	SoyTime FrameTime = GetFrameTime();
+	TFrameRef Frame = mFrameCache.GetFrame( FrameTime );
+	if ( !Frame.IsValid() )
+		return false;
+
+	//	already showing this frame
+	if ( Frame->mTimestamp.GetTime() == FrameCopied.GetTime() )
+		return false;
+
+	if ( !Device.CopyTexture( Texture, *Frame, false ) )
+		return false;
+	FrameCopied = Frame->mTimestamp;
+	mTargetTextureDecodedUs = 0;
+
+	return true;
+}
+
+bool TFastTexture::UpdateFrameTextureFromCache(Unity::TDynamicTexture Texture,SoyTime& FrameCopied,Array<uint32>& TileHashes)
+{
+    auto& Device = GetDevice();
+
+	//	frame stays in the cache, our reference stops the decoder reusing it while we copy
+	SoyTime FrameTime = GetFrameTime();
+	TFrameRef Frame = mFrameCache.GetFrame( FrameTime );
+	if ( !Frame.IsValid() )
+		return false;
+
+	//	already showing this frame
+	if ( Frame->mTimestamp.GetTime() == FrameCopied.GetTime() )
+		return false;
+
+	TPipelineTimer StagingCounter( &mCounters.mStagingCopy );
+	if ( !Device.CopyTexture( Texture, *Frame, false ) )
+	{
+		StagingCounter.Cancel();
+		return false;
+	}
+	StagingCounter.Stop();
+	FrameCopied = Frame->mTimestamp;
+	TileHashes = Frame->mTileHashes;
+
+	return true;
+}
+
 void TFastTexture::Update()
 {
 	//mDecoderThread.lock();
@@ -471,6 +955,7 @@ bool TFastTexture::WaitForLastDeadDecoderThread()
 
 void TFastTexture::threadedFunction()
 {
+	Trace::TThread TraceThread("TFastTexture");
 	while ( isThreadRunning() )
 	{
 		int SleepMs = static_cast<int>( 1000.f/100.f );
@@ -483,8 +968,16 @@ void TFastTexture::OnPostRender()
 {
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,4);
 	//ofMutex::ScopedLock RenderLock(mRenderLock);
+	mLastPostRender = SoyTime(true);
+
+	UpdateUploadSlotCount();
+
+	//	the atlas uploads our frames with everyone else's
+	if ( mAtlas )
+		return;
 
 	bool TargetChanged = false;
+	TPipelineTimer UploadCounter( &mCounters.mUpload );
 
 	//	somtimes need to create upload thread in the render thread
 	if ( !mUploadThread )
@@ -498,7 +991,7 @@ void TFastTexture::OnPostRender()
 
 		//	get latest dynamic texture
 		Unity::TScopeTimerWarning Timerb( BufferString<100>()<<__FUNCTION__<<"mUploadThread->CopyToTarget",4);
-		TargetChanged = mUploadThread->CopyToTarget( mTargetTexture, mTargetTextureFrame );
+		TargetChanged = mUploadThread->CopyToTarget( mTargetTexture, mTargetTextureFrame, mTargetTextureDecodedUs );
 	}
 	else
 	{
@@ -507,15 +1000,25 @@ void TFastTexture::OnPostRender()
 		TargetChanged = UpdateFrameTexture( mTargetTexture, mTargetTextureFrame );
 	}
 
+	//	only time the copies that did something
+	if ( !TargetChanged )
+		UploadCounter.Cancel();
+	UploadCounter.Stop();
+
 	if ( TargetChanged )
+	{
+		mCounters.mFramesUploaded++;
+		mCounters.mShownFrameMs = mTargetTextureFrame.GetTime();
+		mCounters.mEndToEnd.AddSince( mTargetTextureDecodedUs );
 		OnTargetTextureChanged();
+	}
 
 	if ( TargetChanged )
 	{
 		auto Now = GetFrameTime();
 		auto Lag = Now.GetTime() - mTargetTextureFrame.GetTime();
 		static int MinLag = 1;
-		if ( Now.IsValid() && Lag >= MinLag )
+		if ( Now.IsValid() && Lag >= MinLag && Unity::IsLogEnabled( TLogLevel::Lag ) )
 		{
 			BufferString<100> Debug;
 			Debug << "Rendering " << Lag << "ms behind";
@@ -526,83 +1029,98 @@ void TFastTexture::OnPostRender()
 
 }
 
-SoyTime TFastTexture::GetFrameTime()
+void TFastTexture::GetStats(TInstanceStats& Stats)
 {
-	UpdateFrameTime();
-
-	ofMutex::ScopedLock lockb( mFrame );
-	return mFrame.Get();
+	Stats.mFramesDecoded = mCounters.mFramesDecoded;
+	Stats.mFramesConverted = mCounters.mFramesConverted;
+	Stats.mFramesUploaded = mCounters.mFramesUploaded;
+	Stats.mFramesSkipped = mCounters.mFramesSkipped;
+	Stats.mFramesDropped = mCounters.mFramesDropped;
+	Stats.mBytesRead = mCounters.mBytesRead;
+	Stats.mBufferedFrames = mCounters.mBufferedFrames;
+	Stats.mPoolFramesHeld = mFrameQuota.mUsed;
+	Stats.mDecodeAvgMs = mCounters.mDecode.GetAverageMs();
+	Stats.mDecodeMaxMs = mCounters.mDecode.GetMaxMs();
+	Stats.mConvertAvgMs = mCounters.mConvert.GetAverageMs();
+	Stats.mConvertMaxMs = mCounters.mConvert.GetMaxMs();
+	Stats.mUploadAvgMs = mCounters.mUpload.GetAverageMs();
+	Stats.mUploadMaxMs = mCounters.mUpload.GetMaxMs();
+
+	//	nothing shown yet, no lag
+	Stats.mLagMs = 0;
+	uint64 ShownMs = mCounters.mShownFrameMs;
+	SoyTime Playhead = GetFrameTime();
+	if ( ShownMs != 0 && Playhead.IsValid() )
+	{
+		int64 Lag = static_cast<int64>( Playhead.GetTime() ) - static_cast<int64>( ShownMs );
+		Stats.mLagMs = static_cast<int>( IsReverse() ? -Lag : Lag );
+	}
 }
 
-void TFastTexture::OnTargetTextureChanged()
+void TFastTexture::GetStatus(TInstanceStatus& Status)
 {
-	if ( mState == TFastVideoState::FirstFrame )
-	{
-		mState = TFastVideoState::Playing;
-		SetFrameTime( mTargetTextureFrame );
-	}
+	SoyTime Playhead = GetFrameTime();
+	Status.mTimeMs = Playhead.IsValid() ? Playhead.GetTime() : 0;
+	Status.mFrameMs = mCounters.mShownFrameMs;
+	Status.mValid = 1;
+	Status.mState = mState;
+	Status.mLooping = mLooping ? 1 : 0;
+	Status.mScrubbing = mScrubbing ? 1 : 0;
+	Status.mPlaybackRate = GetPlaybackRate();
+	Status.mUploadPriority = mUploadPriority;
 }
 
+int TFastTexture::GetUploadWaitMs(SoyTime Now) const
+{
+	//	never had a turn
+	if ( !mLastPostRender.IsValid() || Now < mLastPostRender )
+		return 0;
+	return static_cast<int>( Now.GetTime() - mLastPostRender.GetTime() );
+}
 
-void TFastTexture::UpdateFrameTime()
+void TFastTexture::UpdateUploadScore(SoyTime Now)
 {
-	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
-	ofMutex::ScopedLock locka( mLastUpdateTime );
-	//	get step
-	SoyTime Now(true);
-	auto Step = Now.GetTime() - mLastUpdateTime.Get().GetTime();
-	float Stepf = static_cast<float>( Step ) * REAL_TIME_MODIFIER;
-	Step = static_cast<uint64>( Stepf );
-	if ( Step <= 0 )
+	//	new instances go first, they're showing nothing yet
+	if ( !mLastPostRender.IsValid() )
+	{
+		mUploadScore = 0x7fffffffffffffffll;
 		return;
+	}
 
-	//	set the last-update-time regardless
-	mLastUpdateTime.Get() = Now;
-	
-	//	if we're paused, dont move frame time on
-	if ( mState == TFastVideoState::Paused )
-		return;
+	int64 WaitMs = GetUploadWaitMs( Now );
+	mUploadScore = (static_cast<int64>( mUploadPriority ) * UPLOAD_STALENESS_PRIORITY_MS) + WaitMs;
+}
 
-	//	if we're waiting for the first frame, we don't step until we've rendered it
-	if ( mState == TFastVideoState::FirstFrame )
-		return;
-	
-	ofMutex::ScopedLock lockb( mFrame );
-	mFrame.Get() = SoyTime( mFrame.GetTime() + Step );
+SoyTime TFastTexture::GetFrameTime()
+{
+	return mClock.GetTime();
+}
 
-	//ofMutex::ScopedLock lockdecoderthread( mDecoderThread );
-	if ( mDecoderThread.Get() )
+void TFastTexture::OnTargetTextureChanged()
+{
+	if ( mState == TFastVideoState::FirstFrame )
 	{
-		mDecoderThread.Get()->SetMinTimestamp( mFrame );
+		mState = TFastVideoState::Playing;
+		//	followers' time comes from the source
+		if ( !mSharedSource )
+			SetFrameTime( mTargetTextureFrame );
+		UpdateClockRunning();
 	}
-	/*
-	BufferString<100> Debug;
-	Debug << "Framestep: " << Step << "ms";
-	Unity::DebugLog( Debug );
-	*/
 }
 
 
 void TFastTexture::SetFrameTime(SoyTime Frame)
 {
-//	ofMutex::ScopedLock lockc( mDynamicTextureLock );	//	to avoid deadlock this has to be done first
-	ofMutex::ScopedLock locka( mLastUpdateTime );
-	ofMutex::ScopedLock lockb( mFrame );
-
-	mFrame.Get() = Frame;
-	mLastUpdateTime.Get() = SoyTime(true);
-
-	//ofMutex::ScopedLock lockc( mDecoderThread );
-	if ( mDecoderThread.Get() )
-	{
-		mDecoderThread.Get()->SetMinTimestamp( mFrame );
-	}
-
-//	mDynamicTextureFrame = Frame;	//	-1?
+	//	source instance sets our time
+	if ( mSharedSource )
+		return;
 
+	//	decoder reads the clock directly
+	mClock.SetTime( Frame );
+	UpdateSharedFollowers();
 
 	BufferString<100> Debug;
-	Debug << "Set frametime: " << mFrame.Get();
+	Debug << "Set frametime: " << Frame;
 	Unity::Debug( Debug );
 }
 
@@ -610,6 +1128,7 @@ void TFastTexture::SetFrameTime(SoyTime Frame)
 
 void TFastTextureUploadThread::threadedFunction()
 {
+	Trace::TThread TraceThread("TFastTextureUploadThread");
 	while ( isThreadRunning() )
 	{
 		sleep(1);
@@ -622,53 +1141,152 @@ void TFastTextureUploadThread::threadedFunction()
 
 void TFastTextureUploadThread::Update()
 {
+	int SlotIndex = -1;
 	{
-		ofMutexTimed::ScopedLock Lock( mDynamicTextureLock );
-		//	last one hasnt been used yet
-		if ( mDynamicTextureChanged )
-			return;
+		ofMutex::ScopedLock Lock( mSlotsLock );
+		SlotIndex = ClaimSlot();
 	}
+	//	every slot is waiting on the render thread or the device
+	if ( SlotIndex < 0 )
+		return;
 
 	//	copy latest
-	if ( mParent.UpdateFrameTexture( mDynamicTexture, mDynamicTextureFrame ) )
+	auto& Slot = mSlots[SlotIndex];
+	SoyTime FrameCopied = mLastFrame;
+	uint64 FrameDecodedUs = 0;
+	TFrameRef MappedFrame;
+	Array<uint32> TileHashes;
+	bool Changed = mParent.UpdateFrameTexture( Slot.mDynamicTexture, FrameCopied, FrameDecodedUs, MappedFrame, TileHashes );
+
+	ofMutex::ScopedLock Lock( mSlotsLock );
+	if ( !Changed )
+	{
+		Slot.mState = TUploadSlotState::Free;
+		return;
+	}
+
+	mLastFrame = FrameCopied;
+	Slot.mFrame = FrameCopied;
+	Slot.mDecodedUs = FrameDecodedUs;
+	Slot.mMappedFrame = MappedFrame;
+	Slot.mTileHashes = TileHashes;
+	Slot.mSequence = ++mLastSequence;
+	Slot.mState = TUploadSlotState::Ready;
+}
+
+int TFastTextureUploadThread::ClaimSlot()
+{
+	//	free slot the device isn't still reading from
+	int OldestReady = -1;
+	int ReadyCount = 0;
+	for ( int i=0;	i<mSlots.GetSize();	i++ )
 	{
-		//ofMutex::ScopedLock Lock( mDynamicTextureLock );
-		mDynamicTextureChanged = true;
+		auto& Slot = mSlots[i];
+		if ( Slot.mState == TUploadSlotState::Ready )
+		{
+			ReadyCount++;
+			if ( OldestReady < 0 || Slot.mSequence < mSlots[OldestReady].mSequence )
+				OldestReady = i;
+			continue;
+		}
+
+		if ( Slot.mState != TUploadSlotState::Free )
+			continue;
+		if ( !mDevice.IsCopyComplete( Slot.mDynamicTexture ) )
+			continue;
+
+		Slot.mState = TUploadSlotState::Writing;
+		return i;
 	}
+
+	//	render thread is behind; overwrite the oldest finished frame. It only wants the newest, so never take that
+	if ( ReadyCount < 2 )
+		return -1;
+
+	auto& Slot = mSlots[OldestReady];
+	if ( !mDevice.IsCopyComplete( Slot.mDynamicTexture ) )
+		return -1;
+
+	Slot.mMappedFrame.Release();
+	Slot.mState = TUploadSlotState::Writing;
+	return OldestReady;
 }
 
 
-bool TFastTextureUploadThread::CopyToTarget(Unity::TTexture TargetTexture,SoyTime& TargetTextureFrame)
+bool TFastTextureUploadThread::CopyToTarget(Unity::TTexture TargetTexture,SoyTime& TargetTextureFrame,uint64& TargetTextureDecodedUs)
 {
-	//	copy latest dynamic texture
-	ofMutexTimed::ScopedLockTimed Lock( mDynamicTextureLock, 2 );
-	if ( !Lock.IsLocked() )
+	//	take the newest finished slot, older ones are stale
+	int SlotIndex = -1;
 	{
-		Unity::Debug("mDynamicTextureLock failed to lock");
-		return false;
+		ofMutex::ScopedLock Lock( mSlotsLock );
+		for ( int i=0;	i<mSlots.GetSize();	i++ )
+		{
+			auto& Slot = mSlots[i];
+			if ( Slot.mState != TUploadSlotState::Ready )
+				continue;
+			if ( SlotIndex < 0 || Slot.mSequence > mSlots[SlotIndex].mSequence )
+				SlotIndex = i;
+		}
+
+		//	dont' have a new texture yet
+		if ( SlotIndex < 0 )
+			return false;
+
+		for ( int i=0;	i<mSlots.GetSize();	i++ )
+		{
+			auto& Slot = mSlots[i];
+			if ( i == SlotIndex || Slot.mState != TUploadSlotState::Ready )
+				continue;
+			Slot.mMappedFrame.Release();
+			Slot.mState = TUploadSlotState::Free;
+		}
+		mSlots[SlotIndex].mState = TUploadSlotState::Copying;
 	}
-		
-	//	dont' have a new texture yet
-	if ( !mDynamicTextureChanged )
-		return false;
 
-	//	copy latest
-	if ( !mDevice.CopyTexture( TargetTexture, mDynamicTexture ) )
+	//	copy latest, straight from the frame's upload buffer if it was decoded into one
+	auto& Slot = mSlots[SlotIndex];
+	auto SrcTexture = Slot.mMappedFrame.IsValid() ? Unity::TDynamicTexture( Slot.mMappedFrame->mMappedBuffer ) : Slot.mDynamicTexture;
+	bool Copied = false;
+	if ( Slot.mTileHashes.IsEmpty() )
+	{
+		Copied = mDevice.CopyTexture( TargetTexture, SrcTexture );
+	}
+	else
+	{
+		//	only the tiles that differ from what's already in the target
+		TFramePixels::GetChangedRects( mChangedRects, mTargetMeta, Slot.mTileHashes, mTargetTileHashes );
+		Copied = mChangedRects.IsEmpty() || mDevice.CopyTexture( TargetTexture, SrcTexture, mChangedRects );
+	}
+
+	ofMutex::ScopedLock Lock( mSlotsLock );
+	if ( !Copied )
+	{
+		//	try again next time, unless it's been replaced by then
+		Slot.mState = TUploadSlotState::Ready;
 		return false;
-	TargetTextureFrame = mDynamicTextureFrame;
+	}
+	TargetTextureFrame = Slot.mFrame;
+	TargetTextureDecodedUs = Slot.mDecodedUs;
+	mTargetTileHashes = Slot.mTileHashes;
 
 	//	latest has been used
-	mDynamicTextureChanged = false;
+	Slot.mMappedFrame.Release();
+	Slot.mState = TUploadSlotState::Free;
 
 	return true;
 }
 
-TFastTextureUploadThread::TFastTextureUploadThread(TFastTexture& Parent,TUnityDevice& Device) :
+TFastTextureUploadThread::TFastTextureUploadThread(TFastTexture& Parent,TUnityDevice& Device,int SlotCount) :
 	SoyThread				( "TFastTextureUploadThread" ),
 	mParent					( Parent ),
 	mDevice					( Device ),
-	mDynamicTextureChanged	( false )
+	mLastSequence			( 0 )
 {
+	SlotCount = ofMax( 1, ofMin( MAX_UPLOAD_SLOTS, SlotCount ) );
+	mSlots.Reserve( SlotCount );
+	for ( int i=0;	i<SlotCount;	i++ )
+		mSlots.PushBack();
+
 	if ( !CreateDynamicTexture() )
 	{
 		//	shouldn't create this thread if we can't satisfy the requirements 
@@ -701,23 +1319,28 @@ bool TFastTextureUploadThread::CreateDynamicTexture()
 
 	auto TargetTextureMeta = Device.GetTextureMeta( mTargetTexture );
 
-	//	if dimensions are different, delete old one
-	ofMutexTimed::ScopedLock lock( mDynamicTextureLock );
-	if ( mDynamicTexture )
+	ofMutex::ScopedLock lock( mSlotsLock );
+	mTargetMeta = TargetTextureMeta;
+	for ( int i=0;	i<mSlots.GetSize();	i++ )
 	{
-		auto CurrentTextureMeta = Device.GetTextureMeta( mDynamicTexture );
-		if ( !CurrentTextureMeta.IsEqualSize(TargetTextureMeta) )
+		auto& DynamicTexture = mSlots[i].mDynamicTexture;
+
+		//	if dimensions are different, delete old one
+		if ( DynamicTexture )
 		{
-			DeleteDynamicTexture();
+			auto CurrentTextureMeta = Device.GetTextureMeta( DynamicTexture );
+			if ( !CurrentTextureMeta.IsEqualSize(TargetTextureMeta) )
+			{
+				Device.DeleteTexture( DynamicTexture );
+			}
 		}
-	}
 
-	//	need to create a new one
-	bool HadTexure = (mDynamicTexture);
-	if ( !mDynamicTexture )
-	{
-		mDynamicTexture = Device.AllocDynamicTexture( TargetTextureMeta );
-		if ( !mDynamicTexture )
+		//	need to create a new one
+		if ( DynamicTexture )
+			continue;
+
+		DynamicTexture = Device.AllocDynamicTexture( TargetTextureMeta );
+		if ( !DynamicTexture )
 		{
 			BufferString<100> Debug;
 			Debug << "Failed to alloc dynamic texture; " << TargetTextureMeta.mWidth << "x" << TargetTextureMeta.mHeight << "x" << TargetTextureMeta.GetChannels();
@@ -733,41 +1356,285 @@ bool TFastTextureUploadThread::CreateDynamicTexture()
 		if ( Frame )
 		{
 			Frame->SetColour( ENABLE_DYNAMIC_INIT_TEXTURE_COLOUR );
-			Device.CopyTexture( mDynamicTexture, *Frame, true );
+			Device.CopyTexture( DynamicTexture, *Frame, true );
 			mParent.mFramePool.Free( Frame );
 		}
 #endif
 	}
 
-	/*
-	//	update decode-to-format
-	if ( mDecoderThread )
+	return true;
+}
+
+void TFastTextureUploadThread::DeleteDynamicTexture()
+{
+	ofMutex::ScopedLock lock( mSlotsLock );
+    auto& Device = GetDevice();
+	for ( int i=0;	i<mSlots.GetSize();	i++ )
 	{
-		TFrameMeta TextureFormat = Device.GetTextureMeta( mDynamicTexture );
-		mDecoderThread->SetDecodedFrameMeta( TextureFormat );
+		auto& Slot = mSlots[i];
+		Slot.mMappedFrame.Release();
+		Device.DeleteTexture( Slot.mDynamicTexture );
+		Slot.mState = TUploadSlotState::Free;
+	}
+}
 
-		if ( !HadTexure )
+bool TFastTextureUploadThread::IsValid()
+{
+	ofMutex::ScopedLock lock( mSlotsLock );
+	if ( mSlots.IsEmpty() )
+		return false;
+	for ( int i=0;	i<mSlots.GetSize();	i++ )
+	{
+		if ( !mSlots[i].mDynamicTexture.IsValid() )
+			return false;
+	}
+    return true;
+}
+
+
+
+TFastTextureAtlas::TFastTextureAtlas(Unity::TTexture TargetTexture,ofPtr<TUnityDevice> Device) :
+	SoyThread			( "TFastTextureAtlas" ),
+	mTargetTexture		( TargetTexture ),
+	mDevice				( Device ),
+	mStagingState		( TUploadSlotState::Free )
+{
+	CreateStagingTexture();
+	startThread( true, true );
+}
+
+TFastTextureAtlas::~TFastTextureAtlas()
+{
+	waitForThread();
+	DeleteStagingTexture();
+}
+
+bool TFastTextureAtlas::CreateStagingTexture()
+{
+	ofMutex::ScopedLock Lock( mLock );
+	if ( !mDevice || !mDevice->IsValid() || !mTargetTexture )
+		return false;
+
+	//	one staging texture the size of the whole atlas, members write into their regions of it
+	mTargetMeta = mDevice->GetTextureMeta( mTargetTexture );
+	mStagingTexture = mDevice->AllocDynamicTexture( mTargetMeta );
+	mStagingState = TUploadSlotState::Free;
+	mStagedRects.Clear();
+	if ( !mStagingTexture )
+	{
+		BufferString<100> Debug;
+		Debug << "Failed to alloc atlas staging texture; " << mTargetMeta.mWidth << "x" << mTargetMeta.mHeight << "x" << mTargetMeta.GetChannels();
+		Unity::DebugError( Debug );
+		return false;
+	}
+	return true;
+}
+
+void TFastTextureAtlas::DeleteStagingTexture()
+{
+	ofMutex::ScopedLock Lock( mLock );
+	if ( mDevice )
+		mDevice->DeleteTexture( mStagingTexture );
+	mStagingTexture = Unity::TDynamicTexture();
+	mStagingState = TUploadSlotState::Free;
+	mStagedRects.Clear();
+	for ( int i=0;	i<mMembers.GetSize();	i++ )
+	{
+		mMembers[i].mLastFrame = SoyTime();
+		mMembers[i].mStaged = false;
+	}
+}
+
+void TFastTextureAtlas::SetDevice(ofPtr<TUnityDevice> Device)
+{
+	DeleteStagingTexture();
+	{
+		ofMutex::ScopedLock Lock( mLock );
+		mDevice = Device;
+	}
+	CreateStagingTexture();
+}
+
+bool TFastTextureAtlas::IsValid()
+{
+	ofMutex::ScopedLock Lock( mLock );
+	return mStagingTexture.IsValid();
+}
+
+bool TFastTextureAtlas::IsEmpty()
+{
+	ofMutex::ScopedLock Lock( mLock );
+	return mMembers.IsEmpty();
+}
+
+int TFastTextureAtlas::FindMemberIndex(const TFastTexture* Instance)
+{
+	for ( int i=0;	i<mMembers.GetSize();	i++ )
+	{
+		if ( mMembers[i].mInstance == Instance )
+			return i;
+	}
+	return -1;
+}
+
+bool TFastTextureAtlas::AddMember(TFastTexture& Instance,const TFrameRect& Rect)
+{
+	ofMutex::ScopedLock Lock( mLock );
+
+	bool Inside = Rect.IsValid() && Rect.mX >= 0 && Rect.mY >= 0 && Rect.mX + Rect.mWidth <= mTargetMeta.mWidth && Rect.mY + Rect.mHeight <= mTargetMeta.mHeight;
+	if ( !Inside )
+	{
+		BufferString<100> Debug;
+		Debug << Instance.GetRef() << " atlas region " << Rect.mX << "," << Rect.mY << " " << Rect.mWidth << "x" << Rect.mHeight << " is outside the " << mTargetMeta.mWidth << "x" << mTargetMeta.mHeight << " texture";
+		Unity::DebugError( Debug );
+		return false;
+	}
+
+	//	regions can't overlap, members would write over each other in the staging texture
+	for ( int i=0;	i<mMembers.GetSize();	i++ )
+	{
+		auto& Other = mMembers[i];
+		if ( Other.mInstance == &Instance )
+			continue;
+		auto& OtherRect = Other.mRect;
+		bool Overlaps = Rect.mX < OtherRect.mX + OtherRect.mWidth && OtherRect.mX < Rect.mX + Rect.mWidth &&
+						Rect.mY < OtherRect.mY + OtherRect.mHeight && OtherRect.mY < Rect.mY + Rect.mHeight;
+		if ( Overlaps )
 		{
 			BufferString<100> Debug;
-			Debug << "Allocated dynamic texture, set decoded meta; " << TargetTextureMeta.mWidth << "x" << TargetTextureMeta.mHeight << "x" << TargetTextureMeta.GetChannels();
-			Unity::DebugLog( Debug );
+			Debug << Instance.GetRef() << " atlas region overlaps " << Other.mInstance->GetRef();
+			Unity::DebugError( Debug );
+			return false;
 		}
 	}
-	*/
 
+	int Index = FindMemberIndex( &Instance );
+	auto& Member = (Index < 0) ? mMembers.PushBack() : mMembers[Index];
+	Member.mInstance = &Instance;
+	Member.mRect = Rect;
+	Member.mLastFrame = SoyTime();
+	Member.mStaged = false;
 	return true;
 }
 
-void TFastTextureUploadThread::DeleteDynamicTexture()
+void TFastTextureAtlas::RemoveMember(TFastTexture& Instance)
 {
-	ofMutexTimed::ScopedLock lock( mDynamicTextureLock );
-    auto& Device = GetDevice();
-	Device.DeleteTexture( mDynamicTexture );
+	ofMutex::ScopedLock Lock( mLock );
+	int Index = FindMemberIndex( &Instance );
+	if ( Index >= 0 )
+		mMembers.RemoveBlock( Index, 1 );
 }
 
-bool TFastTextureUploadThread::IsValid()
+void TFastTextureAtlas::threadedFunction()
+{
+	Trace::TThread TraceThread("TFastTextureAtlas");
+	while ( isThreadRunning() )
+	{
+		sleep(1);
+
+#if !defined(FORCE_SINGLE_THREAD_UPLOAD)
+		Update();
+#endif
+	}
+}
+
+void TFastTextureAtlas::Update()
+{
+	//	held while writing, so members can't leave and the staging texture can't go away under us
+	ofMutex::ScopedLock Lock( mLock );
+	UpdateBatch();
+}
+
+void TFastTextureAtlas::UpdateBatch()
+{
+	//	render thread hasn't taken the last batch, or the device is still reading it
+	if ( mStagingState != TUploadSlotState::Free || !mStagingTexture )
+		return;
+	if ( !mDevice->IsCopyComplete( mStagingTexture ) )
+		return;
+
+	//	a device that can only map in the render thread (opengl without persistent maps) would fail the copy
+	//	and we'd drop the frames for nothing. OnPostRender writes the batch instead
+	if ( !mDevice->AllowOperationsOutOfRenderThread() && !mDevice->IsRenderThreadActive() && !mDevice->GetMappedData( mStagingTexture ) )
+		return;
+
+	//	collect every member's new frame
+	mBatchFrames.Clear();
+	mBatchPixels.Clear();
+	mBatchRects.Clear();
+	mBatchMembers.Clear();
+	for ( int i=0;	i<mMembers.GetSize();	i++ )
+	{
+		auto& Member = mMembers[i];
+		TFrameRef Frame;
+		if ( !Member.mInstance->PopAtlasFrame( Frame, Member.mLastFrame ) )
+			continue;
+
+		mBatchFrames.PushBack( Frame );
+		mBatchPixels.PushBack( Frame.Get() );
+		mBatchRects.PushBack( Member.mRect );
+		mBatchMembers.PushBack( i );
+	}
+
+	if ( mBatchFrames.IsEmpty() )
+		return;
+
+	//	one map for all of them. If it fails the frames are dropped; newer ones will be along by the time it's ready,
+	//	and as mLastFrame hasn't moved on they'll be taken
+	if ( mDevice->CopyTexture( mStagingTexture, mBatchPixels, mBatchRects, false ) )
+	{
+		for ( int i=0;	i<mBatchMembers.GetSize();	i++ )
+		{
+			auto& Member = mMembers[ mBatchMembers[i] ];
+			auto& Frame = *mBatchFrames[i];
+			Member.mLastFrame = Frame.mTimestamp;
+			Member.mLastDecodedUs = Member.mInstance->IsScrubbing() ? 0 : Frame.mDecodedUs;	//	cached frames don't count towards end-to-end latency
+			Member.mStagedFrame = Member.mLastFrame;
+			Member.mStagedDecodedUs = Member.mLastDecodedUs;
+			Member.mStaged = true;
+			mStagedRects.PushBack( Member.mRect );
+		}
+		mStagingState = TUploadSlotState::Ready;
+	}
+
+	mBatchFrames.Clear();
+	mBatchPixels.Clear();
+}
+
+void TFastTextureAtlas::OnPostRender()
 {
-	ofMutexTimed::ScopedLock lock( mDynamicTextureLock );
-    return mDynamicTexture.IsValid();
+	Unity::TScopeTimerWarning Timer(__FUNCTION__,4);
+
+#if defined(FORCE_SINGLE_THREAD_UPLOAD)
+	Update();
+#endif
+
+	//	don't stall the render thread while a batch is being written, it'll be ready next time
+	if ( !mLock.tryLock() )
+		return;
+	if ( !mDevice->AllowOperationsOutOfRenderThread() )
+		UpdateBatch();
+	CopyToTarget();
+	mLock.unlock();
 }
 
+void TFastTextureAtlas::CopyToTarget()
+{
+	if ( mStagingState != TUploadSlotState::Ready )
+		return;
+
+	//	one upload for every member that changed. Try again next time if it fails
+	if ( !mDevice->CopyTexture( mTargetTexture, mStagingTexture, mStagedRects ) )
+		return;
+
+	for ( int i=0;	i<mMembers.GetSize();	i++ )
+	{
+		auto& Member = mMembers[i];
+		if ( !Member.mStaged )
+			continue;
+		Member.mInstance->OnAtlasFrameCopied( Member.mStagedFrame, Member.mStagedDecodedUs );
+		Member.mStaged = false;
+	}
+	mStagedRects.Clear();
+	mStagingState = TUploadSlotState::Free;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ofxSoylent.h>
+#include <atomic>
 #include "SoyDecoder.h"
 #include "UnityDevice.h"
 
@@ -17,21 +18,57 @@ namespace TFastVideoState
 	const char*	ToString(Type State);
 };
 
+namespace TUploadSlotState
+{
+	enum Type
+	{
+		Free,		//	upload thread can fill it, once the device has finished copying out of it
+		Writing,	//	upload thread is filling it
+		Ready,		//	waiting for the render thread
+		Copying,	//	render thread is copying it to the target
+	};
+};
+
+class TFastTextureAtlas;
+
+//	staging buffer in the upload ring
+class TUploadSlot
+{
+public:
+	TUploadSlot() :
+		mState		( TUploadSlotState::Free ),
+		mDecodedUs	( 0 ),
+		mSequence	( 0 )
+	{
+	}
+
+public:
+	TUploadSlotState::Type	mState;
+	Unity::TDynamicTexture	mDynamicTexture;
+	SoyTime					mFrame;			//	frame in this slot
+	uint64					mDecodedUs;		//	when mFrame was decoded, for end-to-end latency
+	TFrameRef				mMappedFrame;	//	frame decoded straight into an upload buffer, copied instead of mDynamicTexture
+	Array<uint32>			mTileHashes;	//	of the frame in this slot, if it was hashed
+	uint64					mSequence;		//	order slots were filled, render thread takes the newest
+};
+
+//	fills a ring of staging buffers so there's always one to write to, whatever the render thread is doing
 class TFastTextureUploadThread : public SoyThread
 {
 public:
-	TFastTextureUploadThread(TFastTexture& Parent,TUnityDevice& Device);
+	TFastTextureUploadThread(TFastTexture& Parent,TUnityDevice& Device,int SlotCount);
 	~TFastTextureUploadThread();
 
 	virtual void			threadedFunction();
 	void					Update();
 
 	bool					IsValid();				//	check was setup okay
-	bool					CopyToTarget(Unity::TTexture TargetTexture,SoyTime& TargetTextureFrame);
+	bool					CopyToTarget(Unity::TTexture TargetTexture,SoyTime& TargetTextureFrame,uint64& TargetTextureDecodedUs);
 	
 private:
 	bool					CreateDynamicTexture();
 	void					DeleteDynamicTexture();
+	int						ClaimSlot();			//	find a slot to write to and mark it. caller must lock mSlotsLock
 
 	TUnityDevice&			GetDevice()		{	return mDevice;	}
 
@@ -39,10 +76,15 @@ public:
 	TFastTexture&			mParent;
 	TUnityDevice&			mDevice;
 
-	ofMutexTimed			mDynamicTextureLock;
-	Unity::TDynamicTexture	mDynamicTexture;
-	SoyTime					mDynamicTextureFrame;	//	frame in current dynamic texture
-	bool					mDynamicTextureChanged;	//	locked via mDynamicTextureLock
+	ofMutex					mSlotsLock;
+	Array<TUploadSlot>		mSlots;					//	never resized after construction, so slots can be used outside the lock once claimed
+	uint64					mLastSequence;
+	SoyTime					mLastFrame;				//	newest frame written. only used by the upload thread
+	TFrameMeta				mTargetMeta;
+
+	//	render thread only
+	Array<uint32>			mTargetTileHashes;		//	what's in the target texture, so we only upload tiles that differ
+	Array<TFrameRect>		mChangedRects;
 };
 
 //	instance of a video texture
@@ -53,6 +95,8 @@ public:
 	~TFastTexture();
 
 	SoyRef				GetRef() const			{	return mRef;	}
+	uint64				GetHandle() const		{	return mHandle;	}
+	void				SetHandle(uint64 Handle)	{	mHandle = Handle;	}	//	set once by TFastVideo when it's in the instance table
 
 	void				OnTargetTextureChanged();
 	void				OnPostRender();	//	callback from unity render thread
@@ -60,23 +104,52 @@ public:
 	bool				SetTexture(Unity::TTexture TargetTexture);
 	bool				SetVideo(const std::wstring& Filename);
 	void				SetState(TFastVideoState::Type State);
+	TFastVideoState::Type	GetState() const	{	return mState;	}
 	void				SetDevice(ofPtr<TUnityDevice> Device);
 	void				SetLooping(bool EnableLooping);
+	bool				IsLooping() const		{	return mLooping;	}
+	void				SetPlaybackRate(float Rate);
+	float				GetPlaybackRate() const	{	return mClock.GetRate();	}
+	bool				IsReverse() const		{	return GetPlaybackRate() < 0.f;	}
+	void				SetScrubbing(bool EnableScrubbing);
+	bool				IsScrubbing() const		{	return mScrubbing;	}
+	void				StepFrame(int Steps);
+	void				Seek(SoyTime Time);
+	bool				SetSharedSource(TFastTexture* Source);	//	show the source's decoded frames instead of decoding ourselves. null to stop
+	void				SetUploadSlotCount(int Count);			//	staging buffers between the upload and render threads. Takes effect on the next render
+	void				SetDirtyRegionUploads(bool Enable);		//	only upload the tiles that changed since the last frame
+	bool				SetAtlas(TFastTextureAtlas* Atlas,const TFrameRect& Rect);	//	draw into a region of a shared texture instead of our own. null to stop
+	TFastTextureAtlas*	GetAtlas() const		{	return mAtlas;	}
+	bool				PopAtlasFrame(TFrameRef& Frame,SoyTime LastFrame);	//	next frame for the atlas to write into our region
+	void				OnAtlasFrameCopied(SoyTime Frame,uint64 DecodedUs);	//	render thread
+	void				SetUploadPriority(int Priority)	{	mUploadPriority = Priority;	}	//	higher uploads first when the render thread is over budget
+	int					GetUploadPriority() const		{	return mUploadPriority;	}
+	void				UpdateUploadScore(SoyTime Now);	//	render thread; priority, raised by how long we've waited
+	int64				GetUploadScore() const			{	return mUploadScore;	}
+	int					GetUploadWaitMs(SoyTime Now) const;
    
 	SoyTime				GetFrameTime();
 	void				SetFrameTime(SoyTime Time);
 
 	bool				UpdateFrameTexture(Unity::TTexture Texture,SoyTime& FrameCopied);			//	copy latest frame to texture. returns if changed
-	bool				UpdateFrameTexture(Unity::TDynamicTexture Texture,SoyTime& FrameCopied);	//	copy latest frame to texture. returns if changed
+	bool				UpdateFrameTexture(Unity::TDynamicTexture Texture,SoyTime& FrameCopied,uint64& FrameDecodedUs,TFrameRef& MappedFrame,Array<uint32>& TileHashes);	//	copy latest frame to texture, or give it back if it's already in an upload buffer. returns if changed
+	bool				UpdateFrameTextureFromCache(Unity::TTexture Texture,SoyTime& FrameCopied);
+	bool				UpdateFrameTextureFromCache(Unity::TDynamicTexture Texture,SoyTime& FrameCopied,Array<uint32>& TileHashes);
 
 	Unity::TTexture		GetTargetTexture()		{	return mTargetTexture;	}
+	SoyTime				GetTargetTextureFrame() const	{	return mTargetTextureFrame;	}	//	frame we're showing
+	TPipelineCounters&	GetCounters()			{	return mCounters;	}
+	void				GetStats(TInstanceStats& Stats);
+	void				GetStatus(TInstanceStatus& Status);
+	TFrameMeta			GetTargetMeta();		//	format we decode to; our texture, or our region of the atlas
 
 private:
 	void				Update();
-	void				UpdateFrameTime();
+	void				UpdateClockRunning();	//	after a state or scrubbing change
 	virtual void		threadedFunction();
 
 	bool				CreateUploadThread(bool IsRenderThread);
+	void				UpdateUploadSlotCount();	//	render thread
 
 	void				DeleteTargetTexture();
 	void				DeleteDecoderThread();
@@ -84,6 +157,10 @@ private:
 	bool				WaitForLastDeadDecoderThread();
 	void				DeleteUploadThread();
 	void				OnDecoderInitFailed(FastVideoError Error);
+	void				AddSharedFollower(TFastTexture& Follower);
+	void				RemoveSharedFollower(TFastTexture& Follower);
+	void				DetachSharedFollowers();
+	void				UpdateSharedFollowers();
   
     TUnityDevice&       GetDevice();
 
@@ -94,18 +171,103 @@ private:
 	ofMutex					mRenderLock;		//	lock while rendering (from a different thread) so we don't deallocate mid-render
 	TFastVideoState::Type	mState;
 	bool					mLooping;
-	ofMutexT<SoyTime>		mFrame;
-	ofMutexT<SoyTime>		mLastUpdateTime;
+	bool					mScrubbing;			//	time doesn't move, frames come from mFrameCache
+	int						mUploadSlotCount;	//	only changed by the render thread
+	std::atomic<int>		mPendingUploadSlotCount;	//	0 if no change. Applied in OnPostRender
+	bool					mDirtyRegionUploads;
+	int						mUploadPriority;
+	int64					mUploadScore;
+	SoyTime					mLastPostRender;	//	last time the render thread gave us a turn
+	TPlaybackClock			mClock;				//	playhead. Followers' are kept in step with their source's
+	TPipelineCounters		mCounters;
 	TFrameBuffer			mFrameBuffer;
+	TFrameCache				mFrameCache;		//	GOP around the playhead when scrubbing
+	TFrameQuota				mFrameQuota;		//	our share of mFramePool
 	SoyRef					mRef;
+	uint64					mHandle;			//	our handle in the exported api
 
 	ofPtr<TUnityDevice>		mDevice;
 
 
 	Unity::TTexture					mTargetTexture;
 	SoyTime							mTargetTextureFrame;	//	frame of the contents of target texture
+	uint64							mTargetTextureDecodedUs;	//	when that frame was decoded. 0 for frames that weren't (cached, init frames)
 	ofMutexM<TDecodeThread*>		mDecoderThread;
 	ofMutexT<Array<TDecodeThread*>>	mDeadDecoderThreads;	//	waiting to kill these off when we can
 	ofPtr<TFastTextureUploadThread>	mUploadThread;
+
+	std::atomic<TFastTexture*>		mSharedSource;		//	decoder and timeline come from this instance. Cleared by the source's thread in DetachSharedFollowers
+	ofMutexT<Array<TFastTexture*>>	mSharedFollowers;	//	instances showing our decoded frames
+
+	TFastTextureAtlas*				mAtlas;				//	we draw into a region of this atlas' texture instead of mTargetTexture
+	TFrameRect						mAtlasRect;
+};
+
+
+class TFastTextureAtlasMember
+{
+public:
+	TFastTextureAtlasMember() :
+		mInstance			( nullptr ),
+		mLastDecodedUs		( 0 ),
+		mStagedDecodedUs	( 0 ),
+		mStaged				( false )
+	{
+	}
+
+public:
+	TFastTexture*		mInstance;
+	TFrameRect			mRect;
+	SoyTime				mLastFrame;		//	newest frame written to the staging texture
+	SoyTime				mStagedFrame;	//	frame in the staging texture waiting to be copied to the target
+	uint64				mLastDecodedUs;
+	uint64				mStagedDecodedUs;
+	bool				mStaged;
+};
+
+//	several instances drawing into regions of one texture. Their frames are written into one staging texture
+//	and the render thread does a single upload for all of them, rather than one per instance
+class TFastTextureAtlas : public SoyThread
+{
+public:
+	TFastTextureAtlas(Unity::TTexture TargetTexture,ofPtr<TUnityDevice> Device);
+	~TFastTextureAtlas();
+
+	virtual void			threadedFunction();
+	void					Update();			//	write members' new frames into the staging texture
+	void					OnPostRender();		//	callback from unity render thread
+
+	bool					IsValid();
+	bool					IsEmpty();
+	void					SetDevice(ofPtr<TUnityDevice> Device);
+	Unity::TTexture			GetTargetTexture() const					{	return mTargetTexture;	}
+	TFrameMeta				GetMemberMeta(const TFrameRect& Rect) const	{	return TFrameMeta( Rect.mWidth, Rect.mHeight, mTargetMeta.mFormat );	}
+
+	bool					AddMember(TFastTexture& Instance,const TFrameRect& Rect);
+	void					RemoveMember(TFastTexture& Instance);
+
+private:
+	void					UpdateBatch();		//	caller must lock mLock
+	void					CopyToTarget();		//	caller must lock mLock
+	bool					CreateStagingTexture();
+	void					DeleteStagingTexture();
+	int						FindMemberIndex(const TFastTexture* Instance);	//	caller must lock mLock
+
+private:
+	Unity::TTexture			mTargetTexture;		//	owned by unity
+	TFrameMeta				mTargetMeta;
+	ofPtr<TUnityDevice>		mDevice;
+
+	ofMutex					mLock;				//	locks everything below. Held by the atlas thread while it writes a batch
+	Unity::TDynamicTexture	mStagingTexture;
+	TUploadSlotState::Type	mStagingState;
+	Array<TFastTextureAtlasMember>	mMembers;
+	Array<TFrameRect>		mStagedRects;		//	regions written since the last copy to the target
+
+	//	only used by Update
+	Array<TFrameRef>		mBatchFrames;
+	Array<TFramePixels*>	mBatchPixels;
+	Array<TFrameRect>		mBatchRects;
+	Array<int>				mBatchMembers;
 };
 
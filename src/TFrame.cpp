@@ -1,5 +1,14 @@
 #include "TFrame.h"
 #include "FastVideo.h"
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define ENABLE_SSE2
+	#include <emmintrin.h>
+#endif
+#if !defined(TARGET_WINDOWS)
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <stdio.h>
+#endif
 
 
 int TFrameFormat::GetChannels(TFrameFormat::Type Format)
@@ -51,9 +60,32 @@ bool TFrameMeta::operator!=(const TFrameMeta& that) const
 
 
 TFramePool::TFramePool(int MaxPoolSize) :
-	mPoolMaxSize	( ofMax(1,MaxPoolSize) )
+	mPoolMaxSize	( ofMax(1,MaxPoolSize) ),
+	mBudgetBytes	( DEFAULT_FRAME_POOL_BUDGET ),
+	mAllocatedBytes	( 0 ),
+	mPeakBytes		( 0 ),
+	mAllocFailures	( 0 )
 {
 }
+
+TFramePool::~TFramePool()
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+
+	//	used frames are still owned by someone, leave them
+	for ( int c=mSizeClasses.GetSize()-1;	c>=0;	c-- )
+	{
+		auto* SizeClass = mSizeClasses[c];
+		for ( int i=0;	i<SizeClass->mFreeFrames.GetSize();	i++ )
+			delete SizeClass->mFreeFrames[i];
+		SizeClass->mFreeFrames.Clear();
+		if ( SizeClass->mUsedCount == 0 )
+		{
+			mSizeClasses.RemoveBlock( c, 1 );
+			delete SizeClass;
+		}
+	}
+}
 	
 void TFramePool::DebugUsedFrames()
 {
@@ -64,7 +96,7 @@ void TFramePool::DebugUsedFrames()
 		auto& Frame = *mUsedPool[i];
 		
 		BufferString<1000> Debug;
-		Debug << "Frame [" << i << "] allocated; owner: " << Frame.mDebugOwner;
+		Debug << "Frame [" << i << "] allocated; owner: " << Frame.mDebugOwner << " (" << Frame.GetDataSize() << " bytes)";
 		Unity::Debug( Debug );
 	}
 }
@@ -80,7 +112,173 @@ bool TFramePool::IsEmpty()
 
 int TFramePool::GetAllocatedCount()
 {
-	return mFreePool.GetSize() + mUsedPool.GetSize();
+	int Count = mUsedPool.GetSize();
+	for ( int i=0;	i<mSizeClasses.GetSize();	i++ )
+		Count += mSizeClasses[i]->mFreeFrames.GetSize();
+	return Count;
+}
+
+TFrameSizeClass* TFramePool::GetSizeClass(int DataSize,int Alignment,bool Mapped,bool Create)
+{
+	for ( int i=0;	i<mSizeClasses.GetSize();	i++ )
+	{
+		auto* SizeClass = mSizeClasses[i];
+		if ( SizeClass->IsMatch( DataSize, Alignment, Mapped ) )
+			return SizeClass;
+	}
+
+	if ( !Create )
+		return nullptr;
+
+	auto* SizeClass = new TFrameSizeClass( DataSize, Alignment, Mapped );
+	mSizeClasses.PushBack( SizeClass );
+
+	BufferString<1000> Debug;
+	Debug << "New frame size class; " << DataSize << " bytes" << (Mapped ? " (mapped)" : "") << " (" << mSizeClasses.GetSize() << " sizes in pool)";
+	Unity::Debug(Debug);
+
+	return SizeClass;
+}
+
+bool TFramePool::HasRoom(int DataSize)
+{
+	if ( GetAllocatedCount() >= mPoolMaxSize )
+		return false;
+	return ( mAllocatedBytes + DataSize <= mBudgetBytes );
+}
+
+void TFramePool::DeleteFreeFrame(TFrameSizeClass& SizeClass,int FreeIndex)
+{
+	auto* Frame = SizeClass.mFreeFrames.PopAt( FreeIndex );
+	mAllocatedBytes -= Frame->GetDataSize();
+	delete Frame;
+
+	//	size isn't used at all any more
+	if ( SizeClass.GetAllocatedCount() == 0 )
+	{
+		int Index = mSizeClasses.FindIndex( &SizeClass );
+		mSizeClasses.RemoveBlock( Index, 1 );
+		delete &SizeClass;
+	}
+}
+
+bool TFramePool::ReclaimFrame(const TFrameSizeClass* ForSizeClass)
+{
+	//	prefer sizes no-one is using any more, otherwise the one with the most spare frames
+	TFrameSizeClass* Victim = nullptr;
+	for ( int i=0;	i<mSizeClasses.GetSize();	i++ )
+	{
+		auto* SizeClass = mSizeClasses[i];
+		if ( SizeClass == ForSizeClass || SizeClass->mFreeFrames.IsEmpty() )
+			continue;
+
+		//	upload buffers are waiting for the device to map them, don't swap them for heap frames
+		if ( ForSizeClass && SizeClass->mMapped )
+			continue;
+
+		if ( !Victim )
+		{
+			Victim = SizeClass;
+			continue;
+		}
+
+		bool Idle = ( SizeClass->mUsedCount == 0 );
+		bool VictimIdle = ( Victim->mUsedCount == 0 );
+		if ( Idle != VictimIdle )
+		{
+			if ( Idle )
+				Victim = SizeClass;
+			continue;
+		}
+
+		if ( SizeClass->mFreeFrames.GetSize() > Victim->mFreeFrames.GetSize() )
+			Victim = SizeClass;
+	}
+
+	if ( !Victim )
+		return false;
+
+	DeleteFreeFrame( *Victim, Victim->mFreeFrames.GetSize()-1 );
+	return true;
+}
+
+void TFramePool::SetBudget(uint64 Bytes)
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+	mBudgetBytes = Bytes;
+
+	//	used frames will go when they're freed
+	while ( mAllocatedBytes > mBudgetBytes && ReclaimFrame( nullptr ) )
+	{
+	}
+
+	BufferString<1000> Debug;
+	Debug << "Frame pool budget " << (mBudgetBytes/(1024*1024)) << "mb, " << (mAllocatedBytes/(1024*1024)) << "mb allocated";
+	Unity::Debug(Debug);
+}
+
+void TFramePool::TrimIdleFrames()
+{
+	SoyTime Now(true);
+	ofMutex::ScopedLock lock( mPoolLock );
+
+	//	don't need to check every frame
+	if ( Now.GetTime() < mLastTrimTime.GetTime() + 1000 )
+		return;
+	mLastTrimTime = Now;
+
+	for ( int c=mSizeClasses.GetSize()-1;	c>=0;	c-- )
+	{
+		auto& SizeClass = *mSizeClasses[c];
+		for ( int i=SizeClass.mFreeFrames.GetSize()-1;	i>=0;	i-- )
+		{
+			auto& Frame = *SizeClass.mFreeFrames[i];
+			if ( Now.GetTime() < Frame.mFreeTime.GetTime() + DEFAULT_FRAME_POOL_TRIM_MS )
+				continue;
+
+			//	this could delete the size class, so don't touch it again
+			bool LastFrame = ( SizeClass.GetAllocatedCount() == 1 );
+			DeleteFreeFrame( SizeClass, i );
+			if ( LastFrame )
+				break;
+		}
+	}
+}
+
+void TFramePool::GetStats(TFramePoolStats& Stats)
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+
+	Stats.mBudgetBytes = mBudgetBytes;
+	Stats.mAllocatedBytes = mAllocatedBytes;
+	Stats.mPeakBytes = mPeakBytes;
+	Stats.mAllocatedFrames = GetAllocatedCount();
+	Stats.mUsedFrames = mUsedPool.GetSize();
+	Stats.mSizeClasses = mSizeClasses.GetSize();
+	Stats.mAllocFailures = mAllocFailures;
+
+	Stats.mUsedBytes = 0;
+	for ( int i=0;	i<mUsedPool.GetSize();	i++ )
+		Stats.mUsedBytes += mUsedPool[i]->GetDataSize();
+
+	Stats.mIdleBytes = 0;
+	Stats.mMappedFrames = 0;
+	for ( int c=0;	c<mSizeClasses.GetSize();	c++ )
+	{
+		auto& SizeClass = *mSizeClasses[c];
+		if ( SizeClass.mMapped )
+			Stats.mMappedFrames += SizeClass.GetAllocatedCount();
+		if ( SizeClass.mUsedCount > 0 )
+			continue;
+		Stats.mIdleBytes += static_cast<uint64>( SizeClass.mDataSize ) * SizeClass.mFreeFrames.GetSize();
+	}
+}
+
+void TFramePool::ResetStats()
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+	mPeakBytes = mAllocatedBytes;
+	mAllocFailures = 0;
 }
 
 void TFramePool::PreAlloc(TFrameMeta FrameMeta)
@@ -91,26 +289,186 @@ void TFramePool::PreAlloc(TFrameMeta FrameMeta)
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
 	ofMutex::ScopedLock lock( mPoolLock );
 
-	//	already allocated some
-	if ( GetAllocatedCount() > 0 )
+	auto& SizeClass = *GetSizeClass( TFramePixels::GetAllocSize(FrameMeta), GetAlignment(FrameMeta), false, true );
+
+	//	already allocated some of this size
+	if ( SizeClass.mPreAllocated )
 		return;
+	SizeClass.mPreAllocated = true;
 
-	//	alloc X frames
-	mFreePool.Reserve( mPoolMaxSize );
-	for ( int i=0;	i<mPoolMaxSize;	i++ )
+	//	alloc X frames, leaving room for other sizes
+	for ( int i=0;	i<DEFAULT_SIZE_CLASS_PREALLOC;	i++ )
 	{
+		if ( !HasRoom( TFramePixels::GetAllocSize(FrameMeta) ) )
+			break;
+
 		TFramePixels* Frame = new TFramePixels( FrameMeta, "TFramePool - pre-alloc" );
-		if ( !Frame )
+		if ( !Frame || !Frame->GetData() )
 		{
-			assert( Frame );
+			delete Frame;
 			return;
 		}
-		mFreePool.PushBack( Frame );
+		Frame->mFreeTime = SoyTime(true);
+		mAllocatedBytes += Frame->GetDataSize();
+		mPeakBytes = ofMax( mPeakBytes, mAllocatedBytes );
+		SizeClass.mFreeFrames.PushBack( Frame );
+	}
+}
+
+
+void TFramePool::SetMappedFrameDevice(ofPtr<TUnityDevice> Device)
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+	mMappedDevice = Device;
+
+	//	free upload buffers of the old device. Used ones are deleted when they come back
+	for ( int c=mSizeClasses.GetSize()-1;	c>=0;	c-- )
+	{
+		auto& SizeClass = *mSizeClasses[c];
+		if ( !SizeClass.mMapped )
+			continue;
+
+		for ( int i=SizeClass.mFreeFrames.GetSize()-1;	i>=0;	i-- )
+		{
+			if ( SizeClass.mFreeFrames[i]->mMappedDevice == mMappedDevice )
+				continue;
+
+			//	this could delete the size class, so don't touch it again
+			bool LastFrame = ( SizeClass.GetAllocatedCount() == 1 );
+			DeleteFreeFrame( SizeClass, i );
+			if ( LastFrame )
+				break;
+		}
 	}
 }
 
+TFramePixels* TFramePool::AllocMappedFrame(const TFrameMeta& FrameMeta,TFrameSizeClass*& pSizeClass)
+{
+	if ( !ENABLE_MAPPED_FRAMES || !mMappedDevice || !mMappedDevice->SupportsMappedFrames() )
+		return nullptr;
+
+	//	upload buffers are tightly packed
+	int DataSize = FrameMeta.GetDataSize();
+	auto& SizeClass = *GetSizeClass( DataSize, 0, true, true );
+	pSizeClass = &SizeClass;
+
+	//	any free buffer of this shape the device has mapped at the moment
+	for ( int i=SizeClass.mFreeFrames.GetSize()-1;	i>=0;	i-- )
+	{
+		auto* Frame = SizeClass.mFreeFrames[i];
+		if ( Frame->mMeta != FrameMeta )
+			continue;
+		if ( !Frame->MapPixels() )
+			continue;
+		SizeClass.mFreeFrames.RemoveBlock( i, 1 );
+		return Frame;
+	}
+
+	//	make another. Some devices can only map it during the render thread, so we'll use the heap until then
+	if ( SizeClass.GetAllocatedCount() >= DEFAULT_MAX_MAPPED_FRAMES || !HasRoom( DataSize ) )
+		return nullptr;
+
+	auto* Frame = new TFramePixels( mMappedDevice, FrameMeta, "TFramePool - mapped" );
+	if ( !Frame->IsMapped() )
+	{
+		delete Frame;
+		mAllocFailures++;
+		return nullptr;
+	}
+	Frame->mFreeTime = SoyTime(true);
+	mAllocatedBytes += Frame->GetDataSize();
+	mPeakBytes = ofMax( mPeakBytes, mAllocatedBytes );
+
+	if ( Frame->MapPixels() )
+		return Frame;
+
+	SizeClass.mFreeFrames.PushBack( Frame );
+	return nullptr;
+}
+
+void TFramePool::AddQuota(TFrameQuota& Quota)
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+	mQuotas.PushBackUnique( &Quota );
+	UpdateQuotas();
+}
+
+void TFramePool::RemoveQuota(TFrameQuota& Quota)
+{
+	ofMutex::ScopedLock lock( mPoolLock );
+	int Index = mQuotas.FindIndex( &Quota );
+	if ( Index >= 0 )
+		mQuotas.RemoveBlock( Index, 1 );
+
+	//	anything still out there doesn't count against anyone now
+	for ( int i=0;	i<mUsedPool.GetSize();	i++ )
+	{
+		if ( mUsedPool[i]->mQuota == &Quota )
+			mUsedPool[i]->mQuota = nullptr;
+	}
+
+	UpdateQuotas();
+}
+
+//	half the pool is reserved evenly between instances, the rest is overflow anyone can borrow.
+//	With more than one instance no-one can borrow more than half of the overflow.
+//	This limits frame counts; the byte budget (HasRoom) still applies on top
+void TFramePool::UpdateQuotas()
+{
+	int QuotaCount = mQuotas.GetSize();
+	if ( QuotaCount == 0 )
+		return;
+
+	int Reserved = ofMax( 1, (mPoolMaxSize/2) / QuotaCount );
+	int Overflow = ofMax( 0, mPoolMaxSize - (Reserved * QuotaCount) );
+	int MaxBorrow = Overflow / ofMin( QuotaCount, 2 );
+
+	for ( int i=0;	i<QuotaCount;	i++ )
+	{
+		auto& Quota = *mQuotas[i];
+		Quota.mReserved = Reserved;
+		Quota.mHighWatermark = Reserved + MaxBorrow;
+		Quota.mLowWatermark = Reserved + MaxBorrow/2;
+	}
+
+	BufferString<1000> Debug;
+	Debug << "Frame pool shared by " << QuotaCount << " instances; " << Reserved << " reserved each, " << Overflow << " overflow";
+	Unity::Debug(Debug);
+}
+
+bool TFramePool::IsWithinQuota(TFrameQuota& Quota)
+{
+	//	always allowed what's reserved for us
+	if ( Quota.mUsed < Quota.mReserved )
+		return true;
+
+	//	borrowed too much, wait until we've given some back
+	if ( Quota.mThrottled )
+		return false;
+
+	if ( Quota.mUsed >= Quota.mHighWatermark )
+	{
+		Quota.mThrottled = true;
+		BufferString<1000> Debug;
+		Debug << Quota.mName << " reached frame quota (" << Quota.mUsed.load() << ")";
+		Unity::Debug(Debug);
+		return false;
+	}
+
+	//	borrowing from the overflow, don't take anything reserved for someone else
+	int Outstanding = 0;
+	for ( int i=0;	i<mQuotas.GetSize();	i++ )
+	{
+		auto& Other = *mQuotas[i];
+		if ( &Other == &Quota )
+			continue;
+		Outstanding += ofMax( 0, Other.mReserved - Other.mUsed.load() );
+	}
+
+	return ( mUsedPool.GetSize() + Outstanding < mPoolMaxSize );
+}
 
-TFramePixels* TFramePool::Alloc(TFrameMeta FrameMeta,const char* Owner)
+TFramePixels* TFramePool::Alloc(TFrameMeta FrameMeta,const char* Owner,TFrameQuota* Quota,bool Mapped)
 {
 	//	can't alloc invalid frame 
 	if ( !FrameMeta.IsValid() )
@@ -121,40 +479,85 @@ TFramePixels* TFramePool::Alloc(TFrameMeta FrameMeta,const char* Owner)
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
 	ofMutex::ScopedLock lock( mPoolLock );
 
-	//	any free?
-	TFramePixels* FreeFrame = NULL;
+	//	instance has all it's allowed
+	if ( Quota && !IsWithinQuota( *Quota ) )
+		return nullptr;
 
-	if ( !mFreePool.IsEmpty() )
-	{
-		FreeFrame = mFreePool.PopBack();
-		mUsedPool.PushBack( FreeFrame );
-	}
-	else
+	//	decode straight into upload memory if we can
+	TFrameSizeClass* pSizeClass = nullptr;
+	TFramePixels* FreeFrame = Mapped ? AllocMappedFrame( FrameMeta, pSizeClass ) : nullptr;
+
+	if ( !FreeFrame )
 	{
-		if ( GetAllocatedCount() < mPoolMaxSize )
-		{
-			FreeFrame = new TFramePixels( FrameMeta, "TFramePool - alloc" );
-			BufferString<1000> Debug;
-			Debug << "Allocating new block; " << " pool size; " << GetAllocatedCount();
-			Unity::Debug(Debug);
+		pSizeClass = GetSizeClass( TFramePixels::GetAllocSize(FrameMeta), GetAlignment(FrameMeta), false, true );
+		auto& SizeClass = *pSizeClass;
 
-			if ( FreeFrame )
-				mUsedPool.PushBack( FreeFrame );
+		//	any free?
+		if ( !SizeClass.mFreeFrames.IsEmpty() )
+		{
+			FreeFrame = SizeClass.mFreeFrames.PopBack();
 		}
 		else
 		{
-			if ( SHOW_POOL_FULL_MESSAGE )
+			//	pool is full of other sizes, free those up until there's room
+			int DataSize = TFramePixels::GetAllocSize(FrameMeta);
+			while ( !HasRoom( DataSize ) && ReclaimFrame( &SizeClass ) )
 			{
+			}
+
+			if ( HasRoom( DataSize ) )
+			{
+				FreeFrame = new TFramePixels( FrameMeta, "TFramePool - alloc" );
+				//	out of memory
+				if ( FreeFrame && !FreeFrame->GetData() )
+				{
+					delete FreeFrame;
+					FreeFrame = nullptr;
+					mAllocFailures++;
+				}
+				if ( FreeFrame )
+				{
+					mAllocatedBytes += FreeFrame->GetDataSize();
+					mPeakBytes = ofMax( mPeakBytes, mAllocatedBytes );
+				}
 				BufferString<1000> Debug;
-				Debug << "Frame pool is full (" << GetAllocatedCount() << ")";
+				Debug << "Allocating new block; " << DataSize << " bytes, pool size; " << GetAllocatedCount() << " (" << (mAllocatedBytes/(1024*1024)) << "mb)";
 				Unity::Debug(Debug);
 			}
+			else
+			{
+				mAllocFailures++;
+				if ( SHOW_POOL_FULL_MESSAGE && Unity::IsLogEnabled( TLogLevel::Full ) )
+				{
+					BufferString<1000> Debug;
+					Debug << "Frame pool is full (" << GetAllocatedCount() << ")";
+					Unity::Debug(Debug);
+				}
+			}
 		}
+
+		//	same size buffer, but could have been a different shape
+		if ( FreeFrame )
+			FreeFrame->SetMeta( FrameMeta );
 	}
 	
-	//	set outgoing owner name
 	if ( FreeFrame )
+	{
+		FreeFrame->mPoolIndex = mUsedPool.GetSize();
+		mUsedPool.PushBack( FreeFrame );
+		pSizeClass->mUsedCount++;
+
+		FreeFrame->mQuota = Quota;
+		if ( Quota )
+			Quota->mUsed++;
+
+		//	set outgoing owner name
 		FreeFrame->mDebugOwner = Owner;
+		FreeFrame->mRefCount = 1;
+		FreeFrame->mTileHashes.Clear();
+		FreeFrame->mDecodedUs = 0;
+		FreeFrame->mBufferedUs = 0;
+	}
 
 	return FreeFrame;
 }
@@ -164,34 +567,592 @@ bool TFramePool::Free(TFramePixels* pFrame)
 	if ( !pFrame )
 		return false;
 
+	//	still held by another consumer
+	int RefCount = --pFrame->mRefCount;
+	assert( RefCount >= 0 );
+	if ( RefCount > 0 )
+		return true;
+
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,2);
 	ofMutex::ScopedLock lock( mPoolLock );
 
-	//	find in used pool
-	int UsedIndex = mUsedPool.FindIndex( pFrame );
-	if ( UsedIndex == -1 )
+	//	check it's from this pool
+	int UsedIndex = pFrame->mPoolIndex;
+	bool Mapped = pFrame->IsMapped();
+	auto* SizeClass = GetSizeClass( pFrame->GetDataSize(), Mapped ? 0 : GetAlignment(pFrame->mMeta), Mapped, false );
+	if ( UsedIndex < 0 || UsedIndex >= mUsedPool.GetSize() || mUsedPool[UsedIndex] != pFrame || !SizeClass )
 	{
 		//	missing from pool
-		assert( UsedIndex != -1 );
+		assert( false );
 		return false;
 	}
 	
-	//	put into free pool
+	//	swap the last used frame into this slot rather than shuffling the whole list down
+	int LastIndex = mUsedPool.GetSize()-1;
+	if ( UsedIndex != LastIndex )
+	{
+		mUsedPool[UsedIndex] = mUsedPool[LastIndex];
+		mUsedPool[UsedIndex]->mPoolIndex = UsedIndex;
+	}
+	mUsedPool.PopBack();
+
+	//	put into free list for its size
 	pFrame->mDebugOwner = "TFramePool - free";
-	mFreePool.PushBack( pFrame );
-	mUsedPool.RemoveBlock( UsedIndex, 1 );
+	pFrame->mPoolIndex = -1;
+	pFrame->mFreeTime = SoyTime(true);
+	SizeClass->mUsedCount--;
+	SizeClass->mFreeFrames.PushBack( pFrame );
+
+	//	given back enough to start borrowing again
+	if ( pFrame->mQuota )
+	{
+		auto& Quota = *pFrame->mQuota;
+		Quota.mUsed--;
+		if ( Quota.mThrottled && Quota.mUsed <= Quota.mLowWatermark )
+			Quota.mThrottled = false;
+		pFrame->mQuota = nullptr;
+	}
+
+	//	device has changed, its upload memory is no use to us
+	if ( Mapped && pFrame->mMappedDevice != mMappedDevice )
+		DeleteFreeFrame( *SizeClass, SizeClass->mFreeFrames.GetSize()-1 );
 
 	return true;
 }
 
+bool TFramePool::Retain(TFramePixels* pFrame)
+{
+	if ( !pFrame )
+		return false;
+
+	//	can only share a frame that's been allocated
+	int RefCount = pFrame->mRefCount++;
+	if ( RefCount <= 0 )
+	{
+		assert( RefCount > 0 );
+		pFrame->mRefCount--;
+		return false;
+	}
+
+	return true;
+}
+
+
+TFrameRef::TFrameRef(TFramePixels* Frame,TFramePool& Pool) :
+	mFrame	( nullptr ),
+	mPool	( &Pool )
+{
+	if ( Pool.Retain( Frame ) )
+		mFrame = Frame;
+}
+
+TFrameRef::TFrameRef(const TFrameRef& That) :
+	mFrame	( nullptr ),
+	mPool	( nullptr )
+{
+	*this = That;
+}
+
+TFrameRef& TFrameRef::operator=(const TFrameRef& That)
+{
+	if ( this == &That )
+		return *this;
+
+	Release();
+	if ( That.mFrame && That.mPool->Retain( That.mFrame ) )
+	{
+		mFrame = That.mFrame;
+		mPool = That.mPool;
+	}
+	return *this;
+}
+
+void TFrameRef::Release()
+{
+	if ( mFrame )
+		mPool->Free( mFrame );
+	mFrame = nullptr;
+}
+
 
 
 
 TFramePixels::TFramePixels(TFrameMeta Meta,const char* Owner) :
 	mMeta		( Meta ),
-	mDebugOwner	( Owner )
+	mDebugOwner	( Owner ),
+	mPixels		( nullptr ),
+	mDataSize	( 0 ),
+	mAllocSize	( 0 ),
+	mPitch		( GetPaddedPitch(Meta) ),
+	mHugePages	( false ),
+	mKeyframe	( false ),
+	mDecodedUs	( 0 ),
+	mBufferedUs	( 0 ),
+	mRefCount	( 0 ),
+	mPoolIndex	( -1 ),
+	mQuota		( nullptr ),
+	mMappedBuffer	( nullptr )
+{
+	AllocPixels( GetAllocSize(mMeta) );
+}
+
+TFramePixels::TFramePixels(ofPtr<TUnityDevice> Device,TFrameMeta Meta,const char* Owner) :
+	mMeta			( Meta ),
+	mDebugOwner		( Owner ),
+	mPixels			( nullptr ),
+	mDataSize		( Meta.GetDataSize() ),
+	mAllocSize		( 0 ),
+	mPitch			( GetRowSize() ),
+	mHugePages		( false ),
+	mKeyframe		( false ),
+	mDecodedUs		( 0 ),
+	mBufferedUs		( 0 ),
+	mRefCount		( 0 ),
+	mPoolIndex		( -1 ),
+	mQuota			( nullptr ),
+	mMappedBuffer	( nullptr )
+{
+	if ( !Device )
+		return;
+
+	auto Buffer = Device->AllocDynamicTexture( Meta );
+	if ( !Buffer )
+		return;
+
+	mMappedDevice = Device;
+	mMappedBuffer = Buffer.GetPointer();
+}
+
+TFramePixels::TFramePixels(const TFramePixels& Other) :
+	mPixels		( nullptr ),
+	mDataSize	( 0 ),
+	mAllocSize	( 0 ),
+	mPitch		( 0 ),
+	mHugePages	( false ),
+	mKeyframe	( false ),
+	mDecodedUs	( 0 ),
+	mBufferedUs	( 0 ),
+	mRefCount	( 0 ),
+	mPoolIndex	( -1 ),
+	mQuota		( nullptr ),
+	mMappedBuffer	( nullptr )
+{
+	*this = Other;
+}
+
+TFramePixels::~TFramePixels()
+{
+	FreePixels();
+}
+
+TFramePixels& TFramePixels::operator=(const TFramePixels& That)
+{
+	if ( this == &That )
+		return *this;
+
+	//	copies live on the heap
+	if ( mDataSize != That.mDataSize || IsMapped() )
+	{
+		FreePixels();
+		AllocPixels( That.mDataSize );
+	}
+
+	mMeta = That.mMeta;
+	mPitch = That.mPitch;
+	mTimestamp = That.mTimestamp;
+	mKeyframe = That.mKeyframe;
+	mDecodedUs = That.mDecodedUs;
+	mBufferedUs = That.mBufferedUs;
+	mTileHashes = That.mTileHashes;
+	if ( mPixels && That.mPixels )
+		memcpy( mPixels, That.mPixels, mDataSize );
+
+	return *this;
+}
+
+//	the mapping can move every time the device unmaps the buffer to upload it
+bool TFramePixels::MapPixels()
+{
+	if ( !mMappedDevice || !mMappedBuffer )
+		return false;
+
+	mPixels = mMappedDevice->GetMappedData( Unity::TDynamicTexture( mMappedBuffer ) );
+	return mPixels != nullptr;
+}
+
+void TFramePixels::SetMeta(const TFrameMeta& Meta)
+{
+	assert( GetAllocSize(Meta) == mDataSize );
+	mMeta = Meta;
+	mPitch = GetPaddedPitch( Meta );
+}
+
+//	pad to whole cache lines, and whole pixels so the row length can be given to GL in pixels
+int TFramePixels::GetPaddedPitch(const TFrameMeta& Meta)
+{
+	int Channels = ofMax( 1, Meta.GetChannels() );
+	int Alignment = FRAME_ROW_ALIGNMENT;
+	while ( Alignment % Channels != 0 )
+		Alignment += FRAME_ROW_ALIGNMENT;
+
+	int RowSize = sizeof(uint8) * Meta.mWidth * Meta.GetChannels();
+	return ( (RowSize + Alignment - 1) / Alignment ) * Alignment;
+}
+
+bool TFramePixels::CopyRows(unsigned char* Dst,int DstPitch,int DstSize) const
+{
+	if ( !Dst || !mPixels )
+		return false;
+
+	//	same layout, one big copy
+	if ( DstPitch == mPitch )
+	{
+		memcpy( Dst, mPixels, ofMin( DstSize, mDataSize ) );
+		return true;
+	}
+
+	int RowSize = ofMin( GetRowSize(), DstPitch );
+	int Rows = ofMin( GetHeight(), DstSize / ofMax( 1, DstPitch ) );
+	for ( int y=0;	y<Rows;	y++ )
+		memcpy( Dst + (y*DstPitch), mPixels + (y*mPitch), RowSize );
+	return true;
+}
+
+bool TFramePixels::CopyRows(unsigned char* Dst,int DstPitch,int DstSize,const TFrameRect& DstRect) const
+{
+	if ( !Dst || !mPixels )
+		return false;
+
+	//	never write outside the rect; neighbouring regions belong to someone else
+	int Channels = mMeta.GetChannels();
+	int RowSize = ofMin( GetWidth(), DstRect.mWidth ) * Channels;
+	int Rows = ofMin( GetHeight(), DstRect.mHeight );
+	if ( DstRect.mX < 0 || DstRect.mY < 0 || (DstRect.mX * Channels) + RowSize > DstPitch )
+		return false;
+
+	int Offset = (DstRect.mY * DstPitch) + (DstRect.mX * Channels);
+	for ( int y=0;	y<Rows;	y++ )
+	{
+		int RowOffset = Offset + (y*DstPitch);
+		if ( RowOffset + RowSize > DstSize )
+			return false;
+		memcpy( Dst + RowOffset, mPixels + (y*mPitch), RowSize );
+	}
+	return true;
+}
+
+#if defined(TARGET_WINDOWS)
+namespace
+{
+	std::atomic<int>	gLargePagePrivilege( 0 );	//	0 not tried yet, 1 enabled, -1 not held
+	std::atomic<bool>	gLargePageFallbackLogged( false );
+
+	//	large pages need SeLockMemoryPrivilege ("Lock pages in memory" in the local security policy) granted
+	//	to the user, and even then it's disabled in our token until we enable it
+	bool EnableLargePagePrivilege()
+	{
+		int State = gLargePagePrivilege.load();
+		if ( State != 0 )
+			return State > 0;
+
+		bool Enabled = false;
+		HANDLE Token = nullptr;
+		if ( OpenProcessToken( GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES|TOKEN_QUERY, &Token ) )
+		{
+			TOKEN_PRIVILEGES Privileges;
+			Privileges.PrivilegeCount = 1;
+			Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			if ( LookupPrivilegeValue( nullptr, SE_LOCK_MEMORY_NAME, &Privileges.Privileges[0].Luid ) )
+			{
+				//	succeeds without enabling anything if the user doesn't hold it
+				if ( AdjustTokenPrivileges( Token, FALSE, &Privileges, 0, nullptr, nullptr ) )
+					Enabled = ( GetLastError() == ERROR_SUCCESS );
+			}
+			CloseHandle( Token );
+		}
+		gLargePagePrivilege = Enabled ? 1 : -1;
+		return Enabled;
+	}
+
+	void OnLargePageFallback(const char* Reason)
+	{
+		if ( gLargePageFallbackLogged.exchange( true ) )
+			return;
+
+		BufferString<200> Debug;
+		Debug << "Large pages unavailable (" << Reason << "), frames will use the heap";
+		Unity::Debug( Debug );
+	}
+};
+#else
+namespace
 {
-	mPixels.SetSize( mMeta.mWidth * mMeta.mHeight * mMeta.GetChannels() );
+	std::atomic<int>	gHugePageSize( 0 );
+
+	//	default size MAP_HUGETLB gives us. munmap fails on a length that isn't a multiple of it
+	int GetHugePageSize()
+	{
+		int Size = gHugePageSize.load();
+		if ( Size > 0 )
+			return Size;
+
+		Size = FRAME_HUGE_PAGE_MIN_SIZE;
+		if ( FILE* MemInfo = fopen( "/proc/meminfo", "r" ) )
+		{
+			char Line[256];
+			int SizeKb = 0;
+			while ( fgets( Line, sizeof(Line), MemInfo ) )
+			{
+				if ( sscanf( Line, "Hugepagesize: %d kB", &SizeKb ) == 1 && SizeKb > 0 )
+				{
+					Size = SizeKb * 1024;
+					break;
+				}
+			}
+			fclose( MemInfo );
+		}
+		gHugePageSize = Size;
+		return Size;
+	}
+};
+#endif
+
+void TFramePixels::AllocPixels(int DataSize)
+{
+	assert( !mPixels );
+	mDataSize = DataSize;
+	mAllocSize = DataSize;
+	mHugePages = false;
+	if ( DataSize <= 0 )
+		return;
+
+#if defined(TARGET_WINDOWS)
+	SIZE_T LargePageSize = GetLargePageMinimum();
+	if ( DataSize >= FRAME_HUGE_PAGE_MIN_SIZE && LargePageSize > 0 )
+	{
+		if ( EnableLargePagePrivilege() )
+		{
+			//	has to be a whole number of large pages. The tail goes unused, mDataSize stays what was asked for
+			SIZE_T AllocSize = ( (static_cast<SIZE_T>( DataSize ) + LargePageSize - 1) / LargePageSize ) * LargePageSize;
+			mPixels = static_cast<uint8*>( VirtualAlloc( nullptr, AllocSize, MEM_COMMIT|MEM_RESERVE|MEM_LARGE_PAGES, PAGE_READWRITE ) );
+			mHugePages = ( mPixels != nullptr );
+			if ( mHugePages )
+				mAllocSize = static_cast<int>( AllocSize );
+			if ( !mPixels )
+				OnLargePageFallback("VirtualAlloc failed, physical memory too fragmented");
+		}
+		else
+		{
+			OnLargePageFallback("user hasn't been granted SeLockMemoryPrivilege");
+		}
+	}
+	if ( !mPixels )
+		mPixels = static_cast<uint8*>( _aligned_malloc( DataSize, FRAME_ROW_ALIGNMENT ) );
+#else
+	if ( DataSize >= FRAME_HUGE_PAGE_MIN_SIZE )
+	{
+		void* Data = MAP_FAILED;
+	#if defined(MAP_HUGETLB)
+		//	whole huge pages, the tail goes unused. mDataSize stays what was asked for
+		int HugePageSize = GetHugePageSize();
+		int HugeAllocSize = ( (DataSize + HugePageSize - 1) / HugePageSize ) * HugePageSize;
+		Data = mmap( nullptr, HugeAllocSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0 );
+		if ( Data != MAP_FAILED )
+			mAllocSize = HugeAllocSize;
+	#endif
+		//	no reserved huge pages, ask for transparent ones
+		if ( Data == MAP_FAILED )
+		{
+			Data = mmap( nullptr, DataSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+	#if defined(MADV_HUGEPAGE)
+			if ( Data != MAP_FAILED )
+				madvise( Data, DataSize, MADV_HUGEPAGE );
+	#endif
+		}
+		if ( Data != MAP_FAILED )
+		{
+			mPixels = static_cast<uint8*>( Data );
+			mHugePages = true;
+		}
+	}
+	if ( !mPixels )
+	{
+		void* Data = nullptr;
+		if ( posix_memalign( &Data, FRAME_ROW_ALIGNMENT, DataSize ) == 0 )
+			mPixels = static_cast<uint8*>( Data );
+	}
+#endif
+
+	if ( !mPixels )
+	{
+		BufferString<100> Debug;
+		Debug << "Failed to allocate " << DataSize << " bytes for frame";
+		Unity::DebugError( Debug );
+		mDataSize = 0;
+		mAllocSize = 0;
+	}
+}
+
+void TFramePixels::FreePixels()
+{
+	if ( mMappedBuffer )
+	{
+		Unity::TDynamicTexture Buffer( mMappedBuffer );
+		mMappedDevice->DeleteTexture( Buffer );
+		mMappedDevice.reset();
+		mMappedBuffer = nullptr;
+	}
+	else if ( mPixels )
+	{
+#if defined(TARGET_WINDOWS)
+		if ( mHugePages )
+			VirtualFree( mPixels, 0, MEM_RELEASE );
+		else
+			_aligned_free( mPixels );
+#else
+		if ( mHugePages )
+		{
+			//	the length we mapped, not mDataSize, or huge pages fail with EINVAL and leak
+			if ( munmap( mPixels, mAllocSize ) != 0 )
+			{
+				BufferString<100> Debug;
+				Debug << "Failed to unmap " << mAllocSize << " bytes of frame";
+				Unity::DebugError( Debug );
+			}
+		}
+		else
+		{
+			free( mPixels );
+		}
+#endif
+	}
+	mPixels = nullptr;
+	mDataSize = 0;
+	mAllocSize = 0;
+	mHugePages = false;
+}
+
+//	not cryptographic, just enough to spot a changed tile. Lanes rotate and xor in 16 bytes at a time
+//	and mix with their neighbour; the scalar version gives the same result
+static uint32 HashTile(const uint8* Pixels,int Pitch,int RowBytes,int Rows)
+{
+	int SimdBytes = RowBytes & ~15;
+#if defined(ENABLE_SSE2)
+	__m128i Acc = _mm_set1_epi32( 0x9e3779b9 );
+	for ( int y=0;	y<Rows;	y++ )
+	{
+		auto* Row = Pixels + (y*Pitch);
+		for ( int x=0;	x<SimdBytes;	x+=16 )
+		{
+			__m128i Data = _mm_loadu_si128( reinterpret_cast<const __m128i*>( Row + x ) );
+			Acc = _mm_or_si128( _mm_slli_epi32( Acc, 5 ), _mm_srli_epi32( Acc, 27 ) );
+			Acc = _mm_xor_si128( Acc, Data );
+			Acc = _mm_add_epi32( Acc, _mm_shuffle_epi32( Acc, _MM_SHUFFLE(2,1,0,3) ) );
+		}
+	}
+	uint32 Lanes[4];
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( Lanes ), Acc );
+#else
+	uint32 Lanes[4] = { 0x9e3779b9, 0x9e3779b9, 0x9e3779b9, 0x9e3779b9 };
+	for ( int y=0;	y<Rows;	y++ )
+	{
+		auto* Row = Pixels + (y*Pitch);
+		for ( int x=0;	x<SimdBytes;	x+=16 )
+		{
+			uint32 Data[4];
+			memcpy( Data, Row + x, sizeof(Data) );
+			uint32 Prev[4];
+			for ( int l=0;	l<4;	l++ )
+				Prev[l] = ( (Lanes[l] << 5) | (Lanes[l] >> 27) ) ^ Data[l];
+			for ( int l=0;	l<4;	l++ )
+				Lanes[l] = Prev[l] + Prev[(l+3)%4];
+		}
+	}
+#endif
+
+	//	fnv-1a the lanes and whatever didn't fill 16 bytes
+	uint32 Hash = 2166136261u;
+	for ( int l=0;	l<4;	l++ )
+		Hash = (Hash ^ Lanes[l]) * 16777619u;
+	for ( int y=0;	y<Rows && SimdBytes<RowBytes;	y++ )
+	{
+		auto* Row = Pixels + (y*Pitch);
+		for ( int x=SimdBytes;	x<RowBytes;	x++ )
+			Hash = (Hash ^ Row[x]) * 16777619u;
+	}
+	return Hash;
+}
+
+void TFramePixels::UpdateTileHashes()
+{
+	int TilesWide = GetTileCount( GetWidth() );
+	int TilesHigh = GetTileCount( GetHeight() );
+	mTileHashes.SetSize( TilesWide * TilesHigh );
+	if ( !mPixels )
+	{
+		mTileHashes.Clear();
+		return;
+	}
+
+	int Channels = mMeta.GetChannels();
+	for ( int ty=0;	ty<TilesHigh;	ty++ )
+	{
+		int y = ty * FRAME_TILE_SIZE;
+		int Rows = ofMin( FRAME_TILE_SIZE, GetHeight() - y );
+		for ( int tx=0;	tx<TilesWide;	tx++ )
+		{
+			int x = tx * FRAME_TILE_SIZE;
+			int RowBytes = ofMin( FRAME_TILE_SIZE, GetWidth() - x ) * Channels;
+			mTileHashes[ty*TilesWide+tx] = HashTile( mPixels + (y*mPitch) + (x*Channels), mPitch, RowBytes, Rows );
+		}
+	}
+}
+
+//	one rect per row of tiles spanning the changed ones, merged with the row above when they line up
+void TFramePixels::GetChangedRects(Array<TFrameRect>& Rects,const TFrameMeta& Meta,const Array<uint32>& TileHashes,const Array<uint32>& OldTileHashes)
+{
+	Rects.Clear();
+	int TilesWide = GetTileCount( Meta.mWidth );
+	int TilesHigh = GetTileCount( Meta.mHeight );
+
+	//	can't compare, so all of it has changed
+	if ( TileHashes.GetSize() != TilesWide*TilesHigh || OldTileHashes.GetSize() != TileHashes.GetSize() )
+	{
+		Rects.PushBack( TFrameRect( 0, 0, Meta.mWidth, Meta.mHeight ) );
+		return;
+	}
+
+	for ( int ty=0;	ty<TilesHigh;	ty++ )
+	{
+		int First = -1;
+		int Last = -1;
+		for ( int tx=0;	tx<TilesWide;	tx++ )
+		{
+			int t = ty*TilesWide + tx;
+			if ( TileHashes[t] == OldTileHashes[t] )
+				continue;
+			if ( First < 0 )
+				First = tx;
+			Last = tx;
+		}
+		if ( First < 0 )
+			continue;
+
+		int x = First * FRAME_TILE_SIZE;
+		int y = ty * FRAME_TILE_SIZE;
+		TFrameRect Rect( x, y, ofMin( (Last+1)*FRAME_TILE_SIZE, Meta.mWidth ) - x, ofMin( FRAME_TILE_SIZE, Meta.mHeight - y ) );
+
+		if ( !Rects.IsEmpty() )
+		{
+			auto& Above = Rects[Rects.GetSize()-1];
+			if ( Above.mX == Rect.mX && Above.mWidth == Rect.mWidth && Above.mY + Above.mHeight == Rect.mY )
+			{
+				Above.mHeight += Rect.mHeight;
+				continue;
+			}
+		}
+		Rects.PushBack( Rect );
+	}
 }
 
 void TFramePixels::SetColour(const TColour& Colour)
@@ -210,11 +1171,12 @@ void TFramePixels::SetColour(const TColour& Colour)
 	//	see if we can do a faster method
 	if ( AllSame )
 	{
-		memset( mPixels.GetArray(), Components[0], mPixels.GetDataSize() );
+		memset( mPixels, Components[0], mDataSize );
 	}
 	else
 	{
-		for ( int i=0;	i<mPixels.GetSize();	i+=Channels )
+		//	padding is whole pixels so we can just fill it too
+		for ( int i=0;	i+Channels<=mDataSize;	i+=Channels )
 		{	
 			memcpy( &mPixels[i], Components.GetArray(), Channels );
 		}
@@ -2,6 +2,12 @@
 
 #include <ofxSoylent.h>
 #include <SoyThread.h>
+#include <atomic>
+
+
+#define FRAME_ROW_ALIGNMENT			64					//	cache line. Rows start on this boundary
+#define FRAME_HUGE_PAGE_MIN_SIZE	(2*1024*1024)		//	frames this big try to use huge pages to cut TLB misses
+#define FRAME_TILE_SIZE				64					//	pixels. Frames can be hashed per tile to find the regions that changed
 
 namespace TFrameFormat
 {
@@ -50,6 +56,35 @@ public:
 DECLARE_NONCOMPLEX_TYPE(TFrameMeta);
 
 
+class TFrameRect
+{
+public:
+	TFrameRect() :
+		mX		( 0 ),
+		mY		( 0 ),
+		mWidth	( 0 ),
+		mHeight	( 0 )
+	{
+	}
+	TFrameRect(int X,int Y,int Width,int Height) :
+		mX		( X ),
+		mY		( Y ),
+		mWidth	( Width ),
+		mHeight	( Height )
+	{
+	}
+
+	bool		IsValid() const		{	return mWidth>0 && mHeight>0;	}
+
+public:
+	int			mX;
+	int			mY;
+	int			mWidth;
+	int			mHeight;
+};
+DECLARE_NONCOMPLEX_TYPE(TFrameRect);
+
+
 class TColour
 {
 public:
@@ -89,51 +124,214 @@ public:
 DECLARE_NONCOMPLEX_NO_CONSTRUCT_TYPE(TColour);
 
 
+class TFrameQuota;
+class TUnityDevice;
+
 class TFramePixels
 {
 public:
 	TFramePixels(TFrameMeta Meta=TFrameMeta(),const char* Owner=nullptr);
+	TFramePixels(ofPtr<TUnityDevice> Device,TFrameMeta Meta,const char* Owner);	//	pixels live in one of the device's upload buffers
 	explicit TFramePixels(const TFramePixels& Other);
+	~TFramePixels();
+
+	TFramePixels&			operator=(const TFramePixels& That);	//	copies pixels, not pool state
 
+	void					SetMeta(const TFrameMeta& Meta);	//	reuse the buffer for a different shape with the same alloc size
 	void					SetColour(const TColour& Colour);
-	unsigned char*			GetData()			{	return mPixels.GetArray();	}
-	const unsigned char*	GetData() const		{	return mPixels.GetArray();	}
-	int						GetDataSize() const	{	return mPixels.GetDataSize();	}
-	int						GetPitch() const	{	return sizeof(uint8) * mMeta.mWidth * mMeta.GetChannels();	}
+	bool					CopyRows(unsigned char* Dst,int DstPitch,int DstSize) const;	//	copy to a buffer with a different pitch
+	bool					CopyRows(unsigned char* Dst,int DstPitch,int DstSize,const TFrameRect& DstRect) const;	//	copy into a region of a bigger buffer (clipped to the rect)
+	unsigned char*			GetData()			{	return mPixels;	}
+	const unsigned char*	GetData() const		{	return mPixels;	}
+	int						GetDataSize() const	{	return mDataSize;	}	//	includes row padding
+	int						GetPitch() const	{	return mPitch;	}		//	bytes between rows, padded to FRAME_ROW_ALIGNMENT
+	int						GetRowSize() const	{	return sizeof(uint8) * mMeta.mWidth * mMeta.GetChannels();	}
 	int						GetWidth() const	{	return mMeta.mWidth;	}
 	int						GetHeight() const	{	return mMeta.mHeight;	}
 	void					SetOwner(const char* Owner)	{	mDebugOwner = Owner;	}
+	bool					IsShared() const	{	return mRefCount > 1;	}
+	bool					IsMapped() const	{	return mMappedBuffer != nullptr;	}
+	bool					MapPixels();		//	point at the device's current mapping of our upload buffer
+	void					UpdateTileHashes();	//	hash each FRAME_TILE_SIZE tile so changes can be found without keeping the old pixels
+
+	static int				GetPaddedPitch(const TFrameMeta& Meta);
+	static int				GetAllocSize(const TFrameMeta& Meta)	{	return GetPaddedPitch(Meta) * Meta.mHeight;	}
+	static int				GetTileCount(int Pixels)				{	return (Pixels + FRAME_TILE_SIZE - 1) / FRAME_TILE_SIZE;	}
+	static void				GetChangedRects(Array<TFrameRect>& Rects,const TFrameMeta& Meta,const Array<uint32>& TileHashes,const Array<uint32>& OldTileHashes);	//	empty if nothing changed
+
+private:
+	void					AllocPixels(int DataSize);
+	void					FreePixels();
 	
 public:
 	BufferString<100>	mDebugOwner;		//	current owner
 	TFrameMeta			mMeta;
-	Array<uint8>		mPixels;
+	uint8*				mPixels;
+	int					mDataSize;
+	int					mAllocSize;	//	bytes actually allocated. Huge page allocations are rounded up to whole pages
+	int					mPitch;
+	bool				mHugePages;	//	allocated with the OS rather than the heap
 	SoyTime				mTimestamp;	//	frame since 0 
+	bool				mKeyframe;	//	decoder can start from this frame
+	uint64				mDecodedUs;		//	TPipelineTimer::GetTimeUs() when the decoder finished it, for latency histograms. 0 if not decoded
+	uint64				mBufferedUs;	//	when it went into the frame buffer(s)
+	std::atomic<int>	mRefCount;	//	consumers holding this frame. Shared frames must not be written to
+	int					mPoolIndex;	//	index in the pool's used list so we can release without searching. Locked by the pool
+	TFrameQuota*		mQuota;		//	instance this frame counts against. Locked by the pool
+	SoyTime				mFreeTime;	//	when this went back to the pool, so idle frames can be trimmed
+	ofPtr<TUnityDevice>	mMappedDevice;	//	owner of mMappedBuffer
+	void*				mMappedBuffer;	//	device dynamic texture our pixels alias. Tightly packed and write-only; only the device reads it
+	Array<uint32>		mTileHashes;	//	row-major tile hashes of these pixels. Empty if not hashed
 };
 
 
 
 
+//	frames with the same buffer size and alignment, whatever their dimensions or format,
+//	can reuse each other's pixel buffers
+class TFrameSizeClass
+{
+public:
+	TFrameSizeClass(int DataSize,int Alignment,bool Mapped) :
+		mDataSize		( DataSize ),
+		mAlignment		( Alignment ),
+		mMapped			( Mapped ),
+		mUsedCount		( 0 ),
+		mPreAllocated	( false )
+	{
+	}
+
+	bool					IsMatch(int DataSize,int Alignment,bool Mapped) const	{	return mDataSize==DataSize && mAlignment==Alignment && mMapped==Mapped;	}
+	int						GetAllocatedCount() const					{	return mFreeFrames.GetSize() + mUsedCount;	}
+
+public:
+	int						mDataSize;
+	int						mAlignment;
+	bool					mMapped;		//	frames in device upload buffers
+	int						mUsedCount;
+	bool					mPreAllocated;
+	Array<TFramePixels*>	mFreeFrames;
+};
+
+
+//	how many pool frames an instance may hold. Everyone gets a reservation that's always
+//	available to them, and can borrow from the unreserved overflow up to the high watermark.
+//	Once they hit it they can't borrow again until they've dropped to the low watermark.
+//	Limits are set by the pool, everything is locked by the pool.
+class TFrameQuota
+{
+public:
+	TFrameQuota(const char* Name) :
+		mName			( Name ),
+		mReserved		( 0 ),
+		mLowWatermark	( 0 ),
+		mHighWatermark	( 0 ),
+		mUsed			( 0 ),
+		mThrottled		( false )
+	{
+	}
+
+public:
+	BufferString<100>	mName;
+	int					mReserved;
+	int					mLowWatermark;
+	int					mHighWatermark;
+	std::atomic<int>	mUsed;			//	read without the pool lock for stats
+	bool				mThrottled;
+};
+
+
+//	for GetFramePoolStats, matches the c# struct
+struct TFramePoolStats
+{
+	uint64		mBudgetBytes;
+	uint64		mAllocatedBytes;	//	used and free
+	uint64		mUsedBytes;
+	uint64		mPeakBytes;			//	most we've had allocated
+	uint64		mIdleBytes;			//	free frames of sizes no-one is using; memory we're holding for nothing
+	int			mAllocatedFrames;
+	int			mUsedFrames;
+	int			mSizeClasses;
+	int			mAllocFailures;		//	out of budget or frames
+	int			mMappedFrames;		//	allocated in device upload buffers (included in mAllocatedFrames)
+};
+
+
 class TFramePool
 {
 public:
 	TFramePool(int MaxPoolSize);
+	~TFramePool();
 
-	TFramePixels*	Alloc(TFrameMeta FrameMeta,const char* Owner);	//	increase pool size
-	bool			Free(TFramePixels* pFrame);
+	TFramePixels*	Alloc(TFrameMeta FrameMeta,const char* Owner,TFrameQuota* Quota=nullptr,bool Mapped=false);	//	increase pool size. Mapped frames may come from device upload memory, so must only be read by the device
+	bool			Free(TFramePixels* pFrame);		//	release a reference, goes back to the free pool when nothing holds it
+	bool			Retain(TFramePixels* pFrame);	//	add a reference for another consumer. Caller must already hold one
 	bool			IsEmpty();						//	no used slots
 
 	void			DebugUsedFrames();
 
-	void			PreAlloc(TFrameMeta FrameMeta);	//	allocate all the frames if we havent already
+	void			AddQuota(TFrameQuota& Quota);		//	share the pool with another instance
+	void			RemoveQuota(TFrameQuota& Quota);
+
+	void			PreAlloc(TFrameMeta FrameMeta);	//	allocate some frames of this size if we haven't used it before
+
+	void			SetMappedFrameDevice(ofPtr<TUnityDevice> Device);	//	device to decode frames straight into the upload buffers of. null to stop
+	void			SetBudget(uint64 Bytes);		//	frees spare frames if we're over it
+	void			TrimIdleFrames();				//	give back frames that have been free for a while
+	void			GetStats(TFramePoolStats& Stats);
+	void			ResetStats();					//	peak back to what's allocated now, and no failures
+
+	static int		GetAlignment(const TFrameMeta& FrameMeta)	{	return FRAME_ROW_ALIGNMENT;	}
 
 private:
-	int				GetAllocatedCount();
+	int					GetAllocatedCount();
+	TFrameSizeClass*	GetSizeClass(int DataSize,int Alignment,bool Mapped,bool Create);
+	TFramePixels*		AllocMappedFrame(const TFrameMeta& FrameMeta,TFrameSizeClass*& SizeClass);
+	bool				ReclaimFrame(const TFrameSizeClass* ForSizeClass);	//	delete a free frame (of another size) to make room
+	bool				HasRoom(int DataSize);
+	void				DeleteFreeFrame(TFrameSizeClass& SizeClass,int FreeIndex);
+	bool				IsWithinQuota(TFrameQuota& Quota);
+	void				UpdateQuotas();
 
 protected:
-	int							mPoolMaxSize;
+	int							mPoolMaxSize;	//	frames of all sizes
+	uint64						mBudgetBytes;
+	uint64						mAllocatedBytes;
+	uint64						mPeakBytes;
+	int							mAllocFailures;
+	SoyTime						mLastTrimTime;
+	ofPtr<TUnityDevice>			mMappedDevice;
 	ofMutex						mPoolLock;
 	Array<TFramePixels*>		mUsedPool;
-	Array<TFramePixels*>		mFreePool;
+	Array<TFrameSizeClass*>		mSizeClasses;
+	Array<TFrameQuota*>			mQuotas;
 };
 DECLARE_NONCOMPLEX_NO_CONSTRUCT_TYPE( TFramePixels* );
+DECLARE_NONCOMPLEX_NO_CONSTRUCT_TYPE( TFrameSizeClass* );
+DECLARE_NONCOMPLEX_NO_CONSTRUCT_TYPE( TFrameQuota* );
+
+
+//	holds a reference to a pooled frame, released when the handle goes out of scope
+class TFrameRef
+{
+public:
+	TFrameRef() :
+		mFrame	( nullptr ),
+		mPool	( nullptr )
+	{
+	}
+	TFrameRef(TFramePixels* Frame,TFramePool& Pool);	//	adds a reference
+	TFrameRef(const TFrameRef& That);
+	~TFrameRef()				{	Release();	}
+
+	TFrameRef&			operator=(const TFrameRef& That);
+	TFramePixels*		operator->() const	{	return mFrame;	}
+	TFramePixels&		operator*() const	{	return *mFrame;	}
+	TFramePixels*		Get() const			{	return mFrame;	}
+	bool				IsValid() const		{	return mFrame != nullptr;	}
+	void				Release();
+
+private:
+	TFramePixels*		mFrame;
+	TFramePool*			mPool;
+};
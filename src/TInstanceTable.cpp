@@ -0,0 +1,155 @@
+#include "TInstanceTable.h"
+#include <SoyThread.h>
+
+
+namespace
+{
+	const uint64 SlotAlive	= 1ull << 31;
+	const uint64 SlotUsers	= SlotAlive - 1;
+
+	uint64	GetGeneration(uint64 State)				{	return State >> 32;	}
+	uint64	MakeHandle(uint64 Generation,int Slot)	{	return (Generation << 32) | static_cast<uint64>( Slot+1 );	}
+
+	//	-1 if out of range
+	int GetSlot(uint64 Handle)
+	{
+		auto Slot = static_cast<int64>( Handle & 0xffffffffull ) - 1;
+		if ( Slot < 0 || Slot >= INSTANCE_TABLE_SLOTS )
+			return -1;
+		return static_cast<int>( Slot );
+	}
+};
+
+
+TInstanceTable::TInstanceTable() :
+	mSlotsUsed	( 0 ),
+	mLiveCount	( 0 )
+{
+	for ( int i=0;	i<INSTANCE_TABLE_SLOTS;	i++ )
+	{
+		mSlots[i].mState = 1ull << 32;
+		mSlots[i].mInstance = nullptr;
+	}
+}
+
+uint64 TInstanceTable::Alloc(TFastTexture* Instance)
+{
+	if ( !Instance )
+		return 0;
+
+	ofMutex::ScopedLock Lock( mAllocLock );
+	int Slot = -1;
+	if ( !mFreeSlots.IsEmpty() )
+		Slot = mFreeSlots.PopBack();
+	else if ( mSlotsUsed.load() < INSTANCE_TABLE_SLOTS )
+		Slot = mSlotsUsed.load();
+	if ( Slot < 0 )
+		return 0;
+
+	//	dead slots have no users, so nothing else is writing the state
+	auto& TableSlot = mSlots[Slot];
+	uint64 Generation = GetGeneration( TableSlot.mState.load( std::memory_order_relaxed ) );
+	TableSlot.mInstance.store( Instance, std::memory_order_relaxed );
+	TableSlot.mState.store( (Generation << 32) | SlotAlive, std::memory_order_release );
+
+	//	publish the slot to walkers after it's alive
+	if ( Slot == mSlotsUsed.load() )
+		mSlotsUsed.store( Slot+1, std::memory_order_release );
+	mLiveCount++;
+
+	return MakeHandle( Generation, Slot );
+}
+
+bool TInstanceTable::Retire(uint64 Handle)
+{
+	int Slot = GetSlot( Handle );
+	if ( Slot < 0 )
+		return false;
+	auto& TableSlot = mSlots[Slot];
+	uint64 Generation = GetGeneration( Handle );
+
+	//	stop new lookups. Only one retire can win this
+	uint64 State = TableSlot.mState.load( std::memory_order_acquire );
+	while ( true )
+	{
+		if ( GetGeneration( State ) != Generation || !(State & SlotAlive) )
+			return false;
+		if ( TableSlot.mState.compare_exchange_weak( State, State & ~SlotAlive, std::memory_order_acq_rel ) )
+			return true;
+	}
+}
+
+TFastTexture* TInstanceTable::Reclaim(uint64 Handle)
+{
+	int Slot = GetSlot( Handle );
+	if ( Slot < 0 )
+		return nullptr;
+	auto& TableSlot = mSlots[Slot];
+	uint64 Generation = GetGeneration( Handle );
+
+	//	generation only moves on here, so a retired handle's slot is still ours
+	uint64 State = TableSlot.mState.load( std::memory_order_acquire );
+	if ( GetGeneration( State ) != Generation || (State & SlotAlive) )
+		return nullptr;
+
+	//	wait for current users (the render pass, other api calls) to finish with it
+	while ( TableSlot.mState.load( std::memory_order_acquire ) & SlotUsers )
+		ofThread::sleep(1);
+
+	auto* Instance = TableSlot.mInstance.exchange( nullptr, std::memory_order_relaxed );
+	TableSlot.mState.store( (Generation+1) << 32, std::memory_order_release );
+
+	ofMutex::ScopedLock Lock( mAllocLock );
+	mFreeSlots.PushBack( Slot );
+	mLiveCount--;
+	return Instance;
+}
+
+TFastTexture* TInstanceTable::Acquire(uint64 Handle)
+{
+	int Slot = GetSlot( Handle );
+	if ( Slot < 0 )
+		return nullptr;
+	auto& TableSlot = mSlots[Slot];
+	uint64 Generation = GetGeneration( Handle );
+
+	uint64 State = TableSlot.mState.load( std::memory_order_acquire );
+	while ( true )
+	{
+		if ( GetGeneration( State ) != Generation || !(State & SlotAlive) )
+			return nullptr;
+		if ( (State & SlotUsers) == SlotUsers )
+			return nullptr;
+		if ( TableSlot.mState.compare_exchange_weak( State, State+1, std::memory_order_acquire ) )
+			break;
+	}
+	return TableSlot.mInstance.load( std::memory_order_relaxed );
+}
+
+TFastTexture* TInstanceTable::AcquireSlot(int Slot,uint64& Handle)
+{
+	if ( Slot < 0 || Slot >= INSTANCE_TABLE_SLOTS )
+		return nullptr;
+
+	uint64 State = mSlots[Slot].mState.load( std::memory_order_acquire );
+	if ( !(State & SlotAlive) )
+		return nullptr;
+
+	//	if it's freed and reused in between, this fails on the generation, which is fine for a walk
+	Handle = MakeHandle( GetGeneration( State ), Slot );
+	return Acquire( Handle );
+}
+
+void TInstanceTable::Release(uint64 Handle)
+{
+	int Slot = GetSlot( Handle );
+	if ( Slot < 0 )
+		return;
+	mSlots[Slot].mState.fetch_sub( 1, std::memory_order_release );
+}
+
+int TInstanceTable::GetLiveCount()
+{
+	ofMutex::ScopedLock Lock( mAllocLock );
+	return mLiveCount;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <ofxSoylent.h>
+#include <atomic>
+
+#define INSTANCE_TABLE_SLOTS	1024	//	live instances at once. Freed slots are reused with a new generation
+
+class TFastTexture;
+
+
+//	handles for the exported api. A handle is the slot (+1 so it's never 0) in the low 32 bits and the
+//	slot's generation in the high 32 bits, so a lookup is an index and a stale handle fails instead of
+//	finding whatever reused the slot.
+//	Each slot's state is one atomic; generation, alive, and a count of threads using the instance.
+//	Lookups only touch that, so they never wait on the render thread (or each other). Retire marks the
+//	slot dead so no new lookups succeed, then Reclaim waits for the count to drain before the instance is
+//	deleted and the slot reused
+class TInstanceTable
+{
+public:
+	TInstanceTable();
+
+	uint64				Alloc(TFastTexture* Instance);	//	0 if the table is full
+	bool				Retire(uint64 Handle);			//	lookups fail from now on, but the slot isn't reused until it's reclaimed. false if not a live handle
+	TFastTexture*		Reclaim(uint64 Handle);			//	waits for current users of a retired handle to release it, then the caller deletes it. Don't call while holding a ref to it
+	TFastTexture*		Acquire(uint64 Handle);			//	can't be freed until released. null if stale
+	TFastTexture*		AcquireSlot(int Slot,uint64& Handle);	//	for walking the table
+	void				Release(uint64 Handle);
+	int					GetSlotCount() const	{	return mSlotsUsed.load( std::memory_order_acquire );	}	//	walk up to this
+	int					GetLiveCount();					//	includes retired instances that haven't been reclaimed
+
+private:
+	class TSlot
+	{
+	public:
+		std::atomic<uint64>			mState;	//	generation << 32 | alive | users
+		std::atomic<TFastTexture*>	mInstance;
+	};
+
+private:
+	TSlot				mSlots[INSTANCE_TABLE_SLOTS];
+	std::atomic<int>	mSlotsUsed;
+	ofMutex				mAllocLock;		//	alloc and reclaim only; lookups never take it
+	Array<int>			mFreeSlots;
+	int					mLiveCount;
+};
+
+
+//	keeps an instance alive for a scope
+class TInstanceRef
+{
+public:
+	TInstanceRef(TInstanceTable& Table,uint64 Handle) :
+		mTable		( Table ),
+		mHandle		( Handle ),
+		mInstance	( Table.Acquire( Handle ) )
+	{
+	}
+	~TInstanceRef()
+	{
+		if ( mInstance )
+			mTable.Release( mHandle );
+	}
+
+	TFastTexture*		Get() const				{	return mInstance;	}
+	TFastTexture*		operator->() const		{	return mInstance;	}
+	TFastTexture&		operator*() const		{	return *mInstance;	}
+	bool				operator!() const		{	return mInstance == nullptr;	}
+
+private:
+	TInstanceRef(const TInstanceRef& That);
+	TInstanceRef&		operator=(const TInstanceRef& That);
+
+private:
+	TInstanceTable&		mTable;
+	uint64				mHandle;
+	TFastTexture*		mInstance;
+};
@@ -0,0 +1,101 @@
+#include "TLogQueue.h"
+#include <cstring>
+
+
+namespace
+{
+	//	returns the end of what's been written
+	char* AppendString(char* Dest,const char* DestEnd,const char* String)
+	{
+		while ( Dest < DestEnd && *String )
+			*Dest++ = *String++;
+		return Dest;
+	}
+};
+
+
+TLogQueue::TLogQueue() :
+	mWritePos	( 0 ),
+	mReadPos	( 0 ),
+	mDropped	( 0 )
+{
+	for ( int i=0;	i<LOG_QUEUE_SLOTS;	i++ )
+	{
+		mSlots[i].mSequence = i;
+		mSlots[i].mMessage[0] = '\0';
+	}
+}
+
+bool TLogQueue::Push(const char* String,const char* Prefix)
+{
+	//	claim the next position, unless the reader hasn't finished with that slot yet
+	uint64 Pos = mWritePos.load( std::memory_order_relaxed );
+	TSlot* Slot = nullptr;
+	while ( true )
+	{
+		Slot = &mSlots[ Pos % LOG_QUEUE_SLOTS ];
+		uint64 Sequence = Slot->mSequence.load( std::memory_order_acquire );
+		auto Diff = static_cast<int64>( Sequence ) - static_cast<int64>( Pos );
+		if ( Diff == 0 )
+		{
+			if ( mWritePos.compare_exchange_weak( Pos, Pos+1, std::memory_order_relaxed ) )
+				break;
+		}
+		else if ( Diff < 0 )
+		{
+			//	full
+			mDropped.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		}
+		else
+		{
+			//	another writer got it first
+			Pos = mWritePos.load( std::memory_order_relaxed );
+		}
+	}
+
+	char* Dest = Slot->mMessage;
+	const char* DestEnd = Dest + LOG_MESSAGE_LENGTH - 1;
+	if ( Prefix )
+	{
+		Dest = AppendString( Dest, DestEnd, "[" );
+		Dest = AppendString( Dest, DestEnd, Prefix );
+		Dest = AppendString( Dest, DestEnd, "] " );
+	}
+	Dest = AppendString( Dest, DestEnd, String ? String : "" );
+	*Dest = '\0';
+
+	Slot->mSequence.store( Pos+1, std::memory_order_release );
+	return true;
+}
+
+bool TLogQueue::Pop(char* String)
+{
+	uint64 Pos = mReadPos.load( std::memory_order_relaxed );
+	TSlot* Slot = nullptr;
+	while ( true )
+	{
+		Slot = &mSlots[ Pos % LOG_QUEUE_SLOTS ];
+		uint64 Sequence = Slot->mSequence.load( std::memory_order_acquire );
+		auto Diff = static_cast<int64>( Sequence ) - static_cast<int64>( Pos+1 );
+		if ( Diff == 0 )
+		{
+			if ( mReadPos.compare_exchange_weak( Pos, Pos+1, std::memory_order_relaxed ) )
+				break;
+		}
+		else if ( Diff < 0 )
+		{
+			//	empty, or the next message is still being written
+			return false;
+		}
+		else
+		{
+			Pos = mReadPos.load( std::memory_order_relaxed );
+		}
+	}
+
+	//	copy out so the slot is free again before the message is printed (which may log again)
+	memcpy( String, Slot->mMessage, LOG_MESSAGE_LENGTH );
+	Slot->mSequence.store( Pos + LOG_QUEUE_SLOTS, std::memory_order_release );
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ofxSoylent.h>
+#include <atomic>
+
+#define LOG_QUEUE_SLOTS			512		//	messages waiting for the render thread; more than this are dropped
+#define LOG_MESSAGE_LENGTH		200		//	including the terminator; longer messages are cut short
+
+
+//	bounded lock-free queue of log messages. Any thread can push without blocking or allocating;
+//	messages are copied into pre-allocated slots, and dropped (and counted) when the queue is full.
+//	Slots carry a sequence number so pushes and pops only contend on their own position counter
+class TLogQueue
+{
+public:
+	TLogQueue();
+
+	bool				Push(const char* String,const char* Prefix=nullptr);	//	false if it was dropped
+	bool				Pop(char* String);		//	LOG_MESSAGE_LENGTH buffer. false if empty
+	uint64				GetDroppedCount() const	{	return mDropped.load( std::memory_order_relaxed );	}
+
+private:
+	class TSlot
+	{
+	public:
+		std::atomic<uint64>	mSequence;	//	== position when free to write, position+1 when written
+		char				mMessage[LOG_MESSAGE_LENGTH];
+	};
+
+private:
+	TSlot				mSlots[LOG_QUEUE_SLOTS];
+	std::atomic<uint64>	mWritePos;
+	std::atomic<uint64>	mReadPos;
+	std::atomic<uint64>	mDropped;
+};
@@ -0,0 +1,249 @@
+#include "TTrace.h"
+#include <SoyThread.h>
+#include <chrono>
+#include <sstream>
+
+
+namespace Trace
+{
+	//	written by the ring's thread only. mSequence is set last so a reader can tell if it raced the writer
+	class TEvent
+	{
+	public:
+		std::atomic<uint64>	mSequence;
+		uint64				mStartUs;
+		uint64				mDurationUs;
+		uint32				mThreadId;
+		char				mName[TRACE_NAME_LENGTH];
+	};
+
+	class TRing
+	{
+	public:
+		TRing() :
+			mInUse			( false ),
+			mThreadId		( 0 ),
+			mThreadName		( "Thread" ),
+			mWriteIndex		( 0 ),
+			mClearedIndex	( 0 )
+		{
+			for ( int i=0;	i<TRACE_RING_EVENTS;	i++ )
+				mEvents[i].mSequence = ~0ull;
+		}
+
+	public:
+		std::atomic<bool>	mInUse;
+		uint32				mThreadId;		//	changes when the ring is reused
+		BufferString<100>	mThreadName;	//	of mThreadId, overwritten when the ring is reused. Locked by gLock
+		std::atomic<uint64>	mWriteIndex;
+		std::atomic<uint64>	mClearedIndex;	//	events before this have been cleared
+		TEvent				mEvents[TRACE_RING_EVENTS];
+	};
+
+	TRing*					ClaimRing();
+	void					SetRingName(TRing& Ring,const char* Name);	//	caller must lock gLock
+	void					WriteEscaped(std::ostream& Stream,const char* String);
+
+	std::atomic<bool>		gEnabled( false );
+	const std::chrono::steady_clock::time_point	gEpoch = std::chrono::steady_clock::now();
+	std::atomic<TRing*>		gRings[TRACE_MAX_THREADS];
+	std::atomic<uint64>		gDroppedEvents( 0 );	//	threads that couldn't get a ring
+	ofMutex					gLock;					//	claiming rings and thread names; never on the hot path
+	uint32					gNextThreadId = 1;
+
+	TRACE_THREAD_LOCAL TRing*		gThreadRing = nullptr;
+	TRACE_THREAD_LOCAL const char*	gThreadName = nullptr;
+};
+
+
+void Trace::SetEnabled(bool Enable)
+{
+	gEnabled = Enable;
+}
+
+uint64 Trace::GetTimeUs()
+{
+	return static_cast<uint64>( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - gEpoch ).count() );
+}
+
+void Trace::CopyName(char* Dest,const char* Name)
+{
+	if ( !Name )
+		Name = "";
+	int i = 0;
+	for ( ;	i<TRACE_NAME_LENGTH-1 && Name[i];	i++ )
+		Dest[i] = Name[i];
+	Dest[i] = '\0';
+}
+
+void Trace::Clear()
+{
+	ofMutex::ScopedLock Lock( gLock );
+	for ( int r=0;	r<TRACE_MAX_THREADS;	r++ )
+	{
+		auto* Ring = gRings[r].load();
+		if ( Ring )
+			Ring->mClearedIndex = Ring->mWriteIndex.load();
+	}
+	gDroppedEvents = 0;
+}
+
+Trace::TRing* Trace::ClaimRing()
+{
+	ofMutex::ScopedLock Lock( gLock );
+
+	//	reuse the ring of a thread that's finished, or make a new one
+	TRing* Ring = nullptr;
+	for ( int r=0;	r<TRACE_MAX_THREADS && !Ring;	r++ )
+	{
+		auto* ExistingRing = gRings[r].load();
+		if ( !ExistingRing )
+		{
+			Ring = new TRing();
+			gRings[r] = Ring;
+		}
+		else if ( !ExistingRing->mInUse )
+		{
+			Ring = ExistingRing;
+		}
+	}
+	if ( !Ring )
+		return nullptr;
+
+	//	events keep the old thread's id, so it's fine to reuse without clearing
+	Ring->mInUse = true;
+	Ring->mThreadId = gNextThreadId++;
+	SetRingName( *Ring, gThreadName );
+	return Ring;
+}
+
+void Trace::SetRingName(TRing& Ring,const char* Name)
+{
+	Ring.mThreadName = Name ? Name : "Thread";
+}
+
+void Trace::SetThreadName(const char* Name)
+{
+	if ( gThreadName == Name )
+		return;
+	gThreadName = Name;
+
+	//	already got a ring under another name
+	if ( gThreadRing )
+	{
+		ofMutex::ScopedLock Lock( gLock );
+		SetRingName( *gThreadRing, Name );
+	}
+}
+
+Trace::TThread::~TThread()
+{
+	if ( !gThreadRing )
+		return;
+
+	gThreadRing->mInUse = false;
+	gThreadRing = nullptr;
+	gThreadName = nullptr;
+}
+
+void Trace::AddEvent(const char* Name,uint64 StartUs,uint64 EndUs)
+{
+	if ( !IsEnabled() )
+		return;
+
+	if ( !gThreadRing )
+	{
+		gThreadRing = ClaimRing();
+		if ( !gThreadRing )
+		{
+			gDroppedEvents++;
+			return;
+		}
+	}
+
+	auto& Ring = *gThreadRing;
+	uint64 Index = Ring.mWriteIndex.load( std::memory_order_relaxed );
+	auto& Event = Ring.mEvents[ Index % TRACE_RING_EVENTS ];
+
+	//	invalidate first, so a reader doesn't take a half written event for the old one
+	Event.mSequence.store( ~0ull, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	Event.mStartUs = StartUs;
+	Event.mDurationUs = EndUs > StartUs ? EndUs - StartUs : 0;
+	Event.mThreadId = Ring.mThreadId;
+	CopyName( Event.mName, Name );
+	Event.mSequence.store( Index, std::memory_order_release );
+	Ring.mWriteIndex.store( Index+1, std::memory_order_release );
+}
+
+void Trace::WriteEscaped(std::ostream& Stream,const char* String)
+{
+	Stream << '"';
+	for ( const char* c=String;	*c;	c++ )
+	{
+		if ( *c == '"' || *c == '\\' )
+			Stream << '\\';
+		if ( static_cast<unsigned char>(*c) < ' ' )
+			continue;
+		Stream << *c;
+	}
+	Stream << '"';
+}
+
+//	complete ("X") events rather than begin/end pairs; scopes don't always end in the order they started
+void Trace::GetJson(std::string& Json)
+{
+	std::stringstream Stream;
+	Stream << "{\"traceEvents\":[\n";
+	bool First = true;
+
+	ofMutex::ScopedLock Lock( gLock );
+	for ( int r=0;	r<TRACE_MAX_THREADS;	r++ )
+	{
+		auto* Ring = gRings[r].load();
+		if ( !Ring )
+			continue;
+
+		uint64 End = Ring->mWriteIndex.load( std::memory_order_acquire );
+		uint64 Start = End > TRACE_RING_EVENTS ? End - TRACE_RING_EVENTS : 0;
+		Start = ofMax( Start, Ring->mClearedIndex.load() );
+
+		for ( uint64 i=Start;	i<End;	i++ )
+		{
+			auto& Event = Ring->mEvents[ i % TRACE_RING_EVENTS ];
+			if ( Event.mSequence.load( std::memory_order_acquire ) != i )
+				continue;
+
+			TEvent Copy;
+			Copy.mStartUs = Event.mStartUs;
+			Copy.mDurationUs = Event.mDurationUs;
+			Copy.mThreadId = Event.mThreadId;
+			CopyName( Copy.mName, Event.mName );
+
+			//	overwritten while we copied it
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if ( Event.mSequence.load( std::memory_order_relaxed ) != i )
+				continue;
+
+			Stream << (First ? "" : ",\n") << "{\"name\":";
+			WriteEscaped( Stream, Copy.mName );
+			Stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << Copy.mThreadId << ",\"ts\":" << Copy.mStartUs << ",\"dur\":" << Copy.mDurationUs << "}";
+			First = false;
+		}
+	}
+
+	//	one name per ring, its current thread's. Events left in a reused ring by the thread before show by id
+	for ( int r=0;	r<TRACE_MAX_THREADS;	r++ )
+	{
+		auto* Ring = gRings[r].load();
+		if ( !Ring || Ring->mThreadId == 0 )
+			continue;
+		Stream << (First ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << Ring->mThreadId << ",\"args\":{\"name\":";
+		WriteEscaped( Stream, Ring->mThreadName.c_str() );
+		Stream << "}}";
+		First = false;
+	}
+
+	Stream << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << gDroppedEvents.load() << "}}\n";
+	Json = Stream.str();
+}
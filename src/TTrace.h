@@ -0,0 +1,41 @@
+#pragma once
+
+#include <ofxSoylent.h>
+#include <atomic>
+#include <string>
+
+#define TRACE_RING_EVENTS		4096	//	per thread; the oldest are overwritten
+#define TRACE_MAX_THREADS		64		//	rings are reused when a named thread (TThread) exits. Threads after this aren't traced
+#define TRACE_NAME_LENGTH		48
+
+#if defined(TARGET_WINDOWS)
+	#define TRACE_THREAD_LOCAL	__declspec(thread)
+#else
+	#define TRACE_THREAD_LOCAL	__thread
+#endif
+
+
+//	records timed scopes (TScopeTimerWarning) into a lock-free ring per thread, dumped as chrome trace
+//	event json (chrome://tracing) to see the decode, convert and upload threads overlapping.
+//	When disabled a scope costs an atomic load.
+namespace Trace
+{
+	extern std::atomic<bool>	gEnabled;
+
+	inline bool		IsEnabled()			{	return gEnabled.load( std::memory_order_relaxed );	}
+	void			SetEnabled(bool Enable);
+	void			Clear();
+	uint64			GetTimeUs();		//	since the plugin loaded
+	void			CopyName(char* Dest,const char* Name);	//	TRACE_NAME_LENGTH buffer
+	void			AddEvent(const char* Name,uint64 StartUs,uint64 EndUs);
+	void			SetThreadName(const char* Name);	//	must outlive the thread (a literal)
+	void			GetJson(std::string& Json);
+
+	//	names the thread for the trace, and gives its ring back when it exits
+	class TThread
+	{
+	public:
+		explicit TThread(const char* Name)	{	SetThreadName( Name );	}
+		~TThread();
+	};
+};
@@ -308,16 +308,15 @@ bool TUnityDevice_Dx11::CopyTexture(Unity::TTexture TextureU,const TFramePixels&
 		}
 
 		int ResourceDataSize = resource.RowPitch * SrcDesc.Height;//	width in bytes
-		if ( Frame.GetDataSize() != ResourceDataSize )
+		if ( Frame.GetRowSize() > static_cast<int>(resource.RowPitch) || Frame.GetHeight() != static_cast<int>(SrcDesc.Height) )
 		{
 			BufferString<1000> Debug;
-			Debug << "Warning: resource/texture data size mismatch; " << Frame.GetDataSize() << " (frame) vs " << ResourceDataSize << " (resource)";
+			Debug << "Warning: resource/texture size mismatch; " << Frame.GetRowSize() << "x" << Frame.GetHeight() << " (frame) vs " << resource.RowPitch << "x" << SrcDesc.Height << " (resource)";
 			Unity::DebugError(Debug);
-			ResourceDataSize = ofMin( ResourceDataSize, Frame.GetDataSize() );
 		}
 
-		//	update contents 
-		memcpy( resource.pData, Frame.GetData(), ResourceDataSize );
+		//	update contents. Frame rows are padded so may not match the resource pitch
+		Frame.CopyRows( static_cast<unsigned char*>( resource.pData ), resource.RowPitch, ResourceDataSize );
 		ctx->Unmap( Texture, SubResource);
 	}
 
@@ -368,6 +367,99 @@ bool TUnityDevice_Dx11::CopyTexture(Unity::TTexture DstTextureU,Unity::TDynamicT
 #endif
 
 
+#if defined(ENABLE_DX11)
+bool TUnityDevice_Dx11::CopyTexture(Unity::TTexture DstTextureU,Unity::TDynamicTexture SrcTextureU,const Array<TFrameRect>& Rects)
+{
+	auto* DstTexture = static_cast<Unity::TTexture_Dx11&>( DstTextureU ).GetTexture();
+	auto* SrcTexture = static_cast<Unity::TDynamicTexture_Dx11&>( SrcTextureU ).GetTexture();
+	if ( !DstTexture || !SrcTexture )
+		return false;
+
+	auto& Device11 = GetDevice();
+	TUnityDeviceContextScope Context( *this );
+	if ( !Context )
+		return false;
+
+	TAutoRelease<ID3D11DeviceContext> ctx;
+	Device11.GetImmediateContext( &ctx.mObject );
+	if ( !ctx )
+	{
+		Unity::DebugError("Failed to get device context");
+		return false;
+	}	
+
+	for ( int r=0;	r<Rects.GetSize();	r++ )
+	{
+		auto& Rect = Rects[r];
+		D3D11_BOX Box;
+		Box.left = Rect.mX;
+		Box.top = Rect.mY;
+		Box.front = 0;
+		Box.right = Rect.mX + Rect.mWidth;
+		Box.bottom = Rect.mY + Rect.mHeight;
+		Box.back = 1;
+		ctx->CopySubresourceRegion( DstTexture, 0, Rect.mX, Rect.mY, 0, SrcTexture, 0, &Box );
+	}
+
+	return true;
+}
+#endif
+
+
+#if defined(ENABLE_DX11)
+bool TUnityDevice_Dx11::CopyTexture(Unity::TDynamicTexture TextureU,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking)
+{
+	auto* Texture = static_cast<Unity::TDynamicTexture_Dx11&>( TextureU ).GetTexture();
+	if ( !Texture || Frames.GetSize() != Rects.GetSize() )
+		return false;
+
+	auto& Device11 = GetDevice();
+	TUnityDeviceContextScope Context( *this );
+	if ( !Context )
+		return false;
+
+	TAutoRelease<ID3D11DeviceContext> ctx;
+	Device11.GetImmediateContext( &ctx.mObject );
+	if ( !ctx )
+	{
+		Unity::DebugError("Failed to get device context");
+		return false;
+	}
+
+	Unity::TScopeTimerWarning MapTimer("DX::Map batch copy",2);
+
+	D3D11_TEXTURE2D_DESC Desc;
+	Texture->GetDesc(&Desc);
+
+	//	discard loses the regions we aren't writing, but only these regions get copied to the target
+	D3D11_MAPPED_SUBRESOURCE resource;
+	ZeroMemory( &resource, sizeof(resource) );
+	int SubResource = 0;
+	HRESULT hr = ctx->Map( Texture, SubResource, D3D11_MAP_WRITE_DISCARD, 0x0, &resource );
+	if ( !Blocking && hr == DXGI_ERROR_WAS_STILL_DRAWING )
+		return false;
+	if ( hr != S_OK )
+	{
+		BufferString<1000> Debug;
+		Debug << "Failed to get Map() for dynamic texture(" << Desc.Width << "," << Desc.Height << "); Error; " << hr;
+		Unity::DebugError(Debug);
+		return false;
+	}
+
+	int ResourceDataSize = resource.RowPitch * Desc.Height;
+	bool Success = true;
+	for ( int i=0;	i<Frames.GetSize();	i++ )
+	{
+		if ( !Frames[i]->CopyRows( static_cast<unsigned char*>( resource.pData ), resource.RowPitch, ResourceDataSize, Rects[i] ) )
+			Success = false;
+	}
+	ctx->Unmap( Texture, SubResource );
+
+	return Success;
+}
+#endif
+
+
 
 #if defined(ENABLE_OPENGL)
 bool Unity::TTexture_Opengl::Bind(TUnityDevice_Opengl& Device)
@@ -446,7 +538,9 @@ Unity::TTexture TUnityDevice_Opengl::AllocTexture(TFrameMeta FrameMeta)
 	//	initialise to set dimensions
 	TFramePixels InitFramePixels( FrameMeta );
 	InitFramePixels.SetColour( HARDWARE_INIT_TEXTURE_COLOUR );
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, InitFramePixels.GetPitch() / FrameMeta.GetChannels() );
 	glTexImage2D( GL_TEXTURE_2D, 0, Format, FrameMeta.mWidth, FrameMeta.mHeight, 0, Format, GL_UNSIGNED_BYTE, InitFramePixels.GetData() );
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
 	if ( HasError() )
 	{
 		DeleteTexture( Texture );
@@ -510,6 +604,17 @@ bool TUnityDevice_Opengl::AllocDynamicTexture(TOpenglBufferCache& Buffer)
 	if ( !Bind(Buffer) )
 		return false;
 
+	//	mapped once, for good
+	if ( AllocPersistentStorage( Buffer ) )
+	{
+		Unbind( Buffer );
+		return true;
+	}
+
+	//	persistent storage failed and took the buffer with it, we'll fall back next time
+	if ( !Buffer.IsAllocated() )
+		return false;
+
 	//	init buffer storage
 	auto Usage = OPENGL_USE_STREAM_TEXTURE ? GL_STREAM_DRAW : GL_DYNAMIC_DRAW;
 	glBufferData( GL_PIXEL_UNPACK_BUFFER, FrameMeta.GetDataSize(), nullptr, Usage );
@@ -525,6 +630,49 @@ bool TUnityDevice_Opengl::AllocDynamicTexture(TOpenglBufferCache& Buffer)
 }
 #endif
 
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::SupportsPersistentMap()
+{
+	if ( !OPENGL_PERSISTENT_MAP )
+		return false;
+
+	//	need fences to know when we can write again
+	return glewIsSupported("GL_ARB_buffer_storage") && glewIsSupported("GL_ARB_sync");
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::AllocPersistentStorage(TOpenglBufferCache& Buffer)
+{
+	if ( !SupportsPersistentMap() )
+		return false;
+
+	//	coherent, so writes are seen by the gpu without flushing
+	GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBufferStorage( GL_PIXEL_UNPACK_BUFFER, Buffer.GetSize(), nullptr, Flags );
+	if ( HasError() )
+		return false;
+
+	Buffer.mDataMap = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, Buffer.GetSize(), Flags );
+	if ( !Buffer.mDataMap || HasError() )
+	{
+		//	storage is immutable, so this buffer can't fall back to glBufferData
+		Buffer.mDataMap = nullptr;
+		glDeleteBuffers( 1, &Buffer.mBufferName );
+		Buffer.mBufferName = GL_INVALID_BUFFER_NAME;
+		OPENGL_PERSISTENT_MAP = false;
+		Unity::DebugError("Failed to persistently map dynamic texture, falling back to map/unmap");
+		return false;
+	}
+
+	Buffer.mPersistent = true;
+	Buffer.mMapRequested = false;
+	return true;
+}
+#endif
+
+
 #if defined(ENABLE_OPENGL)
 bool TUnityDevice_Opengl::Bind(Unity::TDynamicTexture& Texture)
 {
@@ -651,7 +799,9 @@ bool TUnityDevice_Opengl::CopyTexture(Unity::TTexture Texture,const TFramePixels
 		GLint Format = GetFormat( Frame.mMeta.mFormat );
 		GLint InternalFormat = GL_BGRA;
 		GLenum InternalStorage = GL_UNSIGNED_INT_8_8_8_8_REV;
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, PixelsBuffer.GetPitch() / PixelsBuffer.mMeta.GetChannels() );
 		glTexImage2D(GL_TEXTURE_2D, Lod, Format, PixelsBuffer.GetWidth(), PixelsBuffer.GetHeight(), 0, InternalFormat, InternalStorage, PixelsBuffer.GetData() );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
 		
 		if ( HasError() )
 			return false;
@@ -659,7 +809,10 @@ bool TUnityDevice_Opengl::CopyTexture(Unity::TTexture Texture,const TFramePixels
 	else
 	{
 		GLint Format = GetFormat( Frame.mMeta.mFormat );
+		//	frame rows are padded
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, Frame.GetPitch() / Frame.mMeta.GetChannels() );
 		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, Frame.GetWidth(), Frame.GetHeight(), Format, GL_UNSIGNED_BYTE, Frame.GetData() );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
 		if ( HasError() )
 			return false;
 	}
@@ -724,6 +877,10 @@ bool TUnityDevice_Opengl::FreeMap(TOpenglBufferCache& Buffer)
 	if ( !Buffer.mDataMap )
 		return true;
 
+	//	stays mapped, fences keep the gpu and writers apart
+	if ( Buffer.mPersistent )
+		return true;
+
 	//	out of thread
 	TUnityDeviceContextScope Context( *this );
 	if ( !Context )
@@ -771,9 +928,10 @@ bool TUnityDevice_Opengl::CopyTexture(Unity::TDynamicTexture Texture,const TFram
 	if ( !AllocMap( *Buffer ) )
 		return false;
 
-	//	gr: do safety check here
-	int DataSize = ofMin( Frame.GetDataSize(), Buffer->mBufferMeta.GetDataSize() );
-	memcpy( Buffer->mDataMap, Frame.GetData(), DataSize );
+	//	buffer is tightly packed, frame rows are padded
+	auto& BufferMeta = Buffer->mBufferMeta;
+	int BufferPitch = BufferMeta.mWidth * BufferMeta.GetChannels();
+	Frame.CopyRows( static_cast<unsigned char*>( Buffer->mDataMap ), BufferPitch, BufferMeta.GetDataSize() );
 
 	//	umap if in render thread?
 	//FreeMap( Buffer );
@@ -784,7 +942,121 @@ bool TUnityDevice_Opengl::CopyTexture(Unity::TDynamicTexture Texture,const TFram
 
 
 #if defined(ENABLE_OPENGL)
-bool TUnityDevice_Opengl::CopyTexture(Unity::TTexture DstTextureU,Unity::TDynamicTexture SrcTextureU)
+bool TUnityDevice_Opengl::CopyTexture(Unity::TDynamicTexture Texture,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking)
+{
+	if ( Frames.GetSize() != Rects.GetSize() )
+		return false;
+
+	ofMutex::ScopedLock lock( mBufferCache );
+	auto* Buffer = mBufferCache.Find( Texture.GetInteger() );
+	if ( !Buffer )
+		return false;
+	
+	AllocDynamicTexture( *Buffer );
+	if ( !Buffer->IsAllocated() )
+		return false;
+
+	//	gpu is still reading the last batch out of it
+	if ( Buffer->mCopyFence )
+		return false;
+
+	if ( !AllocMap( *Buffer ) )
+		return false;
+
+	//	map isn't invalidated, so regions we don't write keep their contents
+	auto& BufferMeta = Buffer->mBufferMeta;
+	int BufferPitch = BufferMeta.mWidth * BufferMeta.GetChannels();
+	bool Success = true;
+	for ( int i=0;	i<Frames.GetSize();	i++ )
+	{
+		if ( !Frames[i]->CopyRows( static_cast<unsigned char*>( Buffer->mDataMap ), BufferPitch, BufferMeta.GetDataSize(), Rects[i] ) )
+			Success = false;
+	}
+
+	return Success;
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+uint8* TUnityDevice_Opengl::GetMappedData(Unity::TDynamicTexture Texture)
+{
+	ofMutex::ScopedLock lock( mBufferCache );
+	auto* Buffer = mBufferCache.Find( Texture.GetInteger() );
+	if ( !Buffer || Buffer->mDeleteRequested )
+		return nullptr;
+
+	//	gpu is still reading the last frame out of it
+	if ( Buffer->mCopyFence )
+		return nullptr;
+
+	//	can only map in the render thread, so it'll be ready next time
+	if ( !Buffer->IsMapped() )
+	{
+		AllocMap( *Buffer );
+		return nullptr;
+	}
+
+	return static_cast<uint8*>( Buffer->mDataMap );
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::IsCopyComplete(Unity::TDynamicTexture Texture)
+{
+	ofMutex::ScopedLock lock( mBufferCache );
+	auto* Buffer = mBufferCache.Find( Texture.GetInteger() );
+	if ( !Buffer )
+		return true;
+
+	//	fences are checked in the render thread
+	return Buffer->mCopyFence == nullptr;
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::UpdateCopyFence(TOpenglBufferCache& Buffer)
+{
+	if ( !Buffer.mCopyFence )
+		return true;
+
+	TUnityDeviceContextScope Context( *this );
+	if ( !Context )
+		return false;
+
+	//	don't wait, just poll
+	auto Result = glClientWaitSync( Buffer.mCopyFence, 0, 0 );
+	if ( Result == GL_TIMEOUT_EXPIRED )
+		return false;
+
+	//	GL_WAIT_FAILED is as done as it's going to get
+	glDeleteSync( Buffer.mCopyFence );
+	Buffer.mCopyFence = nullptr;
+	return true;
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture)
+{
+	return CopyBufferToTexture( DstTexture, SrcTexture, nullptr );
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>& Rects)
+{
+	return CopyBufferToTexture( DstTexture, SrcTexture, &Rects );
+}
+#endif
+
+
+#if defined(ENABLE_OPENGL)
+bool TUnityDevice_Opengl::CopyBufferToTexture(Unity::TTexture DstTextureU,Unity::TDynamicTexture SrcTextureU,const Array<TFrameRect>* Rects)
 {
 	Unity::TScopeTimerWarning Timer(__FUNCTION__,1);
 	TUnityDeviceContextScope Context( *this );
@@ -812,14 +1084,42 @@ bool TUnityDevice_Opengl::CopyTexture(Unity::TTexture DstTextureU,Unity::TDynami
 	auto Format = GetFormat( TextureMeta.mFormat );
 	{
 		Unity::TScopeTimerWarning timer_glTexSubImage2D("glTexSubImage2D",1);
-		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, TextureMeta.mWidth, TextureMeta.mHeight, Format, GL_UNSIGNED_BYTE, nullptr );
+		if ( !Rects )
+		{
+			glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, TextureMeta.mWidth, TextureMeta.mHeight, Format, GL_UNSIGNED_BYTE, nullptr );
+		}
+		else
+		{
+			//	rects are offsets into the tightly packed buffer
+			glPixelStorei( GL_UNPACK_ROW_LENGTH, TextureMeta.mWidth );
+			for ( int r=0;	r<Rects->GetSize();	r++ )
+			{
+				auto& Rect = (*Rects)[r];
+				size_t Offset = ( (Rect.mY * TextureMeta.mWidth) + Rect.mX ) * TextureMeta.GetChannels();
+				glTexSubImage2D( GL_TEXTURE_2D, 0, Rect.mX, Rect.mY, Rect.mWidth, Rect.mHeight, Format, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid*>( Offset ) );
+			}
+			glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+		}
 		if ( HasError() )
 			return false;
 	}
 
-	//	remap, for speed
-	if ( OPENGL_REREADY_MAP )
-		AllocMap( *Buffer );
+	//	fence the copy so we don't stall mapping the buffer again while the gpu is still reading it
+	if ( glewIsSupported("GL_ARB_sync") )
+	{
+		if ( Buffer->mCopyFence )
+			glDeleteSync( Buffer->mCopyFence );
+		Buffer->mCopyFence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	}
+
+	//	remap, for speed. If fenced, this happens once the copy is done
+	if ( OPENGL_REREADY_MAP && !Buffer->mPersistent )
+	{
+		if ( Buffer->mCopyFence )
+			Buffer->mMapRequested = true;
+		else
+			AllocMap( *Buffer );
+	}
 
 	DstTexture.Unbind(*this);
 	Unbind(*Buffer);
@@ -875,6 +1175,12 @@ bool TUnityDevice_Opengl::DeleteTexture(TOpenglBufferCache& Buffer)
 	if ( !Context )
 		return false;
 
+	if ( Buffer.mCopyFence )
+	{
+		glDeleteSync( Buffer.mCopyFence );
+		Buffer.mCopyFence = nullptr;
+	}
+
 	glDeleteBuffers( 1, &Buffer.mBufferName );
 	Buffer.mBufferName = GL_INVALID_BUFFER_NAME;
 
@@ -962,6 +1268,10 @@ void TUnityDevice_Opengl::OnRenderThreadUpdate()
 
 		//	need to alloc buffer if we need to
 		AllocDynamicTexture( Buffer );
+
+		//	gpu still reading it
+		if ( !UpdateCopyFence( Buffer ) )
+			continue;
 	
 		if ( Buffer.mMapRequested )
 			AllocMap( Buffer );
@@ -982,3 +1292,194 @@ void TUnityDevice_Opengl::OnRenderThreadPostUpdate()
 }
 #endif
 
+
+
+TUnityDevice_Memory::~TUnityDevice_Memory()
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	for ( int i=0;	i<mTextures.GetSize();	i++ )
+		delete mTextures[i];
+	mTextures.Clear();
+}
+
+uint32 TUnityDevice_Memory::AllocMemoryTexture(const TFrameMeta& FrameMeta)
+{
+	if ( !FrameMeta.IsValid() )
+		return 0;
+
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* Texture = new TMemoryTexture( ++mLastTextureRef, FrameMeta );
+	mTextures.PushBack( Texture );
+	return Texture->mRef;
+}
+
+bool TUnityDevice_Memory::DeleteMemoryTexture(uint32 Ref)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	for ( int i=0;	i<mTextures.GetSize();	i++ )
+	{
+		if ( !(*mTextures[i] == Ref) )
+			continue;
+		delete mTextures[i];
+		mTextures.RemoveBlock( i, 1 );
+		return true;
+	}
+	return false;
+}
+
+TMemoryTexture* TUnityDevice_Memory::GetMemoryTexture(uint32 Ref)
+{
+	for ( int i=0;	i<mTextures.GetSize();	i++ )
+	{
+		if ( *mTextures[i] == Ref )
+			return mTextures[i];
+	}
+	return nullptr;
+}
+
+bool TUnityDevice_Memory::CopyToMemoryTexture(uint32 Ref,const TFramePixels& Frame)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* Texture = GetMemoryTexture( Ref );
+	if ( !Texture )
+		return false;
+
+	auto& Meta = Texture->mMeta;
+	int Pitch = Meta.mWidth * Meta.GetChannels();
+	return Frame.CopyRows( Texture->mPixels.GetArray(), Pitch, Texture->mPixels.GetSize() );
+}
+
+Unity::TTexture TUnityDevice_Memory::AllocTexture(TFrameMeta FrameMeta)
+{
+	auto Ref = AllocMemoryTexture( FrameMeta );
+	return Ref ? Unity::TTexture( Ref ) : Unity::TTexture();
+}
+
+Unity::TDynamicTexture TUnityDevice_Memory::AllocDynamicTexture(TFrameMeta FrameMeta)
+{
+	auto Ref = AllocMemoryTexture( FrameMeta );
+	return Ref ? Unity::TDynamicTexture( Ref ) : Unity::TDynamicTexture();
+}
+
+bool TUnityDevice_Memory::DeleteTexture(Unity::TTexture& Texture)
+{
+	bool Result = DeleteMemoryTexture( Texture.GetInteger() );
+	Texture = Unity::TTexture();
+	return Result;
+}
+
+bool TUnityDevice_Memory::DeleteTexture(Unity::TDynamicTexture& Texture)
+{
+	bool Result = DeleteMemoryTexture( Texture.GetInteger() );
+	Texture = Unity::TDynamicTexture();
+	return Result;
+}
+
+TFrameMeta TUnityDevice_Memory::GetTextureMeta(Unity::TTexture Texture)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* pTexture = GetMemoryTexture( Texture.GetInteger() );
+	return pTexture ? pTexture->mMeta : TFrameMeta();
+}
+
+TFrameMeta TUnityDevice_Memory::GetTextureMeta(Unity::TDynamicTexture Texture)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* pTexture = GetMemoryTexture( Texture.GetInteger() );
+	return pTexture ? pTexture->mMeta : TFrameMeta();
+}
+
+bool TUnityDevice_Memory::CopyTexture(Unity::TTexture Texture,const TFramePixels& Frame,bool Blocking)
+{
+	return CopyToMemoryTexture( Texture.GetInteger(), Frame );
+}
+
+bool TUnityDevice_Memory::CopyTexture(Unity::TDynamicTexture Texture,const TFramePixels& Frame,bool Blocking)
+{
+	return CopyToMemoryTexture( Texture.GetInteger(), Frame );
+}
+
+bool TUnityDevice_Memory::CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>& Rects)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* Dst = GetMemoryTexture( DstTexture.GetInteger() );
+	auto* Src = GetMemoryTexture( SrcTexture.GetInteger() );
+	if ( !Dst || !Src )
+		return false;
+	if ( Dst->mMeta != Src->mMeta )
+		return false;
+
+	auto& Meta = Dst->mMeta;
+	int Channels = Meta.GetChannels();
+	int Pitch = Meta.mWidth * Channels;
+	for ( int r=0;	r<Rects.GetSize();	r++ )
+	{
+		auto& Rect = Rects[r];
+		int x = ofMax( 0, Rect.mX );
+		int Width = ofMin( Rect.mX + Rect.mWidth, Meta.mWidth ) - x;
+		for ( int y=ofMax(0,Rect.mY);	y<ofMin( Rect.mY + Rect.mHeight, Meta.mHeight );	y++ )
+		{
+			int Offset = (y*Pitch) + (x*Channels);
+			memcpy( Dst->mPixels.GetArray() + Offset, Src->mPixels.GetArray() + Offset, Width*Channels );
+		}
+	}
+	return true;
+}
+
+bool TUnityDevice_Memory::CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* Dst = GetMemoryTexture( DstTexture.GetInteger() );
+	auto* Src = GetMemoryTexture( SrcTexture.GetInteger() );
+	if ( !Dst || !Src )
+		return false;
+
+	//	like glTexSubImage2D, copies the source's dimensions
+	if ( Dst->mMeta != Src->mMeta )
+		return false;
+
+	memcpy( Dst->mPixels.GetArray(), Src->mPixels.GetArray(), Dst->mPixels.GetSize() );
+	return true;
+}
+
+bool TUnityDevice_Memory::CopyTexture(Unity::TDynamicTexture Texture,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking)
+{
+	if ( Frames.GetSize() != Rects.GetSize() )
+		return false;
+
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* pTexture = GetMemoryTexture( Texture.GetInteger() );
+	if ( !pTexture )
+		return false;
+
+	auto& Meta = pTexture->mMeta;
+	int Pitch = Meta.mWidth * Meta.GetChannels();
+	bool Success = true;
+	for ( int i=0;	i<Frames.GetSize();	i++ )
+	{
+		if ( !Frames[i]->CopyRows( pTexture->mPixels.GetArray(), Pitch, pTexture->mPixels.GetSize(), Rects[i] ) )
+			Success = false;
+	}
+	return Success;
+}
+
+bool TUnityDevice_Memory::ReadTexture(Unity::TTexture Texture,uint8* Buffer,int BufferSize)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* pTexture = GetMemoryTexture( Texture.GetInteger() );
+	if ( !pTexture || !Buffer )
+		return false;
+
+	if ( BufferSize < pTexture->mPixels.GetSize() )
+		return false;
+
+	memcpy( Buffer, pTexture->mPixels.GetArray(), pTexture->mPixels.GetSize() );
+	return true;
+}
+
+uint8* TUnityDevice_Memory::GetMappedData(Unity::TDynamicTexture Texture)
+{
+	ofMutex::ScopedLock Lock( mTextures );
+	auto* pTexture = GetMemoryTexture( Texture.GetInteger() );
+	return pTexture ? pTexture->mPixels.GetArray() : nullptr;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ofxSoylent.h>
+#include <cstdint>
 #include "TFrame.h"
 
 
@@ -48,6 +49,7 @@
 
 class TUnityDevice;
 class TUnityDevice_Dummy;
+class TUnityDevice_Memory;
 #if defined(ENABLE_DX11)
 class TUnityDevice_Dx11;
 #endif
@@ -169,13 +171,13 @@ public:
     {
     }
 	explicit TTexture(uint32 Id) :
-		mObject     ( reinterpret_cast<void*>(Id) )
+		mObject     ( reinterpret_cast<void*>( static_cast<uintptr_t>(Id) ) )
     {
     }
     virtual bool        IsValid() const {   return (mObject != nullptr);  }	//	nullpointer != 0, so might have issues here in c++11
 	operator            bool()			{	return IsValid();	}
 
-	uint32				GetInteger() const	{	return reinterpret_cast<uint32>( mObject );	}
+	uint32				GetInteger() const	{	return static_cast<uint32>( reinterpret_cast<uintptr_t>( mObject ) );	}
 	void*				GetPointer() const	{	return mObject;	}
 
 private:
@@ -197,13 +199,13 @@ public:
     {
     }
 	explicit TDynamicTexture(uint32 Id) :
-		mObject     ( reinterpret_cast<void*>(Id) )
+		mObject     ( reinterpret_cast<void*>( static_cast<uintptr_t>(Id) ) )
     {
     }
     virtual bool        IsValid() const {   return (mObject != nullptr);  }	//	nullpointer != 0, so might have issues here in c++11
 	operator            bool()			{	return IsValid();	}
 
-	uint32				GetInteger() const	{	return reinterpret_cast<uint32>( mObject );	}
+	uint32				GetInteger() const	{	return static_cast<uint32>( reinterpret_cast<uintptr_t>( mObject ) );	}
 	void*				GetPointer() const	{	return mObject;	}
 
 private:
@@ -255,7 +257,9 @@ public:
 		mDataMap			( nullptr ),
 		mBufferName			( GL_INVALID_BUFFER_NAME ),
 		mDeleteRequested	( false ),
-		mMapRequested		( false )
+		mMapRequested		( false ),
+		mCopyFence			( nullptr ),
+		mPersistent			( false )
 	{
 	}
 
@@ -273,6 +277,8 @@ public:
 	void*		mDataMap;
 	bool		mDeleteRequested;
 	bool		mMapRequested;
+	GLsync		mCopyFence;			//	last copy to a texture, can't map until it's done. Only touched in the render thread
+	bool		mPersistent;		//	immutable storage, mapped for its whole life
 };
 #endif
 
@@ -346,6 +352,14 @@ public:
 	virtual bool            CopyTexture(Unity::TDynamicTexture Texture,const TFramePixels& Frame,bool Blocking)=0;
 	virtual bool            CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture)=0;
 
+	//	frames can be decoded straight into dynamic textures (see TFramePool::Alloc) so the copy into them is skipped
+	virtual bool			SupportsMappedFrames()								{	return false;	}
+	virtual uint8*			GetMappedData(Unity::TDynamicTexture Texture)		{	return nullptr;	}	//	tightly packed, write-only. null if not mapped right now
+	virtual bool			IsCopyComplete(Unity::TDynamicTexture Texture)		{	return true;	}		//	gpu has finished reading it since CopyTexture(Dst,Src). writing before then stalls
+	virtual bool			CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>& Rects)	{	return CopyTexture( DstTexture, SrcTexture );	}	//	only copy these regions
+	virtual bool			CopyTexture(Unity::TDynamicTexture Texture,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking)	{	return false;	}	//	write each frame into its region with one map
+	virtual bool			ReadTexture(Unity::TTexture Texture,uint8* Buffer,int BufferSize)	{	return false;	}	//	tightly packed readback. Only headless devices can do this cheaply
+
 public:
 	ofMutex					mContextLock;	//	contexts are generally not threadsafe (certainly not DX11 or opengl) so make it common
 	SoyThreadId				mRenderThreadId;
@@ -400,6 +414,8 @@ public:
 	virtual bool            CopyTexture(Unity::TTexture Texture,const TFramePixels& Frame,bool Blocking);
 	virtual bool            CopyTexture(Unity::TDynamicTexture Texture,const TFramePixels& Frame,bool Blocking);
 	virtual bool            CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture);
+	virtual bool			CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>& Rects);
+	virtual bool			CopyTexture(Unity::TDynamicTexture Texture,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking);
     
 	ID3D11Device&				GetDevice()		{	assert( mDevice );	return *mDevice;	}
  	static TFrameFormat::Type	GetFormat(DXGI_FORMAT Format);
@@ -432,6 +448,68 @@ public:
 
 
 
+//	texture in system memory
+class TMemoryTexture
+{
+public:
+	TMemoryTexture(uint32 Ref,TFrameMeta Meta) :
+		mRef	( Ref ),
+		mMeta	( Meta )
+	{
+		mPixels.SetSize( Meta.GetDataSize() );
+	}
+
+	inline bool		operator==(const uint32 Ref) const	{	return mRef == Ref;	}
+
+public:
+	uint32			mRef;
+	TFrameMeta		mMeta;
+	Array<uint8>	mPixels;	//	tightly packed
+};
+DECLARE_NONCOMPLEX_NO_CONSTRUCT_TYPE( TMemoryTexture* );
+
+
+//	headless device (unity batch mode); textures are buffers in system memory.
+//	Dynamic textures are always "mapped", like upload buffers on a GPU
+class TUnityDevice_Memory : public TUnityDevice
+{
+public:
+	TUnityDevice_Memory() :
+		mLastTextureRef	( 0 )
+	{
+	}
+	~TUnityDevice_Memory();
+    
+	virtual bool			AllowOperationsOutOfRenderThread() const		{	return true;	}
+	virtual bool            IsValid()	{	return true;	}
+    virtual Unity::TTexture AllocTexture(TFrameMeta FrameMeta);
+    virtual Unity::TDynamicTexture	AllocDynamicTexture(TFrameMeta FrameMeta);
+    virtual bool            DeleteTexture(Unity::TTexture& Texture);
+    virtual bool            DeleteTexture(Unity::TDynamicTexture& Texture);
+	virtual TFrameMeta      GetTextureMeta(Unity::TTexture Texture);
+	virtual TFrameMeta      GetTextureMeta(Unity::TDynamicTexture Texture);
+	virtual bool            CopyTexture(Unity::TTexture Texture,const TFramePixels& Frame,bool Blocking);
+	virtual bool            CopyTexture(Unity::TDynamicTexture Texture,const TFramePixels& Frame,bool Blocking);
+	virtual bool            CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture);
+	virtual bool			CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>& Rects);
+	virtual bool			CopyTexture(Unity::TDynamicTexture Texture,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking);
+	virtual bool			SupportsMappedFrames()							{	return true;	}
+	virtual uint8*			GetMappedData(Unity::TDynamicTexture Texture);
+	virtual bool			ReadTexture(Unity::TTexture Texture,uint8* Buffer,int BufferSize);
+
+private:
+	uint32					AllocMemoryTexture(const TFrameMeta& FrameMeta);
+	bool					DeleteMemoryTexture(uint32 Ref);
+	TMemoryTexture*			GetMemoryTexture(uint32 Ref);		//	caller must lock mTextures
+	bool					CopyToMemoryTexture(uint32 Ref,const TFramePixels& Frame);
+
+private:
+	uint32					mLastTextureRef;
+	ofMutexT<Array<TMemoryTexture*>>	mTextures;	//	pointers so mapped pixels don't move as the array grows
+};
+
+
+
 
 
 #if defined(ENABLE_OPENGL)
@@ -457,6 +535,11 @@ public:
 	virtual bool            CopyTexture(Unity::TTexture Texture,const TFramePixels& Frame,bool Blocking);
 	virtual bool            CopyTexture(Unity::TDynamicTexture Texture,const TFramePixels& Frame,bool Blocking);
 	virtual bool            CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture);
+	virtual bool			CopyTexture(Unity::TTexture DstTexture,const Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>& Rects);
+	virtual bool			CopyTexture(Unity::TDynamicTexture Texture,const Array<TFramePixels*>& Frames,const Array<TFrameRect>& Rects,bool Blocking);
+	virtual bool			SupportsMappedFrames()		{	return true;	}
+	virtual uint8*			GetMappedData(Unity::TDynamicTexture Texture);
+	virtual bool			IsCopyComplete(Unity::TDynamicTexture Texture);
  
 	static TFrameFormat::Type	GetFormat(GLint Format);
 	static GLint				GetFormat(TFrameFormat::Type Format);
@@ -473,6 +556,10 @@ private:
 	bool					Unbind(TOpenglBufferCache& Buffer);
 	bool					AllocMap(TOpenglBufferCache& Buffer);
 	bool					FreeMap(TOpenglBufferCache& Buffer);
+	bool					UpdateCopyFence(TOpenglBufferCache& Buffer);	//	returns if complete
+	bool					AllocPersistentStorage(TOpenglBufferCache& Buffer);
+	bool					CopyBufferToTexture(Unity::TTexture DstTexture,Unity::TDynamicTexture SrcTexture,const Array<TFrameRect>* Rects);	//	null rects copies everything
+	bool					SupportsPersistentMap();
 
 private:
 	bool					mFirstRun;
@@ -0,0 +1,448 @@
+//	headless benchmark; decodes N instances of M files on the memory device and drives the render
+//	thread ourselves, then prints the pipeline's throughput, timings and lag as json.
+//	Built by src/CMakeLists.txt (FastVideoBench), which takes the ofxSoylent and ffmpeg paths, eg.
+//		cmake -S src -B build -DOFXSOYLENT_DIR=../ofxSoylent/src && cmake --build build
+//		FastVideoBench --instances 8 --seconds 20 clip_a.mp4 clip_b.mp4 > results.json
+//		FastVideoBench --test-decoder --test-cost-us 3000 --instances 8 > results.json
+//		FastVideoBench --test-frames 600 --encode-test-clip test.mp4	(then bench test.mp4 for the same video through libav)
+//		FastVideoBench --test-decoder --seconds 5 --trace trace.json	(open in chrome://tracing)
+#include "../FastVideo.h"
+#include "../TFastTexture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(TARGET_WINDOWS)
+	#include <psapi.h>
+	#pragma comment(lib,"psapi.lib")
+#else
+	#include <sys/resource.h>
+#endif
+
+
+namespace Bench
+{
+	typedef std::chrono::steady_clock	TClock;
+
+	class TParams
+	{
+	public:
+		TParams() :
+			mInstances		( 4 ),
+			mSeconds		( 10.f ),
+			mWarmupSeconds	( 2.f ),
+			mRenderHz		( 60.f ),
+			mWidth			( 1280 ),
+			mHeight			( 720 ),
+			mFormat			( TFrameFormat::RGBA ),
+			mTestDecoder	( false ),
+			mVerbose		( false ),
+			mTestParams		( TTestFrameGenerator::GetDefaultParams() )
+		{
+		}
+
+		bool						Parse(int argc,char* argv[]);
+
+	public:
+		int							mInstances;
+		float						mSeconds;
+		float						mWarmupSeconds;		//	counters are reset after this, so start-up doesn't skew the results
+		float						mRenderHz;
+		int							mWidth;
+		int							mHeight;
+		TFrameFormat::Type			mFormat;
+		bool						mTestDecoder;
+		bool						mVerbose;
+		std::vector<std::string>	mFiles;				//	instance i plays file i%count
+		TTestDecoderParams			mTestParams;		//	size and format are ours
+		std::string					mEncodeTestClip;	//	write the test video here instead of benchmarking
+		std::string					mTraceFile;			//	chrome trace of the measured period
+	};
+
+	//	cpu time (user+system) and peak resident memory of the whole process
+	class TProcessUsage
+	{
+	public:
+		TProcessUsage();
+
+	public:
+		double						mCpuSeconds;
+		uint64						mPeakRssBytes;
+	};
+
+	class TPercentiles
+	{
+	public:
+		explicit TPercentiles(std::vector<double>& Samples);
+
+	public:
+		int							mCount;
+		double						mMean;
+		double						mP50;
+		double						mP90;
+		double						mP99;
+		double						mMax;
+	};
+
+	double							GetSeconds(TClock::time_point From,TClock::time_point To);
+	void							OnDebugLog(const char* String);
+	void							PrintUsage(const char* Exe);
+	void							PrintPercentiles(const char* Name,const TPercentiles& Percentiles,bool Last=false);
+	void							PrintString(const char* String);
+};
+
+
+
+bool Bench::TParams::Parse(int argc,char* argv[])
+{
+	for ( int i=1;	i<argc;	i++ )
+	{
+		std::string Arg = argv[i];
+		bool HasValue = ( i+1 < argc );
+
+		if ( Arg == "--instances" && HasValue )			mInstances = atoi( argv[++i] );
+		else if ( Arg == "--seconds" && HasValue )		mSeconds = static_cast<float>( atof( argv[++i] ) );
+		else if ( Arg == "--warmup" && HasValue )		mWarmupSeconds = static_cast<float>( atof( argv[++i] ) );
+		else if ( Arg == "--render-hz" && HasValue )	mRenderHz = static_cast<float>( atof( argv[++i] ) );
+		else if ( Arg == "--width" && HasValue )		mWidth = atoi( argv[++i] );
+		else if ( Arg == "--height" && HasValue )		mHeight = atoi( argv[++i] );
+		else if ( Arg == "--rgb" )						mFormat = TFrameFormat::RGB;
+		else if ( Arg == "--test-decoder" )				mTestDecoder = true;
+		else if ( Arg == "--verbose" )					mVerbose = true;
+		else if ( Arg == "--test-fps" && HasValue )		mTestParams.mFramesPerSecond = static_cast<float>( atof( argv[++i] ) );
+		else if ( Arg == "--test-frames" && HasValue )	mTestParams.mFrameCount = atoi( argv[++i] );
+		else if ( Arg == "--test-cost-us" && HasValue )	{	mTestParams.mCostModel = TTestDecoderCost::Fixed;		mTestParams.mCostUs = atoi( argv[++i] );	}
+		else if ( Arg == "--test-workload" && HasValue ){	mTestParams.mCostModel = TTestDecoderCost::Workload;	mTestParams.mCostPasses = atoi( argv[++i] );	}
+		else if ( Arg == "--test-gop" && HasValue )		mTestParams.mKeyframeInterval = atoi( argv[++i] );
+		else if ( Arg == "--test-bframes" && HasValue )	mTestParams.mBFrames = atoi( argv[++i] );
+		else if ( Arg == "--test-ooo" )					mTestParams.mOutOfOrder = true;
+		else if ( Arg == "--test-seed" && HasValue )	mTestParams.mSeed = static_cast<uint32>( atoi( argv[++i] ) );
+		else if ( Arg == "--encode-test-clip" && HasValue )	mEncodeTestClip = argv[++i];
+		else if ( Arg == "--trace" && HasValue )		mTraceFile = argv[++i];
+		else if ( Arg.compare( 0, 2, "--" ) == 0 )		return false;
+		else											mFiles.push_back( Arg );
+	}
+
+	if ( mInstances <= 0 || mSeconds <= 0.f || mRenderHz <= 0.f || mWidth <= 0 || mHeight <= 0 )
+		return false;
+
+	mTestParams.mWidth = mWidth;
+	mTestParams.mHeight = mHeight;
+	mTestParams.mFormat = mFormat;
+	if ( !mEncodeTestClip.empty() )
+		return true;
+
+	//	test decoder ignores the filename
+	if ( mFiles.empty() && mTestDecoder )
+		mFiles.push_back( "test" );
+
+#if !defined(ENABLE_DECODER_LIBAV)
+	//	nothing here can decode a real file, don't report numbers that aren't for it
+	if ( !mTestDecoder )
+	{
+		fprintf( stderr, "Built without the libav decoder; only --test-decoder can be benchmarked\n" );
+		return false;
+	}
+#endif
+
+	return !mFiles.empty();
+}
+
+
+Bench::TProcessUsage::TProcessUsage() :
+	mCpuSeconds		( 0.0 ),
+	mPeakRssBytes	( 0 )
+{
+#if defined(TARGET_WINDOWS)
+	FILETIME Creation, Exit, Kernel, User;
+	if ( GetProcessTimes( GetCurrentProcess(), &Creation, &Exit, &Kernel, &User ) )
+	{
+		auto ToSeconds = [](const FILETIME& Time)	{	return static_cast<double>( (static_cast<uint64>(Time.dwHighDateTime)<<32) | Time.dwLowDateTime ) / 10000000.0;	};
+		mCpuSeconds = ToSeconds( Kernel ) + ToSeconds( User );
+	}
+	PROCESS_MEMORY_COUNTERS Memory;
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &Memory, sizeof(Memory) ) )
+		mPeakRssBytes = Memory.PeakWorkingSetSize;
+#else
+	rusage Usage;
+	if ( getrusage( RUSAGE_SELF, &Usage ) == 0 )
+	{
+		mCpuSeconds = Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec + (Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec) / 1000000.0;
+	#if defined(TARGET_OSX)
+		mPeakRssBytes = Usage.ru_maxrss;			//	bytes on osx
+	#else
+		mPeakRssBytes = Usage.ru_maxrss * 1024ull;	//	kb on linux
+	#endif
+	}
+#endif
+}
+
+
+Bench::TPercentiles::TPercentiles(std::vector<double>& Samples) :
+	mCount	( static_cast<int>( Samples.size() ) ),
+	mMean	( 0.0 ),
+	mP50	( 0.0 ),
+	mP90	( 0.0 ),
+	mP99	( 0.0 ),
+	mMax	( 0.0 )
+{
+	if ( Samples.empty() )
+		return;
+
+	std::sort( Samples.begin(), Samples.end() );
+	auto At = [&Samples](double Percentile)	{	return Samples[ static_cast<size_t>( Percentile * (Samples.size()-1) ) ];	};
+
+	double Total = 0.0;
+	for ( auto Sample : Samples )
+		Total += Sample;
+	mMean = Total / Samples.size();
+	mP50 = At( 0.50 );
+	mP90 = At( 0.90 );
+	mP99 = At( 0.99 );
+	mMax = Samples.back();
+}
+
+
+double Bench::GetSeconds(TClock::time_point From,TClock::time_point To)
+{
+	return std::chrono::duration<double>( To - From ).count();
+}
+
+void Bench::OnDebugLog(const char* String)
+{
+	fprintf( stderr, "%s\n", String );
+}
+
+void Bench::PrintUsage(const char* Exe)
+{
+	fprintf( stderr, "usage: %s [--instances N] [--seconds S] [--warmup S] [--render-hz HZ] [--width W] [--height H] [--rgb] [--test-decoder] [--verbose] [--trace file] file [file...]\n", Exe );
+	fprintf( stderr, "       [--test-fps F] [--test-frames N] [--test-cost-us US | --test-workload PASSES] [--test-gop N] [--test-bframes N] [--test-ooo] [--test-seed N] [--encode-test-clip file]\n" );
+	fprintf( stderr, "instance i plays file i %% filecount. Results are written to stdout as json\n" );
+}
+
+void Bench::PrintString(const char* String)
+{
+	putchar('"');
+	for ( const char* c=String;	*c;	c++ )
+	{
+		if ( *c == '"' || *c == '\\' )
+			putchar('\\');
+		putchar( *c );
+	}
+	putchar('"');
+}
+
+void Bench::PrintPercentiles(const char* Name,const TPercentiles& Percentiles,bool Last)
+{
+	printf( "\t\"%s\": { \"samples\": %d, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+		Name, Percentiles.mCount, Percentiles.mMean, Percentiles.mP50, Percentiles.mP90, Percentiles.mP99, Percentiles.mMax, Last ? "" : "," );
+}
+
+
+int main(int argc,char* argv[])
+{
+	Bench::TParams Params;
+	if ( !Params.Parse( argc, argv ) )
+	{
+		Bench::PrintUsage( argv[0] );
+		return 1;
+	}
+
+	if ( Params.mVerbose )
+		SetDebugLogFunction( Bench::OnDebugLog );
+	EnableTestDecoder( Params.mTestDecoder );
+	SetTestDecoderParams( &Params.mTestParams );
+
+	if ( !Params.mEncodeTestClip.empty() )
+	{
+		std::wstring Filename( Params.mEncodeTestClip.begin(), Params.mEncodeTestClip.end() );
+		return EncodeTestClip( Filename.c_str(), static_cast<int>( Filename.length() ) ) ? 0 : 1;
+	}
+
+	//	we call OnPostRender ourselves so we can time it
+	if ( !UseMemoryDevice( 0.f ) )
+	{
+		fprintf( stderr, "Failed to create memory device\n" );
+		return 1;
+	}
+
+	auto& FastVideo = Unity::GetFastVideo();
+	std::vector<TFastTexture*> Instances;
+	std::vector<Unity::ulong> InstanceRefs;
+	for ( int i=0;	i<Params.mInstances;	i++ )
+	{
+		auto Instance = AllocInstance();
+		auto* Texture = AllocMemoryTexture( Params.mWidth, Params.mHeight, Params.mFormat );
+		const std::string& File = Params.mFiles[ i % Params.mFiles.size() ];
+		std::wstring Filename( File.begin(), File.end() );
+
+		//	instance owns the texture from here
+		if ( !Texture || !SetTexture( Instance, Texture ) || !SetVideo( Instance, Filename.c_str(), static_cast<int>( Filename.length() ) ) )
+		{
+			fprintf( stderr, "Failed to set up instance %d with %s\n", i, File.c_str() );
+			return 1;
+		}
+		InstanceRefs.push_back( Instance );
+		Instances.push_back( FastVideo.FindInstance( Instance ) );
+	}
+
+	auto FrameInterval = std::chrono::duration_cast<Bench::TClock::duration>( std::chrono::duration<double>( 1.0 / Params.mRenderHz ) );
+	auto Start = Bench::TClock::now();
+	auto MeasureStart = Start + std::chrono::duration_cast<Bench::TClock::duration>( std::chrono::duration<double>( Params.mWarmupSeconds ) );
+	auto End = MeasureStart + std::chrono::duration_cast<Bench::TClock::duration>( std::chrono::duration<double>( Params.mSeconds ) );
+
+	bool Measuring = false;
+	Bench::TProcessUsage UsageStart;
+	std::vector<double> RenderMs;
+	std::vector<double> LagMs;
+	auto NextFrame = Start;
+
+	while ( true )
+	{
+		auto FrameStart = Bench::TClock::now();
+		if ( FrameStart >= End )
+			break;
+
+		//	start counting from a warmed up pipeline
+		if ( !Measuring && FrameStart >= MeasureStart )
+		{
+			Measuring = true;
+			for ( auto* Instance : Instances )
+				Instance->GetCounters().Reset();
+			ResetLatencyStats();
+			FastVideo.ResetUploadSchedulerStats();
+			FastVideo.GetFramePool().ResetStats();
+			UsageStart = Bench::TProcessUsage();
+			MeasureStart = FrameStart;
+			if ( !Params.mTraceFile.empty() )
+			{
+				ClearTrace();
+				EnableTrace( true );
+			}
+		}
+
+		UnityRenderEvent( OnPostRender );
+		auto FrameEnd = Bench::TClock::now();
+
+		if ( Measuring )
+		{
+			RenderMs.push_back( Bench::GetSeconds( FrameStart, FrameEnd ) * 1000.0 );
+
+			//	how far the texture is behind the playhead
+			for ( auto* Instance : Instances )
+			{
+				SoyTime Shown = Instance->GetTargetTextureFrame();
+				SoyTime Playhead = Instance->GetFrameTime();
+				if ( !Shown.IsValid() || !Playhead.IsValid() )
+					continue;
+				double Lag = static_cast<double>( Playhead.GetTime() ) - static_cast<double>( Shown.GetTime() );
+				LagMs.push_back( Instance->IsReverse() ? -Lag : Lag );
+			}
+		}
+
+		NextFrame += FrameInterval;
+		auto Now = Bench::TClock::now();
+		if ( NextFrame > Now )
+			std::this_thread::sleep_for( NextFrame - Now );
+		else
+			NextFrame = Now;	//	render is over its interval, don't try and catch up
+	}
+
+	Bench::TProcessUsage UsageEnd;
+	if ( !Params.mTraceFile.empty() )
+	{
+		EnableTrace( false );
+		std::wstring Filename( Params.mTraceFile.begin(), Params.mTraceFile.end() );
+		if ( !WriteTraceFile( Filename.c_str(), static_cast<int>( Filename.length() ) ) )
+			fprintf( stderr, "Failed to write trace to %s\n", Params.mTraceFile.c_str() );
+	}
+	double Seconds = Bench::GetSeconds( MeasureStart, Bench::TClock::now() );
+
+	//	totals across instances
+	uint64 Decoded = 0, Converted = 0, Uploaded = 0, Skipped = 0, Dropped = 0;
+	uint64 DecodeUs = 0, ConvertUs = 0, UploadUs = 0;
+	uint64 DecodeCount = 0, ConvertCount = 0, UploadCount = 0;
+	float DecodeMaxMs = 0.f, ConvertMaxMs = 0.f, UploadMaxMs = 0.f;
+	for ( auto* Instance : Instances )
+	{
+		auto& Counters = Instance->GetCounters();
+		Decoded += Counters.mFramesDecoded;
+		Converted += Counters.mFramesConverted;
+		Uploaded += Counters.mFramesUploaded;
+		Skipped += Counters.mFramesSkipped;
+		Dropped += Counters.mFramesDropped;
+		DecodeUs += Counters.mDecode.mTotalUs;
+		ConvertUs += Counters.mConvert.mTotalUs;
+		UploadUs += Counters.mUpload.mTotalUs;
+		DecodeCount += Counters.mDecode.mCount;
+		ConvertCount += Counters.mConvert.mCount;
+		UploadCount += Counters.mUpload.mCount;
+		DecodeMaxMs = ofMax( DecodeMaxMs, Counters.mDecode.GetMaxMs() );
+		ConvertMaxMs = ofMax( ConvertMaxMs, Counters.mConvert.GetMaxMs() );
+		UploadMaxMs = ofMax( UploadMaxMs, Counters.mUpload.GetMaxMs() );
+	}
+
+	TFramePoolStats PoolStats;
+	GetFramePoolStats( &PoolStats );
+	TUploadSchedulerStats SchedulerStats;
+	GetUploadSchedulerStats( &SchedulerStats );
+
+	auto PerFrameMs = [](uint64 TotalUs,uint64 Frames)	{	return Frames ? (TotalUs / 1000.0) / Frames : 0.0;	};
+	auto PerSecond = [Seconds](uint64 Count)			{	return Seconds > 0.0 ? Count / Seconds : 0.0;	};
+
+	printf( "{\n" );
+	printf( "\t\"instances\": %d,\n", Params.mInstances );
+	printf( "\t\"files\": [" );
+	for ( size_t i=0;	i<Params.mFiles.size();	i++ )
+	{
+		printf( i ? ", " : " " );
+		Bench::PrintString( Params.mFiles[i].c_str() );
+	}
+	printf( " ],\n" );
+	printf( "\t\"width\": %d,\n\t\"height\": %d,\n\t\"format\": %d,\n", Params.mWidth, Params.mHeight, Params.mFormat );
+	printf( "\t\"test_decoder\": %s,\n", Params.mTestDecoder ? "true" : "false" );
+	if ( Params.mTestDecoder )
+	{
+		auto& Test = Params.mTestParams;
+		printf( "\t\"test_params\": { \"fps\": %.2f, \"frames\": %d, \"cost_model\": %d, \"cost_us\": %d, \"cost_passes\": %d, \"gop\": %d, \"bframes\": %d, \"out_of_order\": %s, \"seed\": %u },\n",
+			Test.mFramesPerSecond, Test.mFrameCount, Test.mCostModel, Test.mCostUs, Test.mCostPasses, Test.mKeyframeInterval, Test.mBFrames, Test.mOutOfOrder ? "true" : "false", Test.mSeed );
+	}
+	printf( "\t\"render_hz\": %.2f,\n\t\"seconds\": %.3f,\n", Params.mRenderHz, Seconds );
+	printf( "\t\"decode_fps\": %.2f,\n\t\"decode_fps_per_instance\": %.2f,\n", PerSecond( Decoded ), PerSecond( Decoded ) / Params.mInstances );
+	printf( "\t\"upload_fps\": %.2f,\n", PerSecond( Uploaded ) );
+	printf( "\t\"decode_ms\": %.3f,\n\t\"convert_ms\": %.3f,\n\t\"upload_ms\": %.3f,\n", PerFrameMs( DecodeUs, DecodeCount ), PerFrameMs( ConvertUs, ConvertCount ), PerFrameMs( UploadUs, UploadCount ) );
+	printf( "\t\"decode_max_ms\": %.3f,\n\t\"convert_max_ms\": %.3f,\n\t\"upload_max_ms\": %.3f,\n", DecodeMaxMs, ConvertMaxMs, UploadMaxMs );
+	printf( "\t\"frames\": { \"decoded\": %llu, \"converted\": %llu, \"uploaded\": %llu, \"skipped\": %llu, \"dropped\": %llu },\n",
+		static_cast<unsigned long long>( Decoded ), static_cast<unsigned long long>( Converted ), static_cast<unsigned long long>( Uploaded ),
+		static_cast<unsigned long long>( Skipped ), static_cast<unsigned long long>( Dropped ) );
+	Bench::PrintPercentiles( "render_frame_ms", Bench::TPercentiles( RenderMs ) );
+	Bench::PrintPercentiles( "lag_ms", Bench::TPercentiles( LagMs ) );
+	printf( "\t\"stage_latency_ms\": {\n" );
+	for ( int s=0;	s<TPipelineStage::Count;	s++ )
+	{
+		TLatencyPercentiles Latency;
+		GetGlobalLatencyPercentiles( s, &Latency );
+		printf( "\t\t\"%s\": { \"samples\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f }%s\n",
+			TPipelineStage::ToString( static_cast<TPipelineStage::Type>(s) ), static_cast<unsigned long long>( Latency.mCount ),
+			Latency.mMeanMs, Latency.mP50Ms, Latency.mP90Ms, Latency.mP99Ms, Latency.mP999Ms, Latency.mMaxMs, (s+1 < TPipelineStage::Count) ? "," : "" );
+	}
+	printf( "\t},\n" );
+	printf( "\t\"cpu_percent\": %.1f,\n", Seconds > 0.0 ? 100.0 * (UsageEnd.mCpuSeconds - UsageStart.mCpuSeconds) / Seconds : 0.0 );
+	printf( "\t\"peak_rss_bytes\": %llu,\n", static_cast<unsigned long long>( UsageEnd.mPeakRssBytes ) );
+	printf( "\t\"pool\": { \"peak_bytes\": %llu, \"used_bytes\": %llu, \"alloc_failures\": %d, \"mapped_frames\": %d },\n",
+		static_cast<unsigned long long>( PoolStats.mPeakBytes ), static_cast<unsigned long long>( PoolStats.mUsedBytes ), PoolStats.mAllocFailures, PoolStats.mMappedFrames );
+	printf( "\t\"scheduler\": { \"uploads\": %llu, \"deferred\": %llu, \"over_budget_frames\": %llu, \"max_wait_ms\": %d }\n",
+		static_cast<unsigned long long>( SchedulerStats.mUploads ), static_cast<unsigned long long>( SchedulerStats.mDeferredUploads ),
+		static_cast<unsigned long long>( SchedulerStats.mOverBudgetFrames ), SchedulerStats.mMaxWaitMs );
+	printf( "}\n" );
+
+	for ( auto Instance : InstanceRefs )
+		FreeInstance( Instance );
+
+	return 0;
+}
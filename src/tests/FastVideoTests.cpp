@@ -0,0 +1,349 @@
+//	headless playback tests on the memory device with the test decoder. The plugin is a singleton,
+//	so each test is its own process; FastVideoTests <test> returns 0 if it passes.
+//	Built and registered with ctest by src/CMakeLists.txt, eg.
+//		cmake -S src -B build -DOFXSOYLENT_DIR=../ofxSoylent/src && cmake --build build && ctest --test-dir build
+//	The test decoder writes each frame's index into its top row of blocks, so reading the texture
+//	back tells us exactly which frame was uploaded.
+#include "../FastVideo.h"
+#include "../SoyDecoder.h"
+#include "../TFastTexture.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace Test
+{
+	typedef std::chrono::steady_clock	TClock;
+	typedef std::function<bool()>		TFunction;
+
+	const int	TimeoutMs	= 10000;
+
+	class TStatus
+	{
+	public:
+		SoyTime						mPlayhead;
+		SoyTime						mFrame;			//	in the texture
+	};
+
+	class TPlayer
+	{
+	public:
+		TPlayer(int KeyframeInterval=0);
+		~TPlayer();
+
+		bool						Init(bool HeapFrames);
+		bool						WaitFor(TFunction Condition,const char* What);
+		bool						WaitForSettled();				//	texture has caught up with the playhead
+		TStatus						GetStatus();
+		int							GetFrameIndex(SoyTime Time) const	{	return mGenerator.GetFrameIndex( Time );	}
+		int							GetShownFrameIndex()				{	return GetFrameIndex( GetStatus().mFrame );	}
+		bool						ReadShownFrame(int& TextureFrame,int& StatusFrame);	//	texture and status read without the render pass in between
+
+	public:
+		Unity::ulong				mInstance;
+		TFastTexture*				mFastTexture;
+		void*						mTexture;
+		TTestDecoderParams			mParams;
+		TTestFrameGenerator			mGenerator;
+		std::vector<uint8>			mPixels;
+	};
+
+	bool							Check(bool Condition,const char* What);
+	void							RenderFrame();
+	int								ReadFrameIndex(const std::vector<uint8>& Pixels,const TTestDecoderParams& Params);
+	void							OnDebugLog(const char* String);
+
+	bool							PlaybackHeapFrames();
+	bool							PlaybackMappedFrames();
+	bool							PlaybackReverse();
+};
+
+
+
+Test::TPlayer::TPlayer(int KeyframeInterval) :
+	mInstance		( 0 ),
+	mFastTexture	( nullptr ),
+	mTexture		( nullptr ),
+	mParams			( TTestFrameGenerator::GetDefaultParams() ),
+	mGenerator		( mParams )
+{
+	//	small enough to be quick, wide enough for all 16 bits of the frame index
+	mParams.mWidth = 320;
+	mParams.mHeight = 240;
+	mParams.mFormat = TFrameFormat::RGBA;
+	if ( KeyframeInterval > 0 )
+		mParams.mKeyframeInterval = KeyframeInterval;
+	mGenerator = TTestFrameGenerator( mParams );
+	mPixels.resize( mParams.mWidth * mParams.mHeight * 4 );
+}
+
+Test::TPlayer::~TPlayer()
+{
+	//	texture is owned by the instance
+	if ( mInstance )
+		FreeInstance( mInstance );
+}
+
+bool Test::TPlayer::Init(bool HeapFrames)
+{
+	EnableTestDecoder( true );
+	SetTestDecoderParams( &mParams );
+
+	//	we drive the render pass ourselves
+	if ( !Check( UseMemoryDevice( 0.f ), "UseMemoryDevice" ) )
+		return false;
+
+	mInstance = AllocInstance();
+	mTexture = AllocMemoryTexture( mParams.mWidth, mParams.mHeight, mParams.mFormat );
+	if ( !Check( mInstance != 0, "AllocInstance" ) || !Check( mTexture != nullptr, "AllocMemoryTexture" ) )
+		return false;
+	mFastTexture = Unity::GetFastVideo().FindInstance( mInstance );
+	if ( !Check( SetTexture( mInstance, mTexture ), "SetTexture" ) )
+		return false;
+
+	//	dirty region uploads need the pixels on the heap, so they turn off mapped frames
+	if ( HeapFrames && !Check( SetDirtyRegionUploads( mInstance, true ), "SetDirtyRegionUploads" ) )
+		return false;
+
+	std::wstring Filename( L"test" );
+	return Check( SetVideo( mInstance, Filename.c_str(), static_cast<int>( Filename.length() ) ), "SetVideo" );
+}
+
+Test::TStatus Test::TPlayer::GetStatus()
+{
+	TStatus Status;
+	Status.mPlayhead = mFastTexture->GetFrameTime();
+	Status.mFrame = mFastTexture->GetTargetTextureFrame();
+	return Status;
+}
+
+bool Test::TPlayer::WaitFor(TFunction Condition,const char* What)
+{
+	auto Timeout = TClock::now() + std::chrono::milliseconds( TimeoutMs );
+	while ( TClock::now() < Timeout )
+	{
+		RenderFrame();
+		if ( Condition() )
+			return true;
+	}
+	return Check( false, What );
+}
+
+bool Test::TPlayer::WaitForSettled()
+{
+	TStatus Status;
+	if ( WaitFor( [this,&Status]()
+		{
+			Status = GetStatus();
+			if ( !Status.mFrame.IsValid() )
+				return false;
+			return GetFrameIndex( Status.mFrame ) == GetFrameIndex( Status.mPlayhead );
+		}, "texture catching up with the playhead" ) )
+		return true;
+
+	fprintf( stderr, "playhead %llums (frame %d), texture %llums (frame %d)\n",
+		static_cast<unsigned long long>( Status.mPlayhead.GetTime() ), GetFrameIndex( Status.mPlayhead ),
+		static_cast<unsigned long long>( Status.mFrame.GetTime() ), GetFrameIndex( Status.mFrame ) );
+	return false;
+}
+
+bool Test::TPlayer::ReadShownFrame(int& TextureFrame,int& StatusFrame)
+{
+	//	uploads can finish off the render thread, so make sure the frame didn't change while we read it
+	for ( int Attempt=0;	Attempt<100;	Attempt++ )
+	{
+		SoyTime Before = GetStatus().mFrame;
+		if ( !ReadMemoryTexture( mTexture, mPixels.data(), static_cast<int>( mPixels.size() ) ) )
+			return Check( false, "ReadMemoryTexture" );
+		SoyTime After = GetStatus().mFrame;
+		if ( Before != After )
+			continue;
+
+		TextureFrame = ReadFrameIndex( mPixels, mParams );
+		StatusFrame = GetFrameIndex( After );
+		return true;
+	}
+	return Check( false, "texture stopped changing" );
+}
+
+
+bool Test::Check(bool Condition,const char* What)
+{
+	if ( !Condition )
+		fprintf( stderr, "FAILED: %s\n", What );
+	return Condition;
+}
+
+void Test::RenderFrame()
+{
+	UnityRenderEvent( OnPostRender );
+	std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+}
+
+int Test::ReadFrameIndex(const std::vector<uint8>& Pixels,const TTestDecoderParams& Params)
+{
+	//	sample the middle of each bit's block (see TTestFrameGenerator::Draw)
+	int Channels = TFrameMeta( Params.mWidth, Params.mHeight, static_cast<TFrameFormat::Type>( Params.mFormat ) ).GetChannels();
+	int BlockSize = ofMax( 1, Params.mWidth/32 );
+	int y = ofMin( BlockSize, Params.mHeight ) / 2;
+	int FrameIndex = 0;
+	for ( int Bit=0;	Bit<16 && Bit*BlockSize<Params.mWidth;	Bit++ )
+	{
+		int x = Bit*BlockSize + ofMin( BlockSize, Params.mWidth-Bit*BlockSize ) / 2;
+		if ( Pixels[ (y*Params.mWidth + x) * Channels ] > 127 )
+			FrameIndex |= 1 << Bit;
+	}
+	return FrameIndex;
+}
+
+void Test::OnDebugLog(const char* String)
+{
+	fprintf( stderr, "%s\n", String );
+}
+
+
+//	plays, pauses, and steps with the frames on the heap, checking the texture holds the frame the status says it does
+bool Test::PlaybackHeapFrames()
+{
+	TPlayer Player;
+	if ( !Player.Init( true ) )
+		return false;
+
+	//	play for a bit
+	if ( !Player.WaitFor( [&Player]()	{	return Player.GetShownFrameIndex() >= 10;	}, "playing 10 frames" ) )
+		return false;
+
+	if ( !Check( Pause( Player.mInstance ), "Pause" ) || !Player.WaitForSettled() )
+		return false;
+
+	int TextureFrame = -1, StatusFrame = -1;
+	if ( !Player.ReadShownFrame( TextureFrame, StatusFrame ) )
+		return false;
+	fprintf( stderr, "paused on frame %d, texture has frame %d\n", StatusFrame, TextureFrame );
+	if ( !Check( TextureFrame == StatusFrame, "paused texture frame matches the status" ) )
+		return false;
+
+	int PausedFrame = StatusFrame;
+	if ( !Check( StepFrame( Player.mInstance, 1 ), "StepFrame" ) || !Player.WaitForSettled() )
+		return false;
+	if ( !Player.WaitFor( [&Player,PausedFrame]()	{	return Player.GetShownFrameIndex() != PausedFrame;	}, "stepped frame uploaded" ) )
+		return false;
+
+	if ( !Player.ReadShownFrame( TextureFrame, StatusFrame ) )
+		return false;
+	fprintf( stderr, "stepped to frame %d, texture has frame %d\n", StatusFrame, TextureFrame );
+	if ( !Check( StatusFrame == PausedFrame+1, "stepped one frame" ) || !Check( TextureFrame == StatusFrame, "stepped texture frame matches the status" ) )
+		return false;
+
+	TFramePoolStats PoolStats;
+	return Check( GetFramePoolStats( &PoolStats ), "GetFramePoolStats" ) && Check( PoolStats.mMappedFrames == 0, "no mapped frames with dirty region uploads" );
+}
+
+//	plays with the default settings, so frames are decoded straight into the memory device's upload buffers
+bool Test::PlaybackMappedFrames()
+{
+	if ( !Check( ENABLE_MAPPED_FRAMES, "ENABLE_MAPPED_FRAMES" ) )
+		return false;
+
+	TPlayer Player;
+	if ( !Player.Init( false ) )
+		return false;
+
+	if ( !Player.WaitFor( [&Player]()	{	return Player.GetShownFrameIndex() >= 10;	}, "playing 10 frames" ) )
+		return false;
+
+	TFramePoolStats PoolStats;
+	if ( !Check( GetFramePoolStats( &PoolStats ), "GetFramePoolStats" ) || !Check( PoolStats.mMappedFrames > 0, "frames mapped to upload buffers" ) )
+		return false;
+
+	if ( !Check( Pause( Player.mInstance ), "Pause" ) || !Player.WaitForSettled() )
+		return false;
+
+	int TextureFrame = -1, StatusFrame = -1;
+	if ( !Player.ReadShownFrame( TextureFrame, StatusFrame ) )
+		return false;
+	fprintf( stderr, "paused on frame %d, texture has frame %d, %d mapped frames\n", StatusFrame, TextureFrame, PoolStats.mMappedFrames );
+	if ( !Check( TextureFrame == StatusFrame, "texture frame matches the status" ) )
+		return false;
+
+	return Check( Player.mFastTexture->GetCounters().mFramesUploaded > 0, "uploaded frames" );
+}
+
+//	plays backwards from a few gops in. Each frame should only be decoded about once, not once per chunk
+bool Test::PlaybackReverse()
+{
+	//	two gops fit in an instance's share of the pool
+	const int Gop = 12;
+	TPlayer Player( Gop );
+	if ( !Player.Init( false ) )
+		return false;
+
+	const int StartFrame = Gop*5;
+	if ( !Player.WaitFor( [&Player,StartFrame]()	{	return Player.GetShownFrameIndex() >= StartFrame;	}, "playing forward" ) )
+		return false;
+
+	auto& Counters = Player.mFastTexture->GetCounters();
+	int ReverseFrom = Player.GetShownFrameIndex();
+	uint64 DecodedBefore = Counters.mFramesDecoded;
+	if ( !Check( SetPlaybackRate( Player.mInstance, -1.f ), "SetPlaybackRate" ) )
+		return false;
+
+	//	going backwards, over a few gop boundaries
+	const int ReverseTo = ReverseFrom - Gop*3;
+	if ( !Player.WaitFor( [&Player,ReverseTo]()	{	return Player.GetShownFrameIndex() <= ReverseTo;	}, "playing backwards" ) )
+		return false;
+
+	if ( !Check( Pause( Player.mInstance ), "Pause" ) || !Player.WaitForSettled() )
+		return false;
+
+	int TextureFrame = -1, StatusFrame = -1;
+	if ( !Player.ReadShownFrame( TextureFrame, StatusFrame ) )
+		return false;
+	uint64 Decoded = Counters.mFramesDecoded - DecodedBefore;
+	int Shown = ReverseFrom - StatusFrame;
+	fprintf( stderr, "reversed from frame %d to %d, texture has frame %d, decoded %llu frames\n", ReverseFrom, StatusFrame, TextureFrame, static_cast<unsigned long long>( Decoded ) );
+	if ( !Check( TextureFrame == StatusFrame, "texture frame matches the status" ) )
+		return false;
+
+	//	the chunk we were in when we reversed, and the one being decoded ahead, on top
+	return Check( Decoded <= static_cast<uint64>( Shown + Gop*3 ), "each frame decoded about once" );
+}
+
+
+int main(int argc,char* argv[])
+{
+	struct TTest
+	{
+		const char*		mName;
+		bool			(*mFunction)();
+	};
+	const TTest Tests[] =
+	{
+		{ "playback_heap_frames",	Test::PlaybackHeapFrames	},
+		{ "playback_mapped_frames",	Test::PlaybackMappedFrames	},
+		{ "playback_reverse",		Test::PlaybackReverse		},
+	};
+
+	if ( argc >= 2 )
+	{
+		SetDebugLogFunction( Test::OnDebugLog );
+		for ( auto& Test : Tests )
+		{
+			if ( strcmp( Test.mName, argv[1] ) != 0 )
+				continue;
+			bool Passed = Test.mFunction();
+			fprintf( stderr, "%s: %s\n", Test.mName, Passed ? "passed" : "FAILED" );
+			return Passed ? 0 : 1;
+		}
+	}
+
+	fprintf( stderr, "usage: %s <test>\n", argv[0] );
+	for ( auto& Test : Tests )
+		fprintf( stderr, "\t%s\n", Test.mName );
+	return 1;
+}